@@ -0,0 +1,1717 @@
+/**
+ * @file bench.c
+ *
+ * @brief Benchmark harness for the Red-Black Tree.
+ *
+ * Each benchmark times a batch of operations and, where the hardware allows
+ * it, reads the performance counters declared in `perf.h` around the batch.
+ * Results are reported per operation, so a layout or algorithm change can be
+ * judged on e.g. cache misses per lookup instead of noisy wall-clock numbers
+ * alone. Counters that are unavailable are printed as `-`.
+ *
+ * Usage:
+ *
+ * @verbatim
+ *  ./bench [suite] [n]
+ * @endverbatim
+ *
+ * where @p suite is the name of one of the suites listed in `suites` (or
+ * `all`, the default) and @p n is the number of keys (default 1000000).
+ *
+ * @version 1.0
+ * @date 2024-02-27
+ * @author Warren Kim
+ */
+
+#include "rbt.h"
+#include "perf.h"
+#include "wal.h"
+#include "shared.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <limits.h>
+#include <time.h>
+#include <stdatomic.h>
+#include <unistd.h>
+
+/**
+ * \defgroup bench Benchmark Harness
+ *
+ * This section covers the helpers shared by every benchmark suite.
+ * Key operations include:
+ *
+ * - `bench_run()`: Times a batch of operations and reports per-operation costs.
+ * - `random_keys()`: Generates a reproducible array of random keys.
+ */
+
+/**
+ * \ingroup bench
+ * @brief A batch of operations to be measured.
+ *
+ * @param ctx The suite-specific state needed to run the batch.
+ */
+typedef void (*BenchFn)(void *ctx);
+
+/**
+ * \ingroup bench
+ * @brief The counters shared by every benchmark, opened once in `main()`.
+ */
+static PerfCounters counters;
+
+/**
+ * \ingroup bench
+ * @brief A sink for lookup results so the compiler cannot elide the lookups.
+ */
+static volatile uintptr_t sink;
+
+
+/**
+ * \ingroup bench
+ * @brief Returns the current value of a monotonic clock in seconds.
+ *
+ * @return The current time in seconds.
+ */
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+
+/**
+ * \ingroup bench
+ * @brief Prints the header of the results table.
+ */
+static void print_header(void) {
+    printf("%-36s %10s", "benchmark", "ns/op");
+    for (int i = 0; i < PERF_NUM_EVENTS; i++) {
+        printf(" %10s", perf_event_name(i));
+    }
+    printf("\n");
+}
+
+
+/**
+ * \ingroup bench
+ * @brief Times a batch of operations and reports per-operation costs.
+ *
+ * @param label A short description of the batch.
+ * @param ops   The number of operations performed by @p fn.
+ * @param fn    The batch to run.
+ * @param ctx   The state passed to @p fn.
+ */
+static void bench_run(const char *label, size_t ops, BenchFn fn, void *ctx) {
+    perf_start(&counters);
+    double start = now();
+    fn(ctx);
+    double elapsed = now() - start;
+    perf_stop(&counters);
+
+    printf("%-36s %10.1f", label, elapsed * 1e9 / ops);
+    for (int i = 0; i < PERF_NUM_EVENTS; i++) {
+        if (perf_available(&counters, i)) {
+            printf(" %10.2f", counters.value[i] / ops);
+        } else {
+            printf(" %10s", "-");
+        }
+    }
+    printf("\n");
+}
+
+
+/**
+ * \ingroup bench
+ * @brief Generates a reproducible array of random keys.
+ *
+ * Uses a xorshift generator with a fixed seed so every run measures the same
+ * workload.
+ *
+ * @param n    The number of keys to generate.
+ * @param seed The seed of the generator; must be non-zero.
+ * @return     A heap allocated array of @p n keys. The caller frees it.
+ */
+static int *random_keys(size_t n, uint32_t seed) {
+    int *keys = (int *)malloc(n * sizeof(int));
+    if (!keys) {
+        perror("random_keys(): malloc failed");
+        exit(1);
+    }
+
+    for (size_t i = 0; i < n; i++) {
+        seed ^= seed << 13;
+        seed ^= seed >> 17;
+        seed ^= seed << 5;
+        keys[i] = (int)(seed & 0x7fffffff);
+    }
+
+    return keys;
+}
+
+
+
+
+
+/**
+ * \defgroup bench_basic Basic Operations
+ *
+ * Measures `rbt_insert()` and `rbt_search()` on random and sorted inputs.
+ */
+
+/**
+ * \ingroup bench_basic
+ * @brief State shared by the basic benchmarks.
+ */
+typedef struct {
+    Tree *tree;
+    int *keys;
+    size_t n;
+} BasicCtx;
+
+
+/**
+ * \ingroup bench_basic
+ * @brief Inserts every key of the context into its tree.
+ */
+static void run_insert(void *ctx) {
+    BasicCtx *c = (BasicCtx *)ctx;
+    for (size_t i = 0; i < c->n; i++) {
+        rbt_insert(c->tree, c->keys[i]);
+    }
+}
+
+
+/**
+ * \ingroup bench_basic
+ * @brief Searches for every key of the context in its tree.
+ */
+static void run_search(void *ctx) {
+    BasicCtx *c = (BasicCtx *)ctx;
+    for (size_t i = 0; i < c->n; i++) {
+        sink += (uintptr_t)rbt_search(c->tree, c->keys[i]);
+    }
+}
+
+
+/**
+ * \ingroup bench_basic
+ * @brief Runs the basic insert and search benchmarks.
+ *
+ * @param n The number of keys.
+ */
+static void suite_basic(size_t n) {
+    int *keys = random_keys(n, 2463534242u);
+    int *misses = random_keys(n, 88675123u);
+    int *sorted = (int *)malloc(n * sizeof(int));
+    if (!sorted) {
+        perror("suite_basic(): malloc failed");
+        exit(1);
+    }
+    for (size_t i = 0; i < n; i++) {
+        sorted[i] = (int)i;
+    }
+
+    BasicCtx c = { rbt_init(), keys, n };
+    bench_run("insert (random)", n, run_insert, &c);
+    bench_run("search hit (random)", n, run_search, &c);
+    c.keys = misses;
+    bench_run("search miss (random)", n, run_search, &c);
+    rbt_destroy(c.tree);
+
+    c = (BasicCtx){ rbt_init(), sorted, n };
+    bench_run("insert (sorted)", n, run_insert, &c);
+    bench_run("search hit (sorted)", n, run_search, &c);
+    rbt_destroy(c.tree);
+
+    free(keys);
+    free(misses);
+    free(sorted);
+}
+
+
+
+
+
+/**
+ * \defgroup bench_hint Hinted Insertion
+ *
+ * Measures `rbt_insert_hint()` and `rbt_search_from()` against their
+ * root-based counterparts on monotonic and jittered-monotonic streams, such
+ * as timestamps or sequence IDs.
+ */
+
+/**
+ * \ingroup bench_hint
+ * @brief Inserts every key of the context, using the previous node as the hint.
+ */
+static void run_insert_hint(void *ctx) {
+    BasicCtx *c = (BasicCtx *)ctx;
+    Node *hint = NULL;
+    for (size_t i = 0; i < c->n; i++) {
+        hint = rbt_insert_hint(c->tree, hint, c->keys[i]);
+    }
+}
+
+
+/**
+ * \ingroup bench_hint
+ * @brief Searches for every key of the context, using the previous result as
+ *        the finger.
+ */
+static void run_search_from(void *ctx) {
+    BasicCtx *c = (BasicCtx *)ctx;
+    Node *finger = NULL;
+    for (size_t i = 0; i < c->n; i++) {
+        Node *found = rbt_search_from(c->tree, finger, c->keys[i]);
+        finger = found ? found : finger;
+        sink += (uintptr_t)found;
+    }
+}
+
+
+/**
+ * \ingroup bench_hint
+ * @brief Runs the hinted insertion and finger search benchmarks.
+ *
+ * @param n The number of keys.
+ */
+static void suite_hint(size_t n) {
+    int *jitter = random_keys(n, 521288629u);
+    int *monotonic = (int *)malloc(n * sizeof(int));
+    int *jittered = (int *)malloc(n * sizeof(int));
+    if (!monotonic || !jittered) {
+        perror("suite_hint(): malloc failed");
+        exit(1);
+    }
+    for (size_t i = 0; i < n; i++) {
+        monotonic[i] = (int)i * 4;
+        jittered[i] = (int)i * 4 + jitter[i] % 64 - 32;
+    }
+
+    const struct { const char *name; int *keys; } streams[] = {
+        { "monotonic", monotonic },
+        { "jittered", jittered },
+    };
+
+    for (size_t s = 0; s < sizeof(streams) / sizeof(streams[0]); s++) {
+        char label[64];
+        BasicCtx c = { rbt_init(), streams[s].keys, n };
+        snprintf(label, sizeof(label), "insert (%s)", streams[s].name);
+        bench_run(label, n, run_insert, &c);
+        snprintf(label, sizeof(label), "search (%s)", streams[s].name);
+        bench_run(label, n, run_search, &c);
+        rbt_destroy(c.tree);
+
+        c.tree = rbt_init();
+        snprintf(label, sizeof(label), "insert_hint (%s)", streams[s].name);
+        bench_run(label, n, run_insert_hint, &c);
+        snprintf(label, sizeof(label), "search_from (%s)", streams[s].name);
+        bench_run(label, n, run_search_from, &c);
+        rbt_destroy(c.tree);
+    }
+
+    free(jitter);
+    free(monotonic);
+    free(jittered);
+}
+
+
+
+
+
+/**
+ * \defgroup bench_pq Priority Queue
+ *
+ * Measures the tree used as a scheduler queue ordered by deadline: each
+ * operation removes the earliest deadline and reschedules it later.
+ */
+
+/**
+ * \ingroup bench_pq
+ * @brief Reschedules the minimum by walking the left spine, then searching
+ *        for it again to delete it.
+ */
+static void run_pq_walk(void *ctx) {
+    BasicCtx *c = (BasicCtx *)ctx;
+    for (size_t i = 0; i < c->n; i++) {
+        Node *x = c->tree->root;
+        while (x->left) {
+            x = x->left;
+        }
+        int deadline = x->data;
+        rbt_delete(c->tree, deadline);
+        rbt_insert(c->tree, deadline + c->keys[i] % 1024);
+    }
+}
+
+
+/**
+ * \ingroup bench_pq
+ * @brief Reschedules the minimum using the cached minimum.
+ */
+static void run_pq_pop(void *ctx) {
+    BasicCtx *c = (BasicCtx *)ctx;
+    for (size_t i = 0; i < c->n; i++) {
+        int deadline;
+        rbt_pop_min(c->tree, &deadline);
+        rbt_insert(c->tree, deadline + c->keys[i] % 1024);
+    }
+}
+
+
+/**
+ * \ingroup bench_pq
+ * @brief Runs the priority queue benchmarks.
+ *
+ * @param n The number of keys.
+ */
+static void suite_pq(size_t n) {
+    int *keys = random_keys(n, 3141592653u);
+
+    BasicCtx c = { rbt_init(), keys, n };
+    run_insert(&c);
+    bench_run("pq reschedule (spine walk + delete)", n, run_pq_walk, &c);
+    rbt_destroy(c.tree);
+
+    const struct { const char *name; Engine engine; } engines[] = {
+        { "pq reschedule (rbt_pop_min)", RBT_ENGINE_RB },
+        { "pq reschedule (rbt_pop_min, b+)", RBT_ENGINE_BPLUS },
+        { "pq reschedule (rbt_pop_min, bucket)", RBT_ENGINE_BUCKET },
+    };
+    for (size_t e = 0; e < sizeof(engines) / sizeof(engines[0]); e++) {
+        c.tree = rbt_init_engine(engines[e].engine);
+        run_insert(&c);
+        bench_run(engines[e].name, n, run_pq_pop, &c);
+        rbt_destroy(c.tree);
+    }
+
+    free(keys);
+}
+
+
+
+
+
+/**
+ * \defgroup bench_scan Full Scans
+ *
+ * Measures a full in-order scan using recursion, as `rbt_inorder()` does,
+ * against iteration with `rbt_next()`. Build with `FEATURES=-DRBT_THREADED`
+ * to measure the threaded successor links.
+ */
+
+/**
+ * \ingroup bench_scan
+ * @brief Sums the subtree rooted at @p root recursively, in order.
+ */
+static long long sum_recursive(Node *root) {
+    if (!root) {
+        return 0;
+    }
+
+    return sum_recursive(root->left) + root->data + sum_recursive(root->right);
+}
+
+
+/**
+ * \ingroup bench_scan
+ * @brief Scans the tree of the context recursively, @p n times over.
+ */
+static void run_scan_recursive(void *ctx) {
+    BasicCtx *c = (BasicCtx *)ctx;
+    for (size_t i = 0; i < c->n; i++) {
+        sink += sum_recursive(c->tree->root);
+    }
+}
+
+
+/**
+ * \ingroup bench_scan
+ * @brief Scans the tree of the context with `rbt_next()`, @p n times over.
+ */
+static void run_scan_next(void *ctx) {
+    BasicCtx *c = (BasicCtx *)ctx;
+    for (size_t i = 0; i < c->n; i++) {
+        long long sum = 0;
+        for (Node *x = rbt_min(c->tree); x; x = rbt_next(x)) {
+            sum += x->data;
+        }
+        sink += sum;
+    }
+}
+
+
+/**
+ * \ingroup bench_scan
+ * @brief Runs the full scan benchmarks.
+ *
+ * @param n The number of keys.
+ */
+static void suite_scan(size_t n) {
+    int *keys = random_keys(n, 1234567u);
+    size_t rounds = 10;
+
+    BasicCtx c = { rbt_init(), keys, n };
+    run_insert(&c);
+
+    c.n = rounds;
+    bench_run("scan per node (recursive)", rounds * n, run_scan_recursive, &c);
+#ifdef RBT_THREADED
+    bench_run("scan per node (rbt_next, threaded)", rounds * n, run_scan_next, &c);
+#else
+    bench_run("scan per node (rbt_next)", rounds * n, run_scan_next, &c);
+#endif
+    rbt_destroy(c.tree);
+
+    free(keys);
+}
+
+
+
+
+
+/**
+ * \defgroup bench_engines Engines
+ *
+ * Measures the same workload side by side on every engine selectable with
+ * `rbt_init_engine()`, through the engine-independent `rbt_*` functions.
+ */
+
+/**
+ * \ingroup bench_engines
+ * @brief Looks up every key of the context with `rbt_contains()`.
+ */
+static void run_contains(void *ctx) {
+    BasicCtx *c = (BasicCtx *)ctx;
+    for (size_t i = 0; i < c->n; i++) {
+        sink += rbt_contains(c->tree, c->keys[i]);
+    }
+}
+
+
+/**
+ * \ingroup bench_engines
+ * @brief Counts the values visited by a range scan.
+ */
+static void count_visit(int data, void *ctx) {
+    (void)data;
+    (*(size_t *)ctx)++;
+}
+
+
+/**
+ * \ingroup bench_engines
+ * @brief Scans a short range starting at every key of the context.
+ *
+ * The ranges are 2^16 wide, i.e. about 32 keys each for a million random keys.
+ */
+static void run_range(void *ctx) {
+    BasicCtx *c = (BasicCtx *)ctx;
+    size_t visited = 0;
+    for (size_t i = 0; i < c->n; i++) {
+        int hi = c->keys[i] > INT_MAX - (1 << 16) ? INT_MAX : c->keys[i] + (1 << 16);
+        rbt_range(c->tree, c->keys[i], hi, count_visit, &visited);
+    }
+    sink += visited;
+}
+
+
+/**
+ * \ingroup bench_engines
+ * @brief Deletes every key of the context.
+ */
+static void run_delete(void *ctx) {
+    BasicCtx *c = (BasicCtx *)ctx;
+    for (size_t i = 0; i < c->n; i++) {
+        rbt_delete(c->tree, c->keys[i]);
+    }
+}
+
+
+/**
+ * \ingroup bench_engines
+ * @brief Runs the engine comparison benchmarks.
+ *
+ * @param n The number of keys.
+ */
+static void suite_engines(size_t n) {
+    int *keys = random_keys(n, 2463534242u);
+    int *misses = random_keys(n, 88675123u);
+    size_t scans = n / 10 ? n / 10 : 1;
+    const struct { const char *name; Engine engine; } engines[] = {
+        { "rb", RBT_ENGINE_RB },
+        { "b+", RBT_ENGINE_BPLUS },
+        { "bucket", RBT_ENGINE_BUCKET },
+    };
+
+    for (size_t e = 0; e < sizeof(engines) / sizeof(engines[0]); e++) {
+        char label[64];
+        BasicCtx c = { rbt_init_engine(engines[e].engine), keys, n };
+
+        snprintf(label, sizeof(label), "%s: insert (random)", engines[e].name);
+        bench_run(label, n, run_insert, &c);
+        snprintf(label, sizeof(label), "%s: contains hit", engines[e].name);
+        bench_run(label, n, run_contains, &c);
+        c.keys = misses;
+        snprintf(label, sizeof(label), "%s: contains miss", engines[e].name);
+        bench_run(label, n, run_contains, &c);
+        c.keys = keys;
+        c.n = scans;
+        snprintf(label, sizeof(label), "%s: range scan (~32 keys)", engines[e].name);
+        bench_run(label, scans, run_range, &c);
+        c.n = n;
+        snprintf(label, sizeof(label), "%s: delete (random)", engines[e].name);
+        bench_run(label, n, run_delete, &c);
+        rbt_destroy(c.tree);
+    }
+
+    free(keys);
+    free(misses);
+}
+
+
+
+
+
+/**
+ * \defgroup bench_intrusive Intrusive Trees
+ *
+ * Measures records that are indexed by key: once with the owning interface,
+ * where every insertion allocates a separate `Node`, and once with the
+ * intrusive interface, where the `Node` is embedded in the record itself.
+ */
+
+/**
+ * \ingroup bench_intrusive
+ * @brief A caller-owned record with an embedded link.
+ */
+typedef struct {
+    int key;
+    int payload[7];
+    Node link;
+} Record;
+
+/**
+ * \ingroup bench_intrusive
+ * @brief State shared by the intrusive benchmarks.
+ */
+typedef struct {
+    Tree *tree;
+    Record *records;
+    size_t n;
+} RecordCtx;
+
+
+/**
+ * \ingroup bench_intrusive
+ * @brief Orders two records by key.
+ */
+static int record_cmp(const Node *a, const Node *b) {
+    int x = rbt_entry(a, Record, link)->key;
+    int y = rbt_entry(b, Record, link)->key;
+    return (x > y) - (x < y);
+}
+
+
+/**
+ * \ingroup bench_intrusive
+ * @brief Compares a key with a record.
+ */
+static int record_key_cmp(const void *key, const Node *node) {
+    int x = *(const int *)key;
+    int y = rbt_entry(node, Record, link)->key;
+    return (x > y) - (x < y);
+}
+
+
+/**
+ * \ingroup bench_intrusive
+ * @brief Indexes every record by allocating a node for its key.
+ */
+static void run_owned_insert(void *ctx) {
+    RecordCtx *c = (RecordCtx *)ctx;
+    for (size_t i = 0; i < c->n; i++) {
+        rbt_insert(c->tree, c->records[i].key);
+    }
+}
+
+
+/**
+ * \ingroup bench_intrusive
+ * @brief Looks up every record's key in the owning tree.
+ */
+static void run_owned_search(void *ctx) {
+    RecordCtx *c = (RecordCtx *)ctx;
+    for (size_t i = 0; i < c->n; i++) {
+        sink += (uintptr_t)rbt_search(c->tree, c->records[i].key);
+    }
+}
+
+
+/**
+ * \ingroup bench_intrusive
+ * @brief Links every record into the intrusive tree.
+ */
+static void run_intrusive_link(void *ctx) {
+    RecordCtx *c = (RecordCtx *)ctx;
+    for (size_t i = 0; i < c->n; i++) {
+        rbt_link(c->tree, &c->records[i].link, record_cmp);
+    }
+}
+
+
+/**
+ * \ingroup bench_intrusive
+ * @brief Looks up every record's key in the intrusive tree.
+ */
+static void run_intrusive_find(void *ctx) {
+    RecordCtx *c = (RecordCtx *)ctx;
+    for (size_t i = 0; i < c->n; i++) {
+        sink += (uintptr_t)rbt_find(c->tree, &c->records[i].key, record_key_cmp);
+    }
+}
+
+
+/**
+ * \ingroup bench_intrusive
+ * @brief Runs the intrusive tree benchmarks.
+ *
+ * @param n The number of records.
+ */
+static void suite_intrusive(size_t n) {
+    int *keys = random_keys(n, 2463534242u);
+    Record *records = (Record *)calloc(n, sizeof(Record));
+    if (!records) {
+        perror("suite_intrusive(): calloc failed");
+        exit(1);
+    }
+    for (size_t i = 0; i < n; i++) {
+        records[i].key = keys[i];
+    }
+
+    RecordCtx c = { rbt_init(), records, n };
+    bench_run("owned: insert (allocating)", n, run_owned_insert, &c);
+    bench_run("owned: search", n, run_owned_search, &c);
+    rbt_destroy(c.tree);
+
+    Tree tree;
+    rbt_init_intrusive(&tree);
+    c.tree = &tree;
+    bench_run("intrusive: link", n, run_intrusive_link, &c);
+    bench_run("intrusive: find", n, run_intrusive_find, &c);
+
+    free(records);
+    free(keys);
+}
+
+
+
+
+
+/**
+ * \defgroup bench_purge Range Purges
+ *
+ * Measures a retention job that drops the older half of a tree of
+ * timestamps: one `rbt_delete()` per key, against `rbt_erase_range()`, and
+ * against `rbt_detach_range()` alone (i.e. with freeing left to a reclaimer).
+ */
+
+/**
+ * \ingroup bench_purge
+ * @brief State shared by the range purge benchmarks.
+ */
+typedef struct {
+    Tree *tree;
+    size_t n;
+    Node *detached;
+} PurgeCtx;
+
+
+/**
+ * \ingroup bench_purge
+ * @brief Deletes the keys 0 to n - 1 one at a time.
+ */
+static void run_purge_each(void *ctx) {
+    PurgeCtx *c = (PurgeCtx *)ctx;
+    for (size_t i = 0; i < c->n; i++) {
+        rbt_delete(c->tree, (int)i);
+    }
+}
+
+
+/**
+ * \ingroup bench_purge
+ * @brief Deletes the keys 0 to n - 1 with a single range erase.
+ */
+static void run_purge_range(void *ctx) {
+    PurgeCtx *c = (PurgeCtx *)ctx;
+    sink += rbt_erase_range(c->tree, 0, (int)c->n - 1);
+}
+
+
+/**
+ * \ingroup bench_purge
+ * @brief Detaches the keys 0 to n - 1 without freeing them.
+ */
+static void run_purge_detach(void *ctx) {
+    PurgeCtx *c = (PurgeCtx *)ctx;
+    c->detached = rbt_detach_range(c->tree, 0, (int)c->n - 1, NULL);
+}
+
+
+/**
+ * \ingroup bench_purge
+ * @brief Runs the range purge benchmarks.
+ *
+ * @param n The number of keys; the older half is purged.
+ */
+static void suite_purge(size_t n) {
+    const struct { const char *name; BenchFn run; } purges[] = {
+        { "purge (rbt_delete each)", run_purge_each },
+        { "purge (rbt_erase_range)", run_purge_range },
+        { "purge (rbt_detach_range)", run_purge_detach },
+    };
+
+    for (size_t p = 0; p < sizeof(purges) / sizeof(purges[0]); p++) {
+        PurgeCtx c = { rbt_init(), n / 2 ? n / 2 : 1, NULL };
+        Node *hint = NULL;
+        for (size_t i = 0; i < n; i++) {
+            hint = rbt_insert_hint(c.tree, hint, (int)i);
+        }
+
+        bench_run(purges[p].name, c.n, purges[p].run, &c);
+        rbt_free_detached(c.detached);
+        rbt_destroy(c.tree);
+    }
+}
+
+
+
+
+
+/**
+ * \defgroup bench_wal Write-Ahead Log
+ *
+ * Measures the cost of durability: random inserts without a log, with group
+ * commit (a sync per 64 KiB or 10 ms of records), and with a sync per insert
+ * (on fewer keys, since every insert then waits for the disk). Recovery is
+ * measured from a checkpoint of the tree followed by a log of equal size.
+ * The log lives in `$TMPDIR` (default `/tmp`).
+ */
+
+/**
+ * \ingroup bench_wal
+ * @brief State shared by the write-ahead log benchmarks.
+ */
+typedef struct {
+    Tree *tree;
+    const char *path;
+} WalCtx;
+
+
+/**
+ * \ingroup bench_wal
+ * @brief Removes the files of the log at a base path.
+ */
+static void wal_remove(const char *path) {
+    char file[4096];
+    snprintf(file, sizeof(file), "%s.log", path);
+    remove(file);
+    snprintf(file, sizeof(file), "%s.ckpt", path);
+    remove(file);
+}
+
+
+/**
+ * \ingroup bench_wal
+ * @brief Rebuilds the tree from the log at the context's path.
+ */
+static void run_recover(void *ctx) {
+    WalCtx *c = (WalCtx *)ctx;
+    c->tree = wal_recover(c->path, RBT_ENGINE_RB);
+}
+
+
+/**
+ * \ingroup bench_wal
+ * @brief Runs the write-ahead log benchmarks.
+ *
+ * @param n The number of keys.
+ */
+static void suite_wal(size_t n) {
+    const char *dir = getenv("TMPDIR") ? getenv("TMPDIR") : "/tmp";
+    char path[4000];
+    snprintf(path, sizeof(path), "%s/rbt-bench-wal", dir);
+    int *keys = random_keys(n, 2654435761u);
+
+    const struct { const char *name; bool log; size_t group_bytes; long interval_ms; size_t n; } modes[] = {
+        { "insert (no log)", false, 0, -1, n },
+        { "insert (wal, group commit)", true, 64 * 1024, 10, n },
+        { "insert (wal, sync each)", true, 0, -1, n < 1000 ? n : 1000 },
+    };
+
+    for (size_t m = 0; m < sizeof(modes) / sizeof(modes[0]); m++) {
+        wal_remove(path);
+        BasicCtx c = { rbt_init(), keys, modes[m].n };
+        Wal *wal = modes[m].log ? wal_open(path, modes[m].group_bytes, modes[m].interval_ms) : NULL;
+        rbt_attach_wal(c.tree, wal);
+
+        bench_run(modes[m].name, c.n, run_insert, &c);
+        wal_close(wal);
+        rbt_destroy(c.tree);
+    }
+
+    /* half the keys in a checkpoint, the other half in the log after it */
+    wal_remove(path);
+    Tree *tree = rbt_init();
+    Wal *wal = wal_open(path, 64 * 1024, -1);
+    rbt_attach_wal(tree, wal);
+    for (size_t i = 0; i < n / 2; i++) {
+        rbt_insert(tree, keys[i]);
+    }
+    wal_checkpoint(wal, tree);
+    for (size_t i = n / 2; i < n; i++) {
+        rbt_insert(tree, keys[i]);
+    }
+    wal_close(wal);
+    rbt_destroy(tree);
+
+    WalCtx r = { NULL, path };
+    bench_run("recover (checkpoint + log)", n, run_recover, &r);
+    if (r.tree->size != n) {
+        fprintf(stderr, "recover: expected %zu keys, got %zu\n", n, r.tree->size);
+    }
+    rbt_destroy(r.tree);
+
+    wal_remove(path);
+    free(keys);
+}
+
+
+
+
+
+/**
+ * \defgroup bench_memory Memory Footprint
+ *
+ * Reports the footprint of each engine holding the same random keys, then
+ * lists the live trees with `rbt_registry_dump()`. The time reported is that
+ * of `rbt_memory_usage()` itself, per node visited.
+ */
+
+/**
+ * \ingroup bench_memory
+ * @brief Measures the footprint of the context's tree.
+ */
+static void run_memory_usage(void *ctx) {
+    BasicCtx *c = (BasicCtx *)ctx;
+    sink += rbt_memory_usage(c->tree).total_bytes;
+}
+
+
+/**
+ * \ingroup bench_memory
+ * @brief Runs the memory footprint benchmarks.
+ *
+ * @param n The number of keys.
+ */
+static void suite_memory(size_t n) {
+    const struct { const char *name; Engine engine; } engines[] = {
+        { "memory_usage (rb)", RBT_ENGINE_RB },
+        { "memory_usage (bplus)", RBT_ENGINE_BPLUS },
+        { "memory_usage (bkt)", RBT_ENGINE_BUCKET },
+    };
+    int *keys = random_keys(n, 362436069u);
+    Tree *trees[sizeof(engines) / sizeof(engines[0])];
+
+    for (size_t e = 0; e < sizeof(engines) / sizeof(engines[0]); e++) {
+        BasicCtx c = { rbt_init_engine(engines[e].engine), keys, n };
+        rbt_set_name(c.tree, engines[e].name);
+        run_insert(&c);
+        bench_run(engines[e].name, n, run_memory_usage, &c);
+        trees[e] = c.tree;
+    }
+
+    printf("\n");
+    rbt_registry_dump(stdout);
+    printf("\n");
+
+    for (size_t e = 0; e < sizeof(engines) / sizeof(engines[0]); e++) {
+        rbt_destroy(trees[e]);
+    }
+    free(keys);
+}
+
+
+
+
+
+#ifdef RBT_INTERVAL
+/**
+ * \defgroup bench_interval Interval Overlap Queries
+ *
+ * Only built with `RBT_INTERVAL`. Stores n time ranges of up to 1000 ticks
+ * spread over 100 n ticks, and answers "which ranges overlap this window"
+ * for random windows of up to 1000 ticks, with the interval tree and with a
+ * linear scan over an array of the same ranges (on fewer queries, since each
+ * scan costs O(n)).
+ */
+
+/**
+ * \ingroup bench_interval
+ * @brief State shared by the interval benchmarks.
+ */
+typedef struct {
+    Tree *tree;
+    int *lows;
+    int *highs;
+    size_t n;
+    int *queries;
+    size_t q;
+} IntervalCtx;
+
+
+/**
+ * \ingroup bench_interval
+ * @brief Answers every query window with `rbt_interval_overlaps()`.
+ */
+static void run_overlaps_tree(void *ctx) {
+    IntervalCtx *c = (IntervalCtx *)ctx;
+    for (size_t i = 0; i < c->q; i++) {
+        sink += rbt_interval_overlaps(c->tree, c->queries[i], c->queries[i] + 1000, NULL, NULL);
+    }
+}
+
+
+/**
+ * \ingroup bench_interval
+ * @brief Answers every query window by scanning every range.
+ */
+static void run_overlaps_scan(void *ctx) {
+    IntervalCtx *c = (IntervalCtx *)ctx;
+    for (size_t i = 0; i < c->q; i++) {
+        int a = c->queries[i];
+        int b = a + 1000;
+        size_t count = 0;
+        for (size_t j = 0; j < c->n; j++) {
+            count += c->lows[j] <= b && c->highs[j] >= a;
+        }
+        sink += count;
+    }
+}
+
+
+/**
+ * \ingroup bench_interval
+ * @brief Answers every query window's start with `rbt_interval_stab()`.
+ */
+static void run_stab_tree(void *ctx) {
+    IntervalCtx *c = (IntervalCtx *)ctx;
+    for (size_t i = 0; i < c->q; i++) {
+        sink += rbt_interval_stab(c->tree, c->queries[i], NULL, NULL);
+    }
+}
+
+
+/**
+ * \ingroup bench_interval
+ * @brief Runs the interval benchmarks.
+ *
+ * @param n The number of intervals.
+ */
+static void suite_interval(size_t n) {
+    int *lows = random_keys(n, 1013904223u);
+    int *highs = random_keys(n, 1664525u);
+    int *queries = random_keys(10000, 69069u);
+    long span = (long)n * 100;
+
+    IntervalCtx c = { rbt_init(), lows, highs, n, queries, 10000 };
+    for (size_t i = 0; i < n; i++) {
+        lows[i] = (int)((unsigned)lows[i] % span);
+        highs[i] = lows[i] + (int)((unsigned)highs[i] % 1000);
+        rbt_insert_interval(c.tree, lows[i], highs[i]);
+    }
+    for (size_t i = 0; i < c.q; i++) {
+        queries[i] = (int)((unsigned)queries[i] % span);
+    }
+
+    bench_run("overlaps (interval tree)", c.q, run_overlaps_tree, &c);
+    bench_run("stab (interval tree)", c.q, run_stab_tree, &c);
+    c.q = 100;
+    bench_run("overlaps (linear scan)", c.q, run_overlaps_scan, &c);
+
+    rbt_destroy(c.tree);
+    free(lows);
+    free(highs);
+    free(queries);
+}
+#endif
+
+
+
+
+
+#ifdef RBT_AUGMENT
+/**
+ * \defgroup bench_aggregate Range Aggregates
+ *
+ * Only built with `RBT_AUGMENT`. Aggregates the values of random key ranges
+ * covering about 1% of the keys, with `rbt_range_aggregate()` and by visiting
+ * every key in the range with `rbt_range()`, as was needed before.
+ */
+
+/**
+ * \ingroup bench_aggregate
+ * @brief State shared by the range aggregate benchmarks.
+ */
+typedef struct {
+    Tree *tree;
+    int *queries;
+    size_t q;
+    int width;
+    RbtAgg acc;
+} AggregateCtx;
+
+
+/**
+ * \ingroup bench_aggregate
+ * @brief Folds a visited value into an `AggregateCtx`; an `RbtVisitor`.
+ */
+static void aggregate_visit(int data, void *ctx) {
+    AggregateCtx *c = (AggregateCtx *)ctx;
+    c->acc = RBT_AGG_COMBINE(c->acc, RBT_AGG_LIFT(data));
+}
+
+
+/**
+ * \ingroup bench_aggregate
+ * @brief Answers every query with `rbt_range_aggregate()`.
+ */
+static void run_aggregate_tree(void *ctx) {
+    AggregateCtx *c = (AggregateCtx *)ctx;
+    for (size_t i = 0; i < c->q; i++) {
+        sink += (uintptr_t)rbt_range_aggregate(c->tree, c->queries[i], c->queries[i] + c->width);
+    }
+}
+
+
+/**
+ * \ingroup bench_aggregate
+ * @brief Answers every query by visiting each key in the range.
+ */
+static void run_aggregate_walk(void *ctx) {
+    AggregateCtx *c = (AggregateCtx *)ctx;
+    for (size_t i = 0; i < c->q; i++) {
+        c->acc = RBT_AGG_IDENTITY;
+        rbt_range(c->tree, c->queries[i], c->queries[i] + c->width, aggregate_visit, c);
+        sink += (uintptr_t)c->acc;
+    }
+}
+
+
+/**
+ * \ingroup bench_aggregate
+ * @brief Runs the range aggregate benchmarks.
+ *
+ * @param n The number of keys.
+ */
+static void suite_aggregate(size_t n) {
+    int *queries = random_keys(10000, 5381u);
+    AggregateCtx c = { rbt_init(), queries, 10000, (int)(n / 100), RBT_AGG_IDENTITY };
+
+    Node *hint = NULL;
+    for (size_t i = 0; i < n; i++) {
+        hint = rbt_insert_hint(c.tree, hint, (int)i);
+    }
+    for (size_t i = 0; i < c.q; i++) {
+        queries[i] = (int)((unsigned)queries[i] % (n ? n : 1));
+    }
+
+    bench_run("range aggregate (augmented)", c.q, run_aggregate_tree, &c);
+    c.q = 1000;
+    bench_run("range aggregate (rbt_range walk)", c.q, run_aggregate_walk, &c);
+
+    rbt_destroy(c.tree);
+    free(queries);
+}
+#endif
+
+
+
+
+
+/**
+ * \defgroup bench_compact Compaction
+ *
+ * Simulates hours of churn on a tree of n random keys (n random deletions and
+ * insertions, so that neighbors in the tree end up far apart in memory), then
+ * compares random lookups before and after compacting it with
+ * `rbt_compact()` in slices of 1000 nodes.
+ */
+
+/**
+ * \ingroup bench_compact
+ * @brief Runs a compaction pass to completion in slices of 1000 nodes.
+ */
+static void run_compact(void *ctx) {
+    BasicCtx *c = (BasicCtx *)ctx;
+    while (!rbt_compact(c->tree, 1000)) {
+    }
+}
+
+
+/**
+ * \ingroup bench_compact
+ * @brief Runs the compaction benchmarks.
+ *
+ * @param n The number of keys.
+ */
+static void suite_compact(size_t n) {
+    int *keys = random_keys(n, 19650218u);
+    int *churn = random_keys(n, 4357u);
+    BasicCtx c = { rbt_init(), keys, n };
+
+    run_insert(&c);
+    for (size_t i = 0; i < n; i++) {
+        rbt_delete(c.tree, keys[i]);
+        rbt_insert(c.tree, churn[i]);
+        keys[i] = churn[i];
+    }
+
+    /* look the keys up in an order unrelated to their insertion */
+    BasicCtx lookups = { c.tree, random_keys(n, 4357u), n };
+    for (size_t i = n; i > 1; i--) {
+        size_t j = (size_t)keys[i - 1] % i;
+        int t = lookups.keys[i - 1];
+        lookups.keys[i - 1] = lookups.keys[j];
+        lookups.keys[j] = t;
+    }
+
+    bench_run("search (after churn)", n, run_search, &lookups);
+    bench_run("rbt_compact (per node)", n, run_compact, &c);
+    bench_run("search (compacted)", n, run_search, &lookups);
+
+    rbt_destroy(c.tree);
+    free(lookups.keys);
+    free(churn);
+    free(keys);
+}
+
+
+
+
+
+/**
+ * \defgroup bench_small Small Sets
+ *
+ * Models one tree per tenant: n / 8 trees of 8 random keys each, built on
+ * the Red-Black and the adaptive engine. Reports lookups of random tenants'
+ * keys and the footprint per tree from `rbt_memory_usage()`.
+ */
+
+/**
+ * \ingroup bench_small
+ * @brief State shared by the small set benchmarks.
+ */
+typedef struct {
+    Tree **trees;
+    size_t count;
+    int *keys;
+} SmallCtx;
+
+
+/**
+ * \ingroup bench_small
+ * @brief Looks up one key in each tree, visiting the trees in random order.
+ */
+static void run_small_contains(void *ctx) {
+    SmallCtx *c = (SmallCtx *)ctx;
+    for (size_t i = 0; i < c->count; i++) {
+        size_t t = (unsigned)c->keys[i] % c->count;
+        sink += rbt_contains(c->trees[t], c->keys[t * 8 + i % 8]);
+    }
+}
+
+
+/**
+ * \ingroup bench_small
+ * @brief Runs the small set benchmarks.
+ *
+ * @param n The total number of keys.
+ */
+static void suite_small(size_t n) {
+    const struct { const char *name; const char *mem; Engine engine; } engines[] = {
+        { "contains (small sets, rb)", "bytes per set (rb)", RBT_ENGINE_RB },
+        { "contains (small sets, adaptive)", "bytes per set (adaptive)", RBT_ENGINE_ADAPTIVE },
+    };
+    size_t count = n / 8 ? n / 8 : 1;
+    int *keys = random_keys(count * 8, 123459876u);
+
+    for (size_t e = 0; e < sizeof(engines) / sizeof(engines[0]); e++) {
+        SmallCtx c = { (Tree **)malloc(count * sizeof(Tree *)), count, keys };
+        if (!c.trees) {
+            perror("suite_small(): malloc failed");
+            exit(1);
+        }
+
+        size_t bytes = 0;
+        for (size_t t = 0; t < count; t++) {
+            c.trees[t] = rbt_init_engine(engines[e].engine);
+            for (size_t i = 0; i < 8; i++) {
+                rbt_insert(c.trees[t], keys[t * 8 + i]);
+            }
+            bytes += rbt_memory_usage(c.trees[t]).total_bytes;
+        }
+
+        bench_run(engines[e].name, count, run_small_contains, &c);
+        printf("%-36s %9zu\n", engines[e].mem, bytes / count);
+
+        for (size_t t = 0; t < count; t++) {
+            rbt_destroy(c.trees[t]);
+        }
+        free(c.trees);
+    }
+    free(keys);
+}
+
+
+
+
+
+/**
+ * \defgroup bench_shared Shared Tree
+ *
+ * Publishes a tree of n random keys into a shared tree file and looks the
+ * keys up through a read-only mapping of it, next to the same lookups on the
+ * private Red-Black tree. Also reports the bytes per value of each; the file
+ * is shared by every process mapping it, the tree is not.
+ */
+
+/**
+ * \ingroup bench_shared
+ * @brief State shared by the shared tree benchmarks.
+ */
+typedef struct {
+    SharedTree *shared;
+    Tree *tree;
+    int *keys;
+    size_t n;
+} SharedCtx;
+
+
+/**
+ * \ingroup bench_shared
+ * @brief Publishes a snapshot of the context's tree.
+ */
+static void run_publish(void *ctx) {
+    SharedCtx *c = (SharedCtx *)ctx;
+    sink += shared_publish(c->shared, c->tree);
+}
+
+
+/**
+ * \ingroup bench_shared
+ * @brief Looks up every key of the context with `shared_contains()`.
+ */
+static void run_shared_contains(void *ctx) {
+    SharedCtx *c = (SharedCtx *)ctx;
+    for (size_t i = 0; i < c->n; i++) {
+        sink += shared_contains(c->shared, c->keys[i]);
+    }
+}
+
+
+/**
+ * \ingroup bench_shared
+ * @brief Runs the shared tree benchmarks.
+ *
+ * @param n The number of keys.
+ */
+static void suite_shared(size_t n) {
+    const char *dir = getenv("TMPDIR") ? getenv("TMPDIR") : "/tmp";
+    char path[4000];
+    snprintf(path, sizeof(path), "%s/rbt-bench-shared", dir);
+    int *keys = random_keys(n, 88172645u);
+
+    BasicCtx b = { rbt_init(), keys, n };
+    run_insert(&b);
+
+    SharedTree *writer = shared_create(path, n);
+    SharedCtx w = { writer, b.tree, keys, n };
+    bench_run("publish (per value)", n, run_publish, &w);
+
+    SharedCtx r = { shared_open(path), NULL, keys, n };
+    bench_run("contains (rb, private)", n, run_contains, &b);
+    bench_run("contains (shared mapping)", n, run_shared_contains, &r);
+
+    printf("%-36s %9zu\n", "bytes per value (rb, per process)", rbt_memory_usage(b.tree).total_bytes / n);
+    printf("%-36s %9zu\n", "bytes per value (shared, per host)", r.shared->bytes / n);
+
+    shared_close(r.shared);
+    shared_close(writer);
+    remove(path);
+    rbt_destroy(b.tree);
+    free(keys);
+}
+
+
+
+
+
+#ifdef RBT_EXPIRY
+/**
+ * \defgroup bench_bounded Bounded Trees
+ *
+ * Only built with `RBT_EXPIRY`. Inserts n random keys into an unbounded tree,
+ * into trees bounded to n / 10 entries under each eviction policy, and into a
+ * tree whose entries expire after 1 ms, and reports the largest size each
+ * reached. The bounded trees should cost little more than the unbounded one,
+ * since each insertion only does O(1) extra work.
+ */
+
+/**
+ * \ingroup bench_bounded
+ * @brief State shared by the bounded tree benchmarks.
+ */
+typedef struct {
+    Tree *tree;
+    int *keys;
+    size_t n;
+    uint64_t ttl;
+    size_t peak;
+} BoundedCtx;
+
+
+/**
+ * \ingroup bench_bounded
+ * @brief Inserts every key of the context, tracking the largest size reached.
+ */
+static void run_insert_bounded(void *ctx) {
+    BoundedCtx *c = (BoundedCtx *)ctx;
+    for (size_t i = 0; i < c->n; i++) {
+        rbt_insert_ttl(c->tree, c->keys[i], c->ttl);
+        if (c->tree->size > c->peak) {
+            c->peak = c->tree->size;
+        }
+    }
+}
+
+
+/**
+ * \ingroup bench_bounded
+ * @brief Runs the bounded tree benchmarks.
+ *
+ * @param n The number of keys.
+ */
+static void suite_bounded(size_t n) {
+    const struct { const char *name; size_t max; EvictPolicy policy; uint64_t ttl; } modes[] = {
+        { "insert (unbounded)", 0, RBT_EVICT_OLDEST, 0 },
+        { "insert (bounded, oldest)", n / 10, RBT_EVICT_OLDEST, 0 },
+        { "insert (bounded, smallest)", n / 10, RBT_EVICT_SMALLEST, 0 },
+        { "insert (bounded, expired)", n / 10, RBT_EVICT_EXPIRED, 1 },
+        { "insert (unbounded, 1 ms ttl)", 0, RBT_EVICT_OLDEST, 1 },
+    };
+    int *keys = random_keys(n, 521288629u);
+
+    for (size_t m = 0; m < sizeof(modes) / sizeof(modes[0]); m++) {
+        BoundedCtx c = { rbt_init(), keys, n, modes[m].ttl, 0 };
+        rbt_set_bounds(c.tree, modes[m].max, 0, modes[m].policy);
+
+        bench_run(modes[m].name, n, run_insert_bounded, &c);
+        printf("%-36s %9zu\n", "  largest size", c.peak);
+        rbt_destroy(c.tree);
+    }
+
+    free(keys);
+}
+#endif
+
+
+
+
+
+/**
+ * \defgroup bench_hash Hash Index
+ *
+ * Runs the same exact-match workload on a Red-Black tree with and without a
+ * hash index (`rbt_set_hash_index()`): random inserts, `rbt_search()` hits
+ * and misses, an ordered range scan, which never uses the index, and random
+ * deletes. Also reports the bytes per value of each from `rbt_memory_usage()`.
+ */
+
+/**
+ * \ingroup bench_hash
+ * @brief Runs the hash index benchmarks.
+ *
+ * @param n The number of keys.
+ */
+static void suite_hash(size_t n) {
+    int *keys = random_keys(n, 521288629u);
+    int *misses = random_keys(n, 3624360069u);
+    size_t scans = n / 10 ? n / 10 : 1;
+    const struct { const char *name; bool hashed; } modes[] = {
+        { "tree only", false },
+        { "hash index", true },
+    };
+
+    for (size_t m = 0; m < sizeof(modes) / sizeof(modes[0]); m++) {
+        char label[64];
+        BasicCtx c = { rbt_init(), keys, n };
+        rbt_set_hash_index(c.tree, modes[m].hashed);
+
+        snprintf(label, sizeof(label), "%s: insert (random)", modes[m].name);
+        bench_run(label, n, run_insert, &c);
+        snprintf(label, sizeof(label), "%s: search hit", modes[m].name);
+        bench_run(label, n, run_search, &c);
+        c.keys = misses;
+        snprintf(label, sizeof(label), "%s: search miss", modes[m].name);
+        bench_run(label, n, run_search, &c);
+        c.keys = keys;
+        c.n = scans;
+        snprintf(label, sizeof(label), "%s: range scan (~32 keys)", modes[m].name);
+        bench_run(label, scans, run_range, &c);
+        c.n = n;
+        snprintf(label, sizeof(label), "%s: bytes per value", modes[m].name);
+        printf("%-36s %9.1f\n", label, rbt_memory_usage(c.tree).total_bytes / (double)n);
+        snprintf(label, sizeof(label), "%s: delete (random)", modes[m].name);
+        bench_run(label, n, run_delete, &c);
+        rbt_destroy(c.tree);
+    }
+
+    free(keys);
+    free(misses);
+}
+
+
+
+
+
+/**
+ * \defgroup bench_parallel Parallel Traversal
+ *
+ * Computes an order-sensitive checksum of a tree of n random keys with
+ * `rbt_foreach()` and with `rbt_parallel_reduce()`, and counts the keys
+ * matching a filter with `rbt_parallel_for()`, on 1, 2, 4, ... threads up to
+ * the number of online CPUs. Times are per key.
+ */
+
+/**
+ * \ingroup bench_parallel
+ * @brief An order-sensitive checksum: a polynomial hash of the values in
+ *        sequence, with the power of the base needed to append to it.
+ */
+typedef struct {
+    uint64_t hash;
+    uint64_t power;
+} Checksum;
+
+
+/**
+ * \ingroup bench_parallel
+ * @brief Appends a value to a checksum.
+ */
+static void checksum_fold(void *acc, int data, void *ctx) {
+    (void)ctx;
+    Checksum *c = (Checksum *)acc;
+    c->hash = c->hash * 1000003u + (uint32_t)data;
+    c->power *= 1000003u;
+}
+
+
+/**
+ * \ingroup bench_parallel
+ * @brief Appends the checksum of the following values to a checksum.
+ */
+static void checksum_combine(void *acc, const void *next, void *ctx) {
+    (void)ctx;
+    Checksum *c = (Checksum *)acc;
+    const Checksum *d = (const Checksum *)next;
+    c->hash = c->hash * d->power + d->hash;
+    c->power *= d->power;
+}
+
+
+/**
+ * \ingroup bench_parallel
+ * @brief Appends a value to the checksum passed as @p ctx, for `rbt_foreach()`.
+ */
+static void checksum_visit(int data, void *ctx) {
+    checksum_fold(ctx, data, NULL);
+}
+
+
+/**
+ * \ingroup bench_parallel
+ * @brief Counts the values divisible by 100 in the atomic counter @p ctx.
+ */
+static void filter_visit(int data, void *ctx) {
+    if (data % 100 == 0) {
+        atomic_fetch_add_explicit((atomic_size_t *)ctx, 1, memory_order_relaxed);
+    }
+}
+
+
+/**
+ * \ingroup bench_parallel
+ * @brief State shared by the parallel traversal benchmarks.
+ */
+typedef struct {
+    Tree *tree;
+    unsigned threads;
+    Checksum sum;
+    atomic_size_t matches;
+} ParallelCtx;
+
+
+/**
+ * \ingroup bench_parallel
+ * @brief Computes the checksum of the context's tree with `rbt_foreach()`.
+ */
+static void run_checksum_serial(void *ctx) {
+    ParallelCtx *c = (ParallelCtx *)ctx;
+    c->sum = (Checksum){ 0, 1 };
+    rbt_foreach(c->tree, checksum_visit, &c->sum);
+    sink += c->sum.hash;
+}
+
+
+/**
+ * \ingroup bench_parallel
+ * @brief Computes the checksum of the context's tree with `rbt_parallel_reduce()`.
+ */
+static void run_checksum_parallel(void *ctx) {
+    ParallelCtx *c = (ParallelCtx *)ctx;
+    c->sum = (Checksum){ 0, 1 };
+    rbt_parallel_reduce(c->tree, &c->sum, sizeof(Checksum), checksum_fold, checksum_combine, NULL,
+                        c->threads);
+    sink += c->sum.hash;
+}
+
+
+/**
+ * \ingroup bench_parallel
+ * @brief Counts the matching values of the context's tree with `rbt_parallel_for()`.
+ */
+static void run_filter_parallel(void *ctx) {
+    ParallelCtx *c = (ParallelCtx *)ctx;
+    atomic_store(&c->matches, 0);
+    rbt_parallel_for(c->tree, filter_visit, &c->matches, c->threads);
+    sink += atomic_load(&c->matches);
+}
+
+
+/**
+ * \ingroup bench_parallel
+ * @brief Runs the parallel traversal benchmarks.
+ *
+ * @param n The number of keys.
+ */
+static void suite_parallel(size_t n) {
+    int *keys = random_keys(n, 2654435761u);
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    ParallelCtx c;
+    c.tree = rbt_init();
+    for (size_t i = 0; i < n; i++) {
+        rbt_insert(c.tree, keys[i]);
+    }
+
+    bench_run("checksum (rbt_foreach)", n, run_checksum_serial, &c);
+    uint64_t expected = c.sum.hash;
+    for (unsigned threads = 1; threads <= (cpus > 1 ? (unsigned)cpus : 1); threads *= 2) {
+        char label[64];
+        c.threads = threads;
+        snprintf(label, sizeof(label), "checksum (reduce, %u threads)", threads);
+        bench_run(label, n, run_checksum_parallel, &c);
+        if (c.sum.hash != expected) {
+            fprintf(stderr, "suite_parallel(): checksum mismatch on %u threads\n", threads);
+            exit(1);
+        }
+        snprintf(label, sizeof(label), "filter (parallel_for, %u threads)", threads);
+        bench_run(label, n, run_filter_parallel, &c);
+    }
+
+    rbt_destroy(c.tree);
+    free(keys);
+}
+
+
+
+
+
+/**
+ * \ingroup bench
+ * @brief A named benchmark suite.
+ */
+typedef struct {
+    const char *name;
+    void (*run)(size_t n);
+} Suite;
+
+/**
+ * \ingroup bench
+ * @brief Every suite known to the harness, run in order by `all`.
+ */
+static const Suite suites[] = {
+    { "basic", suite_basic },
+    { "hint", suite_hint },
+    { "pq", suite_pq },
+    { "scan", suite_scan },
+    { "engines", suite_engines },
+    { "intrusive", suite_intrusive },
+    { "purge", suite_purge },
+    { "wal", suite_wal },
+    { "memory", suite_memory },
+#ifdef RBT_INTERVAL
+    { "interval", suite_interval },
+#endif
+#ifdef RBT_AUGMENT
+    { "aggregate", suite_aggregate },
+#endif
+    { "compact", suite_compact },
+    { "small", suite_small },
+    { "shared", suite_shared },
+#ifdef RBT_EXPIRY
+    { "bounded", suite_bounded },
+#endif
+    { "hash", suite_hash },
+    { "parallel", suite_parallel },
+};
+
+
+int main(int argc, char **argv) {
+    const char *name = argc > 1 ? argv[1] : "all";
+    size_t n = argc > 2 ? strtoul(argv[2], NULL, 10) : 1000000;
+    size_t num_suites = sizeof(suites) / sizeof(suites[0]);
+    bool found = false;
+
+    if (!n) {
+        fprintf(stderr, "usage: %s [suite] [n]\n", argv[0]);
+        return 1;
+    }
+
+    if (!perf_open(&counters)) {
+        fprintf(stderr, "note: hardware counters unavailable, reporting timings only\n");
+    }
+
+    print_header();
+    for (size_t i = 0; i < num_suites; i++) {
+        if (!strcmp(name, "all") || !strcmp(name, suites[i].name)) {
+            suites[i].run(n);
+            found = true;
+        }
+    }
+
+    perf_close(&counters);
+
+    if (!found) {
+        fprintf(stderr, "unknown suite '%s'; available:", name);
+        for (size_t i = 0; i < num_suites; i++) {
+            fprintf(stderr, " %s", suites[i].name);
+        }
+        fprintf(stderr, "\n");
+        return 1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,537 @@
+/**
+ * @file bptree.c
+ *
+ * @brief Implementation of the B+-tree engine.
+ *
+ * Keys are stored only in the leaves; internal nodes hold separator keys used
+ * for routing. Every node except the root holds between `BPT_ORDER / 2` and
+ * `BPT_ORDER` keys, which keeps the tree balanced: insertion splits nodes that
+ * overflow, and deletion borrows from or merges with a sibling when a node
+ * underflows. Duplicates are stored once with a multiplicity, so separators
+ * are always distinct and routing stays unambiguous.
+ *
+ * Key Functions:
+ * - bpt_init(): Initializes and returns a new B+-tree.
+ * - bpt_destroy(): Frees memory allocated for the B+-tree.
+ * - bpt_insert(): Inserts a key, splitting full nodes.
+ * - bpt_delete(): Deletes a key, rebalancing underfull nodes.
+ * - bpt_contains(): Searches for a key.
+ * - bpt_range(): Visits the keys in a range through the leaf links.
+ *
+ * @version 1.0
+ * @date 2024-02-27
+ * @author Warren Kim
+ */
+
+#include "bptree.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/**
+ * @def BPT_MIN
+ * @brief The minimum number of keys in a node other than the root.
+ */
+#define BPT_MIN (BPT_ORDER / 2)
+
+/**
+ * \defgroup bpt_helpers B+-Tree Helper Functions
+ *
+ * This section describes the helper functions used to search within a node
+ * and to keep the B+-tree balanced. Key operations include:
+ *
+ * - `bpnode_init()`: Allocates an empty node.
+ * - `lower_bound()`: Finds the first key not less than a value within a node.
+ * - `child_index()`: Finds the child of an internal node that covers a value.
+ * - `split()`: Splits an overflowing node in two.
+ * - `insert_rec()`: Recursively inserts a key, propagating splits upwards.
+ * - `rebalance()`: Fixes an underfull child by borrowing or merging.
+ * - `delete_rec()`: Recursively deletes a key, propagating underflows upwards.
+ */
+
+/**
+ * \ingroup bpt_helpers
+ * @brief Allocates an empty node.
+ *
+ * @param tree A pointer to the tree the node belongs to.
+ * @param leaf Whether the node is a leaf.
+ * @return     A pointer to the new node if successful, error and exit otherwise.
+ */
+static BPNode *bpnode_init(BPTree *tree, bool leaf) {
+    BPNode *node = (BPNode *)(malloc(sizeof(BPNode)));
+    if (!node) {
+        perror("bpnode_init(): malloc failed");
+        exit(1);
+    }
+
+    node->count = 0;
+    node->leaf = leaf;
+    if (leaf) {
+        node->u.l.next = NULL;
+    }
+
+    tree->nodes++;
+    return node;
+}
+
+
+/**
+ * \ingroup bpt_helpers
+ * @brief Frees a node.
+ *
+ * @param tree A pointer to the tree the node belongs to.
+ * @param node A pointer to the node to free.
+ */
+static void bpnode_destroy(BPTree *tree, BPNode *node) {
+    tree->nodes--;
+    free(node);
+}
+
+
+/**
+ * \ingroup bpt_helpers
+ * @brief Frees every node in the subtree rooted at @p node.
+ *
+ * @param tree A pointer to the tree the subtree belongs to.
+ * @param node A pointer to the root of the subtree.
+ */
+static void subtree_destroy(BPTree *tree, BPNode *node) {
+    if (!node->leaf) {
+        for (int i = 0; i <= node->count; i++) {
+            subtree_destroy(tree, node->u.children[i]);
+        }
+    }
+
+    bpnode_destroy(tree, node);
+}
+
+
+/**
+ * \ingroup bpt_helpers
+ * @brief Finds the first key not less than a value within a node.
+ *
+ * @param node A pointer to the node.
+ * @param data The value to search for.
+ * @return     The index of the first key >= @p data, or `node->count`.
+ */
+static int lower_bound(const BPNode *node, const int data) {
+    int lo = 0;
+    int hi = node->count;
+
+    while (lo < hi) {
+        int mid = (lo + hi) / 2;
+        if (node->keys[mid] < data) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+
+    return lo;
+}
+
+
+/**
+ * \ingroup bpt_helpers
+ * @brief Finds the child of an internal node that covers a value.
+ *
+ * Since `keys[i]` is the smallest key that may be found in `children[i + 1]`,
+ * the child is given by the number of separators that are <= @p data.
+ *
+ * @param node A pointer to an internal node.
+ * @param data The value to route.
+ * @return     The index of the child to descend into.
+ */
+static int child_index(const BPNode *node, const int data) {
+    int i = lower_bound(node, data);
+    return i < node->count && node->keys[i] == data ? i + 1 : i;
+}
+
+
+/**
+ * \ingroup bpt_helpers
+ * @brief Splits an overflowing node in two.
+ *
+ * The upper half of @p node is moved into a new right sibling. For a leaf, the
+ * separator is a copy of the first key of the new sibling; for an internal
+ * node, the middle key moves up into the parent and is removed from both
+ * halves.
+ *
+ * @param tree A pointer to the tree.
+ * @param node A pointer to the node holding `BPT_ORDER + 1` keys.
+ * @param sep  A pointer that receives the separator for the parent.
+ * @return     A pointer to the new right sibling.
+ */
+static BPNode *split(BPTree *tree, BPNode *node, int *sep) {
+    BPNode *right = bpnode_init(tree, node->leaf);
+    int mid = node->count / 2;
+
+    if (node->leaf) {
+        right->count = node->count - mid;
+        memcpy(right->keys, node->keys + mid, right->count * sizeof(int));
+        memcpy(right->u.l.counts, node->u.l.counts + mid, right->count * sizeof(unsigned));
+        right->u.l.next = node->u.l.next;
+        node->u.l.next = right;
+        node->count = mid;
+        *sep = right->keys[0];
+    } else {
+        right->count = node->count - mid - 1;
+        memcpy(right->keys, node->keys + mid + 1, right->count * sizeof(int));
+        memcpy(right->u.children, node->u.children + mid + 1, (right->count + 1) * sizeof(BPNode *));
+        node->count = mid;
+        *sep = node->keys[mid];
+    }
+
+    return right;
+}
+
+
+/**
+ * \ingroup bpt_helpers
+ * @brief Recursively inserts a key, propagating splits upwards.
+ *
+ * @param tree A pointer to the tree.
+ * @param node A pointer to the root of the subtree to insert into.
+ * @param data The key to insert.
+ * @param sep  A pointer that receives the separator if @p node was split.
+ * @return     A pointer to the new right sibling of @p node if it was split,
+ *             NULL otherwise.
+ */
+static BPNode *insert_rec(BPTree *tree, BPNode *node, const int data, int *sep) {
+    if (node->leaf) {
+        int i = lower_bound(node, data);
+        if (i < node->count && node->keys[i] == data) {
+            node->u.l.counts[i]++;
+            return NULL;
+        }
+
+        memmove(node->keys + i + 1, node->keys + i, (node->count - i) * sizeof(int));
+        memmove(node->u.l.counts + i + 1, node->u.l.counts + i, (node->count - i) * sizeof(unsigned));
+        node->keys[i] = data;
+        node->u.l.counts[i] = 1;
+        node->count++;
+    } else {
+        int i = child_index(node, data);
+        int child_sep;
+        BPNode *right = insert_rec(tree, node->u.children[i], data, &child_sep);
+        if (!right) {
+            return NULL;
+        }
+
+        memmove(node->keys + i + 1, node->keys + i, (node->count - i) * sizeof(int));
+        memmove(node->u.children + i + 2, node->u.children + i + 1, (node->count - i) * sizeof(BPNode *));
+        node->keys[i] = child_sep;
+        node->u.children[i + 1] = right;
+        node->count++;
+    }
+
+    return node->count > BPT_ORDER ? split(tree, node, sep) : NULL;
+}
+
+
+/**
+ * \ingroup bpt_helpers
+ * @brief Removes the key at index @p i of a node, along with the child to its
+ *        right if the node is internal.
+ *
+ * @param node A pointer to the node.
+ * @param i    The index of the key to remove.
+ */
+static void remove_at(BPNode *node, int i) {
+    memmove(node->keys + i, node->keys + i + 1, (node->count - i - 1) * sizeof(int));
+    if (node->leaf) {
+        memmove(node->u.l.counts + i, node->u.l.counts + i + 1, (node->count - i - 1) * sizeof(unsigned));
+    } else {
+        memmove(node->u.children + i + 1, node->u.children + i + 2, (node->count - i - 1) * sizeof(BPNode *));
+    }
+    node->count--;
+}
+
+
+/**
+ * \ingroup bpt_helpers
+ * @brief Merges the child at index @p i + 1 of @p parent into the child at
+ *        index @p i.
+ *
+ * @param tree   A pointer to the tree.
+ * @param parent A pointer to the parent of both children.
+ * @param i      The index of the left child.
+ */
+static void merge(BPTree *tree, BPNode *parent, int i) {
+    BPNode *left = parent->u.children[i];
+    BPNode *right = parent->u.children[i + 1];
+
+    if (left->leaf) {
+        memcpy(left->keys + left->count, right->keys, right->count * sizeof(int));
+        memcpy(left->u.l.counts + left->count, right->u.l.counts, right->count * sizeof(unsigned));
+        left->count += right->count;
+        left->u.l.next = right->u.l.next;
+    } else {
+        left->keys[left->count] = parent->keys[i];
+        memcpy(left->keys + left->count + 1, right->keys, right->count * sizeof(int));
+        memcpy(left->u.children + left->count + 1, right->u.children, (right->count + 1) * sizeof(BPNode *));
+        left->count += right->count + 1;
+    }
+
+    remove_at(parent, i);
+    bpnode_destroy(tree, right);
+}
+
+
+/**
+ * \ingroup bpt_helpers
+ * @brief Fixes an underfull child by borrowing from or merging with a sibling.
+ *
+ * If a sibling has more than `BPT_MIN` keys, one key is rotated through the
+ * parent; otherwise the child is merged with a sibling, which removes one key
+ * from the parent (possibly making it underfull in turn).
+ *
+ * @param tree   A pointer to the tree.
+ * @param parent A pointer to the parent of the underfull child.
+ * @param i      The index of the underfull child.
+ */
+static void rebalance(BPTree *tree, BPNode *parent, int i) {
+    BPNode *child = parent->u.children[i];
+    BPNode *left = i > 0 ? parent->u.children[i - 1] : NULL;
+    BPNode *right = i < parent->count ? parent->u.children[i + 1] : NULL;
+
+    if (left && left->count > BPT_MIN) {
+        memmove(child->keys + 1, child->keys, child->count * sizeof(int));
+        if (child->leaf) {
+            memmove(child->u.l.counts + 1, child->u.l.counts, child->count * sizeof(unsigned));
+            child->keys[0] = left->keys[left->count - 1];
+            child->u.l.counts[0] = left->u.l.counts[left->count - 1];
+            parent->keys[i - 1] = child->keys[0];
+        } else {
+            memmove(child->u.children + 1, child->u.children, (child->count + 1) * sizeof(BPNode *));
+            child->keys[0] = parent->keys[i - 1];
+            child->u.children[0] = left->u.children[left->count];
+            parent->keys[i - 1] = left->keys[left->count - 1];
+        }
+        child->count++;
+        left->count--;
+    } else if (right && right->count > BPT_MIN) {
+        if (child->leaf) {
+            child->keys[child->count] = right->keys[0];
+            child->u.l.counts[child->count] = right->u.l.counts[0];
+            child->count++;
+            remove_at(right, 0);
+            parent->keys[i] = right->keys[0];
+        } else {
+            child->keys[child->count] = parent->keys[i];
+            child->u.children[child->count + 1] = right->u.children[0];
+            child->count++;
+            parent->keys[i] = right->keys[0];
+            memmove(right->keys, right->keys + 1, (right->count - 1) * sizeof(int));
+            memmove(right->u.children, right->u.children + 1, right->count * sizeof(BPNode *));
+            right->count--;
+        }
+    } else if (left) {
+        merge(tree, parent, i - 1);
+    } else {
+        merge(tree, parent, i);
+    }
+}
+
+
+/**
+ * \ingroup bpt_helpers
+ * @brief Recursively deletes a key, propagating underflows upwards.
+ *
+ * @param tree A pointer to the tree.
+ * @param node A pointer to the root of the subtree to delete from.
+ * @param data The key to delete.
+ * @return     true if the key was found and deleted, false otherwise.
+ */
+static bool delete_rec(BPTree *tree, BPNode *node, const int data) {
+    if (node->leaf) {
+        int i = lower_bound(node, data);
+        if (i == node->count || node->keys[i] != data) {
+            return false;
+        }
+
+        if (--node->u.l.counts[i] == 0) {
+            remove_at(node, i);
+        }
+        return true;
+    }
+
+    int i = child_index(node, data);
+    if (!delete_rec(tree, node->u.children[i], data)) {
+        return false;
+    }
+
+    if (node->u.children[i]->count < BPT_MIN) {
+        rebalance(tree, node, i);
+    }
+    return true;
+}
+
+
+
+
+
+/**
+ * \defgroup bpt B+-Tree
+ *
+ * This section documents the public facing API of the B+-tree engine. Key
+ * operations include:
+ *
+ * - `bpt_init()`: Initializes a new, empty tree.
+ * - `bpt_destroy()`: Frees the memory allocated for the entire tree.
+ * - `bpt_insert()`: Inserts a key, splitting full nodes.
+ * - `bpt_delete()`: Deletes a key, rebalancing underfull nodes.
+ * - `bpt_contains()`: Searches for a key.
+ * - `bpt_range()`: Visits every key in a range in sorted order.
+ */
+
+/**
+ * \ingroup bpt
+ * @brief Initializes a new, empty B+-tree.
+ *
+ * @return A pointer to the newly initialized tree if successful, error and
+ *         exits otherwise.
+ */
+BPTree *bpt_init(void) {
+    BPTree *tree = (BPTree *)(malloc(sizeof(BPTree)));
+    if (!tree) {
+        perror("bpt_init(): malloc failed");
+        exit(1);
+    }
+
+    tree->root = NULL;
+    tree->nodes = 0;
+    return tree;
+}
+
+
+/**
+ * \ingroup bpt
+ * @brief Destroys a B+-tree and frees its memory.
+ *
+ * @param tree A pointer to the tree to be destroyed.
+ */
+void bpt_destroy(BPTree *tree) {
+    if (!tree) {
+        return;
+    }
+
+    if (tree->root) {
+        subtree_destroy(tree, tree->root);
+    }
+    free(tree);
+}
+
+
+/**
+ * \ingroup bpt
+ * @brief Inserts a key into the B+-tree.
+ *
+ * If the key is already present its multiplicity is incremented. Full nodes
+ * are split on the way back up, growing the tree at the root.
+ *
+ * @param tree A pointer to the tree.
+ * @param data The key to insert.
+ */
+void bpt_insert(BPTree *tree, const int data) {
+    if (!tree->root) {
+        tree->root = bpnode_init(tree, true);
+    }
+
+    int sep;
+    BPNode *right = insert_rec(tree, tree->root, data, &sep);
+    if (right) {
+        BPNode *root = bpnode_init(tree, false);
+        root->count = 1;
+        root->keys[0] = sep;
+        root->u.children[0] = tree->root;
+        root->u.children[1] = right;
+        tree->root = root;
+    }
+}
+
+
+/**
+ * \ingroup bpt
+ * @brief Deletes one occurrence of a key from the B+-tree.
+ *
+ * Nodes that fall below half full borrow a key from a sibling or are merged
+ * with it, shrinking the tree at the root.
+ *
+ * @param tree A pointer to the tree.
+ * @param data The key to delete.
+ * @return     true if the key was found and deleted, false otherwise.
+ */
+bool bpt_delete(BPTree *tree, const int data) {
+    if (!tree->root || !delete_rec(tree, tree->root, data)) {
+        return false;
+    }
+
+    BPNode *root = tree->root;
+    if (!root->leaf && root->count == 0) {
+        tree->root = root->u.children[0];
+        bpnode_destroy(tree, root);
+    } else if (root->leaf && root->count == 0) {
+        tree->root = NULL;
+        bpnode_destroy(tree, root);
+    }
+    return true;
+}
+
+
+/**
+ * \ingroup bpt
+ * @brief Returns whether a key is present in the B+-tree.
+ *
+ * @param tree A pointer to the tree.
+ * @param data The key to search for.
+ * @return     true if @p data is present, false otherwise.
+ */
+bool bpt_contains(BPTree *tree, const int data) {
+    BPNode *node = tree->root;
+    if (!node) {
+        return false;
+    }
+
+    while (!node->leaf) {
+        node = node->u.children[child_index(node, data)];
+    }
+
+    int i = lower_bound(node, data);
+    return i < node->count && node->keys[i] == data;
+}
+
+
+/**
+ * \ingroup bpt
+ * @brief Visits every key in [@p lo, @p hi] in sorted order.
+ *
+ * Keys with a multiplicity greater than one are visited that many times.
+ *
+ * @param tree  A pointer to the tree.
+ * @param lo    The smallest key to visit.
+ * @param hi    The largest key to visit.
+ * @param visit The function called for every key.
+ * @param ctx   An opaque pointer passed to @p visit.
+ */
+void bpt_range(BPTree *tree, const int lo, const int hi, RbtVisitor visit, void *ctx) {
+    BPNode *node = tree->root;
+    if (!node || hi < lo) {
+        return;
+    }
+
+    while (!node->leaf) {
+        node = node->u.children[child_index(node, lo)];
+    }
+
+    for (int i = lower_bound(node, lo); node; node = node->u.l.next, i = 0) {
+        for (; i < node->count; i++) {
+            if (hi < node->keys[i]) {
+                return;
+            }
+            for (unsigned k = 0; k < node->u.l.counts[i]; k++) {
+                visit(node->keys[i], ctx);
+            }
+        }
+    }
+}
@@ -0,0 +1,169 @@
+/**
+ * @file bptree.h
+ *
+ * @brief Declaration of the B+-tree engine.
+ *
+ * A binary tree pays roughly one cache miss per level of the tree. A B+-tree
+ * stores many keys per node in a contiguous array, so each node visited costs
+ * a handful of adjacent cache lines instead, and the tree is only
+ * log_{B}(n) levels deep. All keys live in the leaves, which are linked
+ * together so that range scans are sequential.
+ *
+ * This engine is normally not used directly: a `Tree` created with
+ * `rbt_init_engine(RBT_ENGINE_BPLUS)` forwards the engine-independent
+ * `rbt_*` functions (insert, delete, contains, iteration) here.
+ *
+ * Key Components:
+ * - BPNode: A node of the tree. Internal nodes hold separator keys and
+ *   children; leaves hold keys, their multiplicities, and a link to the next
+ *   leaf.
+ * - BPTree: The tree itself, encapsulating its root and the number of nodes.
+ *
+ * Key Functions (Declared):
+ * - bpt_init(): Creates and returns a new, empty B+-tree.
+ * - bpt_destroy(): Destroys the tree, freeing all allocated memory.
+ * - bpt_insert(): Inserts a key.
+ * - bpt_delete(): Deletes one occurrence of a key.
+ * - bpt_contains(): Returns whether a key is present.
+ * - bpt_range(): Visits every key in a range in sorted order.
+ *
+ * @version 1.0
+ * @date 2024-02-27
+ * @author Warren Kim
+ */
+
+#ifndef BPTREE_H
+#define BPTREE_H
+
+#include "rbt.h"
+
+/**
+ * @def BPT_ORDER
+ * @brief The maximum number of keys in a node.
+ *
+ * With the default of 64 keys, the key array of a node spans about four 64-byte
+ * cache lines, and a search within a node touches at most those. Override it at
+ * compile time, e.g. with `-DBPT_ORDER=500` for nodes of about a 4 KiB page.
+ */
+#ifndef BPT_ORDER
+#define BPT_ORDER 64
+#endif
+
+/**
+ * @typedef struct BPNode
+ * @struct BPNode
+ * @brief A node of the B+-tree.
+ *
+ * Every array has one spare slot so that a node may temporarily hold
+ * `BPT_ORDER + 1` keys between an insertion and the split that follows it.
+ *
+ * @var BPNode::count
+ * The number of keys in the node. An internal node has `count + 1` children.
+ *
+ * @var BPNode::leaf
+ * Whether the node is a leaf.
+ *
+ * @var BPNode::keys
+ * The keys of the node in ascending order. In an internal node, `keys[i]` is
+ * the smallest key that may be found in `children[i + 1]`.
+ *
+ * @var BPNode::children
+ * Internal nodes only. Pointers to the children of the node.
+ *
+ * @var BPNode::counts
+ * Leaves only. The multiplicity of each key, since the `rbt_*` interface
+ * allows duplicates.
+ *
+ * @var BPNode::next
+ * Leaves only. Pointer to the next leaf in sorted order, or NULL.
+ */
+typedef struct BPNode {
+    int count;
+    bool leaf;
+    int keys[BPT_ORDER + 1];
+    union {
+        struct BPNode *children[BPT_ORDER + 2];
+        struct {
+            unsigned counts[BPT_ORDER + 1];
+            struct BPNode *next;
+        } l;
+    } u;
+} BPNode;
+
+/**
+ * @typedef struct BPTree
+ * @struct BPTree
+ * @brief Structure representing a B+-tree.
+ *
+ * @var BPTree::root
+ * Pointer to the root node of the tree, or NULL when the tree is empty.
+ *
+ * @var BPTree::nodes
+ * The number of nodes currently allocated by the tree.
+ */
+typedef struct BPTree {
+    BPNode *root;
+    size_t nodes;
+} BPTree;
+
+/**
+ * @brief Initializes a new, empty B+-tree.
+ *
+ * @return A pointer to the newly initialized tree if successful, error and
+ *         exits otherwise.
+ */
+BPTree *bpt_init(void);
+
+/**
+ * @brief Destroys a B+-tree and frees its memory.
+ *
+ * @param tree A pointer to the tree to be destroyed.
+ */
+void bpt_destroy(BPTree *tree);
+
+/**
+ * @brief Inserts a key into the B+-tree.
+ *
+ * If the key is already present its multiplicity is incremented. Full nodes
+ * are split on the way back up, growing the tree at the root.
+ *
+ * @param tree A pointer to the tree.
+ * @param data The key to insert.
+ */
+void bpt_insert(BPTree *tree, const int data);
+
+/**
+ * @brief Deletes one occurrence of a key from the B+-tree.
+ *
+ * Nodes that fall below half full borrow a key from a sibling or are merged
+ * with it, shrinking the tree at the root.
+ *
+ * @param tree A pointer to the tree.
+ * @param data The key to delete.
+ * @return     true if the key was found and deleted, false otherwise.
+ */
+bool bpt_delete(BPTree *tree, const int data);
+
+/**
+ * @brief Returns whether a key is present in the B+-tree.
+ *
+ * @param tree A pointer to the tree.
+ * @param data The key to search for.
+ * @return     true if @p data is present, false otherwise.
+ */
+bool bpt_contains(BPTree *tree, const int data);
+
+/**
+ * @brief Visits every key in [@p lo, @p hi] in sorted order.
+ *
+ * Keys with a multiplicity greater than one are visited that many times.
+ *
+ * @param tree  A pointer to the tree.
+ * @param lo    The smallest key to visit.
+ * @param hi    The largest key to visit.
+ * @param visit The function called for every key.
+ * @param ctx   An opaque pointer passed to @p visit.
+ */
+void bpt_range(BPTree *tree, const int lo, const int hi, RbtVisitor visit, void *ctx);
+
+#endif
@@ -0,0 +1,488 @@
+/**
+ * @file bucket.c
+ *
+ * @brief Implementation of the bucketed-leaf engine.
+ *
+ * Keys are stored in buckets of up to `RBT_BUCKET_KEYS` sorted keys, which are
+ * linked into an intrusive Red-Black tree ordered by their smallest key. A key
+ * belongs to the last bucket whose smallest key is not greater than it, so a
+ * search descends the tree of buckets and then scans a single bucket.
+ * Duplicates are stored as separate keys and may span several buckets; a
+ * bucket is only ever split where its keys differ, so that the new bucket
+ * orders strictly after the old one.
+ *
+ * Key Functions:
+ * - bkt_init(): Initializes and returns a new bucketed tree.
+ * - bkt_destroy(): Frees memory allocated for the bucketed tree.
+ * - bkt_insert(): Inserts a key, splitting full buckets.
+ * - bkt_delete(): Deletes a key, merging underfull buckets.
+ * - bkt_contains(): Searches for a key.
+ * - bkt_range(): Visits the keys in a range bucket by bucket.
+ *
+ * @version 1.0
+ * @date 2024-02-27
+ * @author Warren Kim
+ */
+
+#include "bucket.h"
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#if RBT_BUCKET_KEYS % 4 || RBT_BUCKET_KEYS < 16 || RBT_BUCKET_KEYS > 64
+#error "RBT_BUCKET_KEYS must be a multiple of 4 between 16 and 64"
+#endif
+
+/**
+ * @def BKT_MIN
+ * @brief The number of keys below which a bucket is merged with a neighbour.
+ */
+#define BKT_MIN (RBT_BUCKET_KEYS / 4)
+
+/**
+ * \defgroup bkt_helpers Bucketed Tree Helper Functions
+ *
+ * This section describes the helper functions used to search within a bucket
+ * and to split and merge buckets. Key operations include:
+ *
+ * - `bucket_init()`: Allocates an empty bucket.
+ * - `bucket_rank()`: Counts the keys of a bucket less than a value.
+ * - `bucket_find()`: Finds the bucket a value belongs to.
+ * - `bucket_add()`, `bucket_remove()`: Update the keys of a bucket.
+ * - `split()`: Splits a full bucket in two.
+ * - `underflow()`: Merges an underfull bucket with a neighbour.
+ */
+
+/**
+ * \ingroup bkt_helpers
+ * @brief Allocates an empty bucket.
+ *
+ * @param tree A pointer to the tree the bucket belongs to.
+ * @return     A pointer to the new bucket if successful, error and exit otherwise.
+ */
+static Bucket *bucket_init(BucketTree *tree) {
+    Bucket *bucket = (Bucket *)(malloc(sizeof(Bucket)));
+    if (!bucket) {
+        perror("bucket_init(): malloc failed");
+        exit(1);
+    }
+
+    bucket->count = 0;
+    for (int i = 0; i < RBT_BUCKET_KEYS; i++) {
+        bucket->keys[i] = INT_MAX;
+    }
+
+    tree->buckets++;
+    return bucket;
+}
+
+
+/**
+ * \ingroup bkt_helpers
+ * @brief Unlinks a bucket from the tree and frees it.
+ *
+ * @param tree   A pointer to the tree the bucket belongs to.
+ * @param bucket A pointer to the bucket.
+ */
+static void bucket_destroy(BucketTree *tree, Bucket *bucket) {
+    rbt_unlink(&tree->index, &bucket->node);
+    free(bucket);
+    tree->buckets--;
+}
+
+
+/**
+ * \ingroup bkt_helpers
+ * @brief Frees every bucket of a subtree without unlinking them.
+ *
+ * @param node A pointer to the root of the subtree, which may be NULL.
+ */
+static void subtree_destroy(Node *node) {
+    if (!node) {
+        return;
+    }
+
+    subtree_destroy(node->left);
+    subtree_destroy(node->right);
+    free(rbt_entry(node, Bucket, node));
+}
+
+
+/**
+ * \ingroup bkt_helpers
+ * @brief Orders two buckets by their smallest key, for `rbt_link()`.
+ *
+ * Ties order the new bucket before the existing one.
+ *
+ * @param a A pointer to the node of the first bucket.
+ * @param b A pointer to the node of the second bucket.
+ * @return  A negative, zero or positive value if @p a orders before, with or
+ *          after @p b.
+ */
+static int bucket_compare(const Node *a, const Node *b) {
+    return (a->data > b->data) - (a->data < b->data);
+}
+
+
+/**
+ * \ingroup bkt_helpers
+ * @brief Counts the keys of a bucket that are less than @p data.
+ *
+ * With SSE2, the whole array is compared four keys per instruction without a
+ * single branch; the unused slots hold `INT_MAX` and never count.
+ *
+ * @param bucket A pointer to the bucket.
+ * @param data   The value to rank.
+ * @return       The index at which @p data is, or would be, inserted.
+ */
+static int bucket_rank(const Bucket *bucket, const int data) {
+#ifdef __SSE2__
+    __m128i key = _mm_set1_epi32(data);
+    __m128i less = _mm_setzero_si128();
+    for (int i = 0; i < RBT_BUCKET_KEYS; i += 4) {
+        __m128i v = _mm_loadu_si128((const __m128i *)&bucket->keys[i]);
+        less = _mm_sub_epi32(less, _mm_cmplt_epi32(v, key));
+    }
+    less = _mm_add_epi32(less, _mm_shuffle_epi32(less, _MM_SHUFFLE(1, 0, 3, 2)));
+    less = _mm_add_epi32(less, _mm_shuffle_epi32(less, _MM_SHUFFLE(2, 3, 0, 1)));
+    return _mm_cvtsi128_si32(less);
+#else
+    int rank = 0;
+    while (rank < bucket->count && bucket->keys[rank] < data) {
+        rank++;
+    }
+    return rank;
+#endif
+}
+
+
+/**
+ * \ingroup bkt_helpers
+ * @brief Finds the last bucket whose smallest key is less than (or equal to)
+ *        a value.
+ *
+ * Only the nodes of the tree are visited; the keys of a bucket are not read.
+ *
+ * @param tree   A pointer to the tree.
+ * @param data   The value to look for.
+ * @param strict true to require a smallest key less than @p data, false to
+ *               allow one equal to it.
+ * @return       A pointer to the bucket, or NULL if there is none.
+ */
+static Bucket *bucket_find(const BucketTree *tree, const int data, bool strict) {
+    Node *found = NULL;
+
+    for (Node *x = tree->index.root; x;) {
+        if (x->data < data || (!strict && x->data == data)) {
+            found = x;
+            x = x->right;
+        } else {
+            x = x->left;
+        }
+    }
+
+    return found ? rbt_entry(found, Bucket, node) : NULL;
+}
+
+
+/**
+ * \ingroup bkt_helpers
+ * @brief Inserts a key at a given position of a bucket that is not full.
+ *
+ * @param bucket A pointer to the bucket.
+ * @param i      The position, as returned by `bucket_rank()`.
+ * @param data   The key to insert.
+ */
+static void bucket_add(Bucket *bucket, int i, const int data) {
+    memmove(&bucket->keys[i + 1], &bucket->keys[i], (RBT_BUCKET_KEYS - 1 - i) * sizeof(int));
+    bucket->keys[i] = data;
+    bucket->count++;
+    if (i == 0) {
+        bucket->node.data = data;
+    }
+}
+
+
+/**
+ * \ingroup bkt_helpers
+ * @brief Removes the key at a given position of a bucket.
+ *
+ * @param bucket A pointer to the bucket.
+ * @param i      The position of the key.
+ */
+static void bucket_remove(Bucket *bucket, int i) {
+    memmove(&bucket->keys[i], &bucket->keys[i + 1], (RBT_BUCKET_KEYS - 1 - i) * sizeof(int));
+    bucket->keys[RBT_BUCKET_KEYS - 1] = INT_MAX;
+    bucket->count--;
+    if (i == 0 && bucket->count) {
+        bucket->node.data = bucket->keys[0];
+    }
+}
+
+
+/**
+ * \ingroup bkt_helpers
+ * @brief Splits a full bucket in two.
+ *
+ * The upper half of the keys moves to a new bucket, which is linked right
+ * after @p bucket. If the middle key equals the smallest one, the split point
+ * moves up past it, so that the new bucket's smallest key is strictly greater
+ * and `rbt_link()` cannot place it before @p bucket.
+ *
+ * @param tree   A pointer to the tree.
+ * @param bucket A pointer to the full bucket.
+ * @return       A pointer to the new bucket, or NULL if every key of
+ *               @p bucket is the same and it cannot be split.
+ */
+static Bucket *split(BucketTree *tree, Bucket *bucket) {
+    int mid = RBT_BUCKET_KEYS / 2;
+    while (mid < RBT_BUCKET_KEYS && bucket->keys[mid] == bucket->keys[0]) {
+        mid++;
+    }
+    if (mid == RBT_BUCKET_KEYS) {
+        return NULL;
+    }
+
+    Bucket *upper = bucket_init(tree);
+    upper->count = RBT_BUCKET_KEYS - mid;
+    memcpy(upper->keys, &bucket->keys[mid], upper->count * sizeof(int));
+    upper->node.data = upper->keys[0];
+    for (int i = mid; i < RBT_BUCKET_KEYS; i++) {
+        bucket->keys[i] = INT_MAX;
+    }
+    bucket->count = mid;
+
+    rbt_link(&tree->index, &upper->node, bucket_compare);
+    return upper;
+}
+
+
+/**
+ * \ingroup bkt_helpers
+ * @brief Fixes a bucket that has fallen below `BKT_MIN` keys.
+ *
+ * The bucket is merged with its successor (or, for the last bucket, its
+ * predecessor) if their keys fit in one bucket; otherwise the keys of the two
+ * are shared out evenly. An empty bucket without neighbours is freed.
+ *
+ * @param tree   A pointer to the tree.
+ * @param bucket A pointer to the underfull bucket.
+ */
+static void underflow(BucketTree *tree, Bucket *bucket) {
+    Bucket *lo = bucket;
+    Bucket *hi = NULL;
+    Node *next = rbt_next(&bucket->node);
+    Node *prev = rbt_prev(&bucket->node);
+
+    if (next) {
+        hi = rbt_entry(next, Bucket, node);
+    } else if (prev) {
+        lo = rbt_entry(prev, Bucket, node);
+        hi = bucket;
+    } else {
+        if (!bucket->count) {
+            bucket_destroy(tree, bucket);
+        }
+        return;
+    }
+
+    if (lo->count + hi->count <= RBT_BUCKET_KEYS) {
+        memcpy(&lo->keys[lo->count], hi->keys, hi->count * sizeof(int));
+        lo->count += hi->count;
+        lo->node.data = lo->keys[0];
+        bucket_destroy(tree, hi);
+        return;
+    }
+
+    int half = (lo->count + hi->count) / 2;
+    if (lo->count < half) {
+        int moved = half - lo->count;
+        memcpy(&lo->keys[lo->count], hi->keys, moved * sizeof(int));
+        lo->count = half;
+        lo->node.data = lo->keys[0];
+        memmove(hi->keys, &hi->keys[moved], (hi->count - moved) * sizeof(int));
+        for (int i = hi->count - moved; i < hi->count; i++) {
+            hi->keys[i] = INT_MAX;
+        }
+        hi->count -= moved;
+    } else {
+        int moved = lo->count - half;
+        memmove(&hi->keys[moved], hi->keys, hi->count * sizeof(int));
+        memcpy(hi->keys, &lo->keys[half], moved * sizeof(int));
+        for (int i = half; i < lo->count; i++) {
+            lo->keys[i] = INT_MAX;
+        }
+        lo->count = half;
+        hi->count += moved;
+    }
+    hi->node.data = hi->keys[0];
+}
+
+
+
+
+
+/**
+ * \defgroup bkt Bucketed Tree
+ *
+ * This section documents the public interface of the bucketed-leaf engine.
+ * Key operations include:
+ *
+ * - `bkt_init()`: Initializes a new, empty tree.
+ * - `bkt_destroy()`: Frees the tree.
+ * - `bkt_insert()`, `bkt_delete()`: Modify the tree.
+ * - `bkt_contains()`, `bkt_range()`: Query the tree.
+ */
+
+/**
+ * \ingroup bkt
+ * @brief Initializes a new, empty bucketed tree.
+ *
+ * @return A pointer to the newly initialized tree if successful, error and
+ *         exits otherwise.
+ */
+BucketTree *bkt_init(void) {
+    BucketTree *tree = (BucketTree *)(malloc(sizeof(BucketTree)));
+    if (!tree) {
+        perror("bkt_init(): malloc failed");
+        exit(1);
+    }
+
+    rbt_init_intrusive(&tree->index);
+    tree->buckets = 0;
+    return tree;
+}
+
+
+/**
+ * \ingroup bkt
+ * @brief Destroys a bucketed tree and frees its memory.
+ *
+ * @param tree A pointer to the tree to be destroyed. May be NULL.
+ */
+void bkt_destroy(BucketTree *tree) {
+    if (!tree) {
+        return;
+    }
+
+    subtree_destroy(tree->index.root);
+    free(tree);
+}
+
+
+/**
+ * \ingroup bkt
+ * @brief Inserts a key into the bucketed tree.
+ *
+ * @param tree A pointer to the tree.
+ * @param data The key to insert.
+ */
+void bkt_insert(BucketTree *tree, const int data) {
+    Bucket *bucket = bucket_find(tree, data, false);
+    if (!bucket && tree->index.min) {
+        bucket = rbt_entry(tree->index.min, Bucket, node);
+    }
+
+    if (bucket && bucket->count == RBT_BUCKET_KEYS) {
+        Bucket *upper = split(tree, bucket);
+        if (upper && upper->keys[0] <= data) {
+            bucket = upper;
+        } else if (!upper) {
+            /* a run of equal keys; the new bucket orders before it if data is equal */
+            bucket = NULL;
+        }
+    }
+
+    if (!bucket) {
+        bucket = bucket_init(tree);
+        bucket_add(bucket, 0, data);
+        rbt_link(&tree->index, &bucket->node, bucket_compare);
+        return;
+    }
+
+    bucket_add(bucket, bucket_rank(bucket, data), data);
+}
+
+
+/**
+ * \ingroup bkt
+ * @brief Deletes one occurrence of a key from the bucketed tree.
+ *
+ * @param tree A pointer to the tree.
+ * @param data The key to delete.
+ * @return     true if the key was found and deleted, false otherwise.
+ */
+bool bkt_delete(BucketTree *tree, const int data) {
+    Bucket *bucket = bucket_find(tree, data, false);
+    if (!bucket) {
+        return false;
+    }
+
+    int i = bucket_rank(bucket, data);
+    if (i == bucket->count || bucket->keys[i] != data) {
+        return false;
+    }
+
+    bucket_remove(bucket, i);
+    if (bucket->count < BKT_MIN) {
+        underflow(tree, bucket);
+    }
+    return true;
+}
+
+
+/**
+ * \ingroup bkt
+ * @brief Returns whether a key is present in the bucketed tree.
+ *
+ * @param tree A pointer to the tree.
+ * @param data The key to search for.
+ * @return     true if @p data is present, false otherwise.
+ */
+bool bkt_contains(BucketTree *tree, const int data) {
+    Bucket *bucket = bucket_find(tree, data, false);
+    if (!bucket) {
+        return false;
+    }
+
+    int i = bucket_rank(bucket, data);
+    return i < bucket->count && bucket->keys[i] == data;
+}
+
+
+/**
+ * \ingroup bkt
+ * @brief Visits every key in [@p lo, @p hi] in sorted order.
+ *
+ * Equal keys may span several buckets, so the scan starts at the last bucket
+ * whose smallest key is strictly less than @p lo.
+ *
+ * @param tree  A pointer to the tree.
+ * @param lo    The smallest key to visit.
+ * @param hi    The largest key to visit.
+ * @param visit The function called for every key.
+ * @param ctx   An opaque pointer passed to @p visit.
+ */
+void bkt_range(BucketTree *tree, const int lo, const int hi, RbtVisitor visit, void *ctx) {
+    if (hi < lo) {
+        return;
+    }
+
+    Bucket *first = bucket_find(tree, lo, true);
+    Node *x = first ? &first->node : tree->index.min;
+    int i = first ? bucket_rank(first, lo) : 0;
+
+    for (; x; x = rbt_next(x), i = 0) {
+        Bucket *bucket = rbt_entry(x, Bucket, node);
+        for (; i < bucket->count; i++) {
+            if (bucket->keys[i] > hi) {
+                return;
+            }
+            visit(bucket->keys[i], ctx);
+        }
+    }
+}
@@ -0,0 +1,152 @@
+/**
+ * @file bucket.h
+ *
+ * @brief Declaration of the bucketed-leaf engine.
+ *
+ * Most nodes of a binary tree sit in its bottom levels, and that is where a
+ * search takes most of its cache misses. This engine keeps the upper levels
+ * Red-Black but replaces the fringe with buckets: each node of the tree
+ * carries a sorted array of up to `RBT_BUCKET_KEYS` keys, so the tree itself
+ * has about 1/20 as many nodes and a search ends with a scan of a few adjacent
+ * cache lines, compared with SSE2 four keys at a time. Buckets are split when
+ * they overflow and merged with a neighbour when they fall below a quarter
+ * full.
+ *
+ * The buckets are linked through the intrusive interface of `rbt.h`, ordered
+ * by their smallest key, so the same `fixup()` and `erase()` keep them
+ * balanced. This engine is normally not used directly: a `Tree` created with
+ * `rbt_init_engine(RBT_ENGINE_BUCKET)` forwards the engine-independent
+ * `rbt_*` functions (insert, delete, contains, iteration) here.
+ *
+ * Key Components:
+ * - Bucket: A node of the Red-Black tree together with its sorted keys.
+ * - BucketTree: The tree of buckets.
+ *
+ * Key Functions (Declared):
+ * - bkt_init(): Creates and returns a new, empty bucketed tree.
+ * - bkt_destroy(): Destroys the tree, freeing all allocated memory.
+ * - bkt_insert(): Inserts a key.
+ * - bkt_delete(): Deletes one occurrence of a key.
+ * - bkt_contains(): Returns whether a key is present.
+ * - bkt_range(): Visits every key in a range in sorted order.
+ *
+ * @version 1.0
+ * @date 2024-02-27
+ * @author Warren Kim
+ */
+
+#ifndef BUCKET_H
+#define BUCKET_H
+
+#include "rbt.h"
+
+/**
+ * @def RBT_BUCKET_KEYS
+ * @brief The maximum number of keys in a bucket.
+ *
+ * With the default of 32 keys, the keys of a bucket span two 64-byte cache
+ * lines. Override it at compile time with a multiple of 4 between 16 and 64,
+ * e.g. `-DRBT_BUCKET_KEYS=64`.
+ */
+#ifndef RBT_BUCKET_KEYS
+#define RBT_BUCKET_KEYS 32
+#endif
+
+/**
+ * @typedef struct Bucket
+ * @struct Bucket
+ * @brief A node of the bucketed tree.
+ *
+ * @var Bucket::node
+ * The node linking the bucket into `BucketTree::index`. `Node::data` caches
+ * `keys[0]`, the key the buckets are ordered by.
+ *
+ * @var Bucket::count
+ * The number of keys in the bucket, between 1 and `RBT_BUCKET_KEYS`.
+ *
+ * @var Bucket::keys
+ * The keys of the bucket in ascending order. Unused slots hold `INT_MAX`, so
+ * that a scan may always compare the whole array.
+ */
+typedef struct Bucket {
+    Node node;
+    int count;
+    int keys[RBT_BUCKET_KEYS];
+} Bucket;
+
+/**
+ * @typedef struct BucketTree
+ * @struct BucketTree
+ * @brief Structure representing a bucketed tree.
+ *
+ * @var BucketTree::index
+ * An intrusive Red-Black tree of the buckets, ordered by their smallest key.
+ * Every key of a bucket lies between its own smallest key and that of the
+ * next bucket.
+ *
+ * @var BucketTree::buckets
+ * The number of buckets currently allocated by the tree.
+ */
+typedef struct BucketTree {
+    Tree index;
+    size_t buckets;
+} BucketTree;
+
+/**
+ * @brief Initializes a new, empty bucketed tree.
+ *
+ * @return A pointer to the newly initialized tree if successful, error and
+ *         exits otherwise.
+ */
+BucketTree *bkt_init(void);
+
+/**
+ * @brief Destroys a bucketed tree and frees its memory.
+ *
+ * @param tree A pointer to the tree to be destroyed. May be NULL.
+ */
+void bkt_destroy(BucketTree *tree);
+
+/**
+ * @brief Inserts a key into the bucketed tree.
+ *
+ * A full bucket is split in two around its middle before the key is added.
+ *
+ * @param tree A pointer to the tree.
+ * @param data The key to insert.
+ */
+void bkt_insert(BucketTree *tree, const int data);
+
+/**
+ * @brief Deletes one occurrence of a key from the bucketed tree.
+ *
+ * A bucket that falls below a quarter full is merged with a neighbour, or
+ * takes keys from it if both would not fit in one bucket.
+ *
+ * @param tree A pointer to the tree.
+ * @param data The key to delete.
+ * @return     true if the key was found and deleted, false otherwise.
+ */
+bool bkt_delete(BucketTree *tree, const int data);
+
+/**
+ * @brief Returns whether a key is present in the bucketed tree.
+ *
+ * @param tree A pointer to the tree.
+ * @param data The key to search for.
+ * @return     true if @p data is present, false otherwise.
+ */
+bool bkt_contains(BucketTree *tree, const int data);
+
+/**
+ * @brief Visits every key in [@p lo, @p hi] in sorted order.
+ *
+ * @param tree  A pointer to the tree.
+ * @param lo    The smallest key to visit.
+ * @param hi    The largest key to visit.
+ * @param visit The function called for every key.
+ * @param ctx   An opaque pointer passed to @p visit.
+ */
+void bkt_range(BucketTree *tree, const int lo, const int hi, RbtVisitor visit, void *ctx);
+
+#endif
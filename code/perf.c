@@ -0,0 +1,223 @@
+/**
+ * @file perf.c
+ *
+ * @brief Implementation of the hardware performance counter interface.
+ *
+ * On Linux, each counter is opened with `perf_event_open(2)` as a disabled,
+ * user-space-only counter of the calling thread. Counters are opened one at a
+ * time rather than as a group, so an unsupported event (common in virtual
+ * machines) only disables that one event. On every other platform the counters
+ * are reported as unavailable.
+ *
+ * @version 1.0
+ * @date 2024-02-27
+ * @author Warren Kim
+ */
+
+#include "perf.h"
+#include <stdint.h>
+#include <string.h>
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+/**
+ * \defgroup perf Performance Counters
+ *
+ * This section covers the wrapper around the hardware performance counters
+ * used by the benchmarks. Key operations include:
+ *
+ * - `perf_open()`: Opens every counter supported by the system.
+ * - `perf_start()`: Resets and enables the counters.
+ * - `perf_stop()`: Disables the counters and reads their (scaled) values.
+ * - `perf_close()`: Closes the counters.
+ */
+
+/**
+ * \ingroup perf
+ * @brief Printable names of the events, indexed by `PerfEvent`.
+ */
+static const char *event_names[PERF_NUM_EVENTS] = {
+    "cycles", "instr", "L1d-miss", "LLC-miss", "dTLB-miss", "br-miss"
+};
+
+#ifdef __linux__
+/**
+ * \ingroup perf
+ * @brief Encodes a hardware cache event as expected by `perf_event_attr`.
+ *
+ * @param cache  The cache to measure, e.g. `PERF_COUNT_HW_CACHE_L1D`.
+ * @return       The config value for a read miss on @p cache.
+ */
+static uint64_t cache_read_miss(uint64_t cache) {
+    return cache
+        | (PERF_COUNT_HW_CACHE_OP_READ << 8)
+        | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+}
+
+
+/**
+ * \ingroup perf
+ * @brief Opens a single disabled counter for the calling thread.
+ *
+ * @param type   The event type, e.g. `PERF_TYPE_HARDWARE`.
+ * @param config The event config within @p type.
+ * @return       The counter's file descriptor, or -1 if it is unavailable.
+ */
+static int open_counter(uint32_t type, uint64_t config) {
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = type;
+    attr.config = config;
+    attr.disabled = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+
+    long fd = syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+    return fd < 0 ? -1 : (int)fd;
+}
+#endif
+
+
+/**
+ * \ingroup perf
+ * @brief Opens every supported hardware counter.
+ *
+ * Counters that cannot be opened are marked unavailable rather than treated as
+ * an error.
+ *
+ * @param pc A pointer to the counters to open.
+ * @return   true if at least one counter is available, false otherwise.
+ */
+bool perf_open(PerfCounters *pc) {
+    bool any = false;
+
+    for (int i = 0; i < PERF_NUM_EVENTS; i++) {
+        pc->fd[i] = -1;
+        pc->value[i] = 0;
+    }
+
+#ifdef __linux__
+    pc->fd[PERF_CYCLES] = open_counter(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES);
+    pc->fd[PERF_INSTRUCTIONS] = open_counter(PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS);
+    pc->fd[PERF_L1D_MISSES] = open_counter(PERF_TYPE_HW_CACHE, cache_read_miss(PERF_COUNT_HW_CACHE_L1D));
+    pc->fd[PERF_LLC_MISSES] = open_counter(PERF_TYPE_HW_CACHE, cache_read_miss(PERF_COUNT_HW_CACHE_LL));
+    pc->fd[PERF_DTLB_MISSES] = open_counter(PERF_TYPE_HW_CACHE, cache_read_miss(PERF_COUNT_HW_CACHE_DTLB));
+    pc->fd[PERF_BRANCH_MISSES] = open_counter(PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES);
+#endif
+
+    for (int i = 0; i < PERF_NUM_EVENTS; i++) {
+        any = any || pc->fd[i] >= 0;
+    }
+
+    return any;
+}
+
+
+/**
+ * \ingroup perf
+ * @brief Resets and enables every available counter.
+ *
+ * @param pc A pointer to the counters to start.
+ */
+void perf_start(PerfCounters *pc) {
+#ifdef __linux__
+    for (int i = 0; i < PERF_NUM_EVENTS; i++) {
+        if (pc->fd[i] >= 0) {
+            ioctl(pc->fd[i], PERF_EVENT_IOC_RESET, 0);
+        }
+    }
+    for (int i = 0; i < PERF_NUM_EVENTS; i++) {
+        if (pc->fd[i] >= 0) {
+            ioctl(pc->fd[i], PERF_EVENT_IOC_ENABLE, 0);
+        }
+    }
+#else
+    (void)pc;
+#endif
+}
+
+
+/**
+ * \ingroup perf
+ * @brief Disables every available counter and stores its value.
+ *
+ * If the kernel multiplexed a counter (because more counters were requested
+ * than the PMU has registers), its raw value is scaled by the ratio of the
+ * time it was enabled to the time it was actually running.
+ *
+ * @param pc A pointer to the counters to stop.
+ */
+void perf_stop(PerfCounters *pc) {
+#ifdef __linux__
+    for (int i = 0; i < PERF_NUM_EVENTS; i++) {
+        if (pc->fd[i] >= 0) {
+            ioctl(pc->fd[i], PERF_EVENT_IOC_DISABLE, 0);
+        }
+    }
+
+    for (int i = 0; i < PERF_NUM_EVENTS; i++) {
+        uint64_t buf[3];
+        pc->value[i] = 0;
+        if (pc->fd[i] < 0 || read(pc->fd[i], buf, sizeof(buf)) != sizeof(buf)) {
+            continue;
+        }
+
+        pc->value[i] = (double)buf[0];
+        if (buf[2] && buf[2] < buf[1]) {
+            pc->value[i] *= (double)buf[1] / (double)buf[2];
+        }
+    }
+#else
+    (void)pc;
+#endif
+}
+
+
+/**
+ * \ingroup perf
+ * @brief Closes every available counter.
+ *
+ * @param pc A pointer to the counters to close.
+ */
+void perf_close(PerfCounters *pc) {
+    for (int i = 0; i < PERF_NUM_EVENTS; i++) {
+#ifdef __linux__
+        if (pc->fd[i] >= 0) {
+            close(pc->fd[i]);
+        }
+#endif
+        pc->fd[i] = -1;
+    }
+}
+
+
+/**
+ * \ingroup perf
+ * @brief Returns whether a given counter could be opened.
+ *
+ * @param pc    A pointer to the counters.
+ * @param event The event to query.
+ * @return      true if @p event is being measured, false otherwise.
+ */
+bool perf_available(const PerfCounters *pc, PerfEvent event) {
+    return pc->fd[event] >= 0;
+}
+
+
+/**
+ * \ingroup perf
+ * @brief Returns a short, printable name for an event.
+ *
+ * @param event The event to name.
+ * @return      A static string such as "cycles" or "br-miss".
+ */
+const char *perf_event_name(PerfEvent event) {
+    return event_names[event];
+}
@@ -0,0 +1,124 @@
+/**
+ * @file perf.h
+ *
+ * @brief Declaration of the hardware performance counter interface used by the
+ *        benchmark harness.
+ *
+ * Wall-clock timings alone do not tell us *why* an operation is slow. This
+ * header declares a thin wrapper around Linux `perf_event_open(2)` that
+ * measures, for a region of code:
+ *
+ * - CPU cycles
+ * - retired instructions
+ * - L1 data cache read misses
+ * - last level cache (LLC) read misses
+ * - data TLB read misses
+ * - branch mispredictions
+ *
+ * Every counter is opened independently, so a machine (or a container) that
+ * exposes only some of them still reports the ones it has. If
+ * `perf_event_open()` is unavailable altogether, e.g. on a non-Linux system or
+ * when `/proc/sys/kernel/perf_event_paranoid` forbids it, every counter is
+ * simply marked unavailable and the benchmarks fall back to timings only.
+ *
+ * Key Functions (Declared):
+ * - perf_open(): Opens all counters that the system supports.
+ * - perf_start(): Resets and enables the counters.
+ * - perf_stop(): Disables the counters and reads their values.
+ * - perf_close(): Releases the counters.
+ *
+ * @version 1.0
+ * @date 2024-02-27
+ * @author Warren Kim
+ */
+
+#ifndef PERF_H
+#define PERF_H
+
+#include <stdbool.h>
+
+/**
+ * @typedef enum PerfEvent
+ * @enum PerfEvent
+ * @brief The hardware events measured by the benchmark harness.
+ *
+ * `PERF_NUM_EVENTS` is not an event; it is the number of events and is used to
+ * size the arrays in `PerfCounters`.
+ */
+typedef enum {
+    PERF_CYCLES,
+    PERF_INSTRUCTIONS,
+    PERF_L1D_MISSES,
+    PERF_LLC_MISSES,
+    PERF_DTLB_MISSES,
+    PERF_BRANCH_MISSES,
+    PERF_NUM_EVENTS
+} PerfEvent;
+
+/**
+ * @typedef struct PerfCounters
+ * @struct PerfCounters
+ * @brief A set of hardware counters measuring one region of code.
+ *
+ * @var PerfCounters::fd
+ * The file descriptor of each counter, or -1 if the counter is unavailable.
+ *
+ * @var PerfCounters::value
+ * The value of each counter read by the last call to `perf_stop()`. Values are
+ * scaled up if the kernel had to multiplex the counters.
+ */
+typedef struct PerfCounters {
+    int fd[PERF_NUM_EVENTS];
+    double value[PERF_NUM_EVENTS];
+} PerfCounters;
+
+/**
+ * @brief Opens every supported hardware counter.
+ *
+ * Counters that cannot be opened are marked unavailable rather than treated as
+ * an error.
+ *
+ * @param pc A pointer to the counters to open.
+ * @return   true if at least one counter is available, false otherwise.
+ */
+bool perf_open(PerfCounters *pc);
+
+/**
+ * @brief Resets and enables every available counter.
+ *
+ * @param pc A pointer to the counters to start.
+ */
+void perf_start(PerfCounters *pc);
+
+/**
+ * @brief Disables every available counter and stores its value.
+ *
+ * @param pc A pointer to the counters to stop.
+ */
+void perf_stop(PerfCounters *pc);
+
+/**
+ * @brief Closes every available counter.
+ *
+ * @param pc A pointer to the counters to close.
+ */
+void perf_close(PerfCounters *pc);
+
+/**
+ * @brief Returns whether a given counter could be opened.
+ *
+ * @param pc    A pointer to the counters.
+ * @param event The event to query.
+ * @return      true if @p event is being measured, false otherwise.
+ */
+bool perf_available(const PerfCounters *pc, PerfEvent event);
+
+/**
+ * @brief Returns a short, printable name for an event.
+ *
+ * @param event The event to name.
+ * @return      A static string such as "cycles" or "br-miss".
+ */
+const char *perf_event_name(PerfEvent event);
+
+#endif
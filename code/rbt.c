@@ -1,7 +1,7 @@
 /**
  * @file rbt.c
  *
- * @brief Implementation of a Red-Black Tree in C (Insertion Only).
+ * @brief Implementation of a Red-Black Tree in C.
  *
  * This file contains the definition and implementation details of a Red-Black
  * Tree, a self-balancing binary search tree. In a Red-Black Tree, each node
@@ -33,6 +33,8 @@
  * - rbt_destroy(): Frees memory allocated for the Red-Black Tree.
  * - rbt_insert(): Inserts a new node with the given
  *   data into the tree.
+ * - rbt_delete(): Deletes a node with the given data from the tree.
+ * - rbt_pop_min(), rbt_pop_max(): Remove the smallest or largest value.
  * - rbt_inorder(): Performs an inorder traversal of the tree.
  * - rbt_print_tree(): Prints the tree structure.
  *
@@ -45,9 +47,190 @@
  */
 
 #include "rbt.h"
+#include "bptree.h"
+#include "bucket.h"
+#include "wal.h"
+#include <limits.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <math.h>
+#include <stdbool.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <time.h>
+#include <unistd.h>
+#ifdef __GLIBC__
+#include <malloc.h>
+#endif
+#ifdef __linux__
+#include <sys/mman.h>
+#endif
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+#include <string.h>
+
+/* every tree created by rbt_init_engine() and not yet destroyed */
+static Tree *registry = NULL;
+static pthread_mutex_t registry_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* guards the slab lists of every tree, since detached nodes may be freed on another thread */
+static pthread_mutex_t slab_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/**
+ * \defgroup slab Slab Allocation
+ *
+ * This section covers the slabs that `rbt_compact()` relocates nodes into.
+ * A slab is a block of `RBT_SLAB_BYTES`, aligned to its own size, so the slab
+ * holding a node is found by masking the node's address. Each slab counts its
+ * live nodes and is freed when the last one goes; nodes outside slabs are
+ * allocated and freed individually as before. Key operations include:
+ *
+ * - `slab_of()`: Returns the slab holding a node.
+ * - `slab_release()`: Drops a reference to a slab, freeing it at zero.
+ * - `slab_alloc()`: Returns a free slot in the slab being filled.
+ * - `slab_orphan()`: Detaches the remaining slabs from a destroyed tree.
+ */
+
+/**
+ * \ingroup slab
+ * @typedef struct Slab
+ * @struct Slab
+ * @brief A block of nodes relocated by `rbt_compact()`.
+ *
+ * `live` counts the nodes in use plus one reference held while the slab is
+ * being filled, so exactly one release brings it to zero, on whichever thread.
+ * `prev`, `next` and `owner` are guarded by `slab_lock`.
+ */
+typedef struct Slab {
+    struct Slab *prev;
+    struct Slab *next;
+    Tree *owner;
+    unsigned gen;
+    size_t used;
+    size_t capacity;
+    atomic_size_t live;
+    Node nodes[];
+} Slab;
+
+
+/**
+ * \ingroup slab
+ * @brief Returns the slab holding a node.
+ *
+ * @param node A pointer to a node with `Node::slab` set.
+ * @return     A pointer to the slab containing @p node.
+ */
+static Slab *slab_of(Node *node) {
+    return (Slab *)((uintptr_t)node & ~(uintptr_t)(RBT_SLAB_BYTES - 1));
+}
+
+
+/**
+ * \ingroup slab
+ * @brief Drops a reference to a slab, freeing it when none are left.
+ *
+ * @param s A pointer to the slab.
+ */
+static void slab_release(Slab *s) {
+    if (atomic_fetch_sub(&s->live, 1) != 1) {
+        return;
+    }
+
+    pthread_mutex_lock(&slab_lock);
+    if (s->prev) {
+        s->prev->next = s->next;
+    } else if (s->owner) {
+        s->owner->slabs = s->next;
+    }
+    if (s->next) {
+        s->next->prev = s->prev;
+    }
+    pthread_mutex_unlock(&slab_lock);
+    free(s);
+}
+
+
+/**
+ * \ingroup slab
+ * @brief Returns a free slot in the slab being filled by the current
+ *        compaction pass, starting a new slab when it is full.
+ *
+ * @param tree A pointer to the tree being compacted.
+ * @return     A pointer to an uninitialized node slot.
+ */
+static Node *slab_alloc(Tree *tree) {
+    Slab *s = tree->fill;
+    if (!s || s->used == s->capacity) {
+        void *block = NULL;
+        if (posix_memalign(&block, RBT_SLAB_BYTES, RBT_SLAB_BYTES)) {
+            perror("slab_alloc(): posix_memalign failed");
+            exit(1);
+        }
+#if defined(__linux__) && defined(MADV_HUGEPAGE)
+        if (RBT_SLAB_BYTES >= 2 * 1024 * 1024) {
+            madvise(block, RBT_SLAB_BYTES, MADV_HUGEPAGE);
+        }
+#endif
+
+        s = (Slab *)block;
+        s->prev = NULL;
+        s->owner = tree;
+        s->gen = tree->compact_gen;
+        s->used = 0;
+        s->capacity = (RBT_SLAB_BYTES - sizeof(Slab)) / sizeof(Node);
+        atomic_init(&s->live, 1);
+
+        pthread_mutex_lock(&slab_lock);
+        s->next = tree->slabs;
+        if (tree->slabs) {
+            tree->slabs->prev = s;
+        }
+        tree->slabs = s;
+        pthread_mutex_unlock(&slab_lock);
+
+        if (tree->fill) {
+            slab_release(tree->fill);
+        }
+        tree->fill = s;
+    }
+
+    atomic_fetch_add(&s->live, 1);
+    return &s->nodes[s->used++];
+}
+
+
+/**
+ * \ingroup slab
+ * @brief Detaches the remaining slabs from a tree that is being destroyed.
+ *
+ * Slabs still holding detached nodes (see `rbt_detach_range()`) outlive the
+ * tree and are freed with their last node.
+ *
+ * @param tree A pointer to the tree.
+ */
+static void slab_orphan(Tree *tree) {
+    pthread_mutex_lock(&slab_lock);
+    for (Slab *s = tree->slabs, *next; s; s = next) {
+        next = s->next;
+        s->prev = NULL;
+        s->next = NULL;
+        s->owner = NULL;
+    }
+    tree->slabs = NULL;
+    pthread_mutex_unlock(&slab_lock);
+
+    if (tree->fill) {
+        slab_release(tree->fill);
+        tree->fill = NULL;
+    }
+}
+
+
+
+
+
 
 /**
  * \defgroup bst Binary Search Tree
@@ -60,8 +243,17 @@
  *
  * - `node_init()`: Initializes a new node with specified data, setting it to RED.
  * - `node_destroy()`: Frees the memory allocated for a node, ensuring no access to its children.
+ * - `subtree_destroy()`: Frees every node in a subtree, children first.
  * - `bst_insert()`: Inserts a new node into the tree following BST rules, setting up for Red-Black fixups.
  * - `bst_search()`: Recursively searches for a node by its value, adhering to BST search semantics.
+ * - `bst_insert_at()`: Iteratively inserts a new node into a given subtree.
+ * - `finger()`: Ascends from a recently visited node to the subtree covering a value.
+ * - `bst_lower_bound()`: Finds the first node whose value is not less than a given value.
+ * - `bst_successor()`: Returns the in-order successor of a node.
+ * - `bst_predecessor()`: Returns the in-order predecessor of a node.
+ * - `node_update()`: Recomputes the subtree summary of a node in augmented builds.
+ * - `propagate()`: Recomputes the subtree summaries from a node up to the root.
+ * - `build_sorted()`: Builds a balanced subtree from sorted values.
  */
 
 /**
@@ -87,10 +279,28 @@ static Node *node_init(const int data) {
     }
 
     node->color = RED;
+    node->slab = false;
     node->left = NULL;
     node->right = NULL;
     node->parent = NULL;
     node->data = data;
+#ifdef RBT_THREADED
+    node->next = NULL;
+    node->prev = NULL;
+#endif
+#ifdef RBT_INTERVAL
+    node->high = data;
+    node->max_high = data;
+#endif
+#ifdef RBT_AUGMENT
+    node->value = data;
+    node->agg = RBT_AGG_LIFT(data);
+#endif
+#ifdef RBT_EXPIRY
+    node->expires = 0;
+    node->older = NULL;
+    node->newer = NULL;
+#endif
 
     return node;
 }
@@ -123,7 +333,31 @@ static void node_destroy(Node *node) {
         node->right = NULL;
     }
 
-    free(node);
+    if (node->slab) {
+        slab_release(slab_of(node));
+    } else {
+        free(node);
+    }
+}
+
+
+/**
+ * \ingroup bst
+ * @brief Frees every node in the subtree rooted at @p root.
+ *
+ * The children of each node are destroyed before the node itself, so no node
+ * is accessed after it has been freed.
+ *
+ * @param root A pointer to the root of the subtree to be destroyed.
+ */
+static void subtree_destroy(Node *root) {
+    if (!root) {
+        return;
+    }
+
+    subtree_destroy(root->left);
+    subtree_destroy(root->right);
+    node_destroy(root);
 }
 
 
@@ -205,150 +439,656 @@ static Node *bst_search(Node *root, const int data) {
 }
 
 
+/**
+ * \ingroup bst
+ * @brief Inserts a new node into the subtree rooted at @p root.
+ *
+ * This is the iterative counterpart of `bst_insert()`. It is used when the
+ * insertion starts below the root of the tree, e.g. from a finger, so the new
+ * node's parent pointer is set directly instead of while unwinding.
+ *
+ * @param root The (non-NULL) root of the subtree to insert into. The caller
+ *             guarantees that @p data belongs in this subtree.
+ * @param data The integer value for the new node.
+ * @return     A pointer to the newly inserted node.
+ *
+ * @note We set equality to the left of the subtree.
+ */
+static Node *bst_insert_at(Node *root, const int data) {
+    Node *z = node_init(data);
+
+    while (true) {
+        if (data <= root->data) {
+            if (!root->left) {
+                root->left = z;
+                break;
+            }
+            root = root->left;
+        } else {
+            if (!root->right) {
+                root->right = z;
+                break;
+            }
+            root = root->right;
+        }
+    }
 
+    z->parent = root;
+    return z;
+}
 
 
 /**
- * \defgroup rbt_helpers Red-Black Tree Helper Functions
+ * \ingroup bst
+ * @brief Finds the lowest ancestor of a finger whose subtree covers a value.
  *
- * This section describes the helper functions used for maintaining the
- * Red-Black tree properties. These functions are essential for internal
- * operations such as rotations, insertions, deletions, and color adjustments
- * which ensure the tree remains balanced and conforms to red-black tree rules.
- * Key operations include:
+ * Every subtree covers a range of keys bounded by its nearest ancestors: the
+ * closest ancestor it hangs to the right of bounds it from below, and the
+ * closest ancestor it hangs to the left of bounds it from above. This
+ * function ascends from @p x through `parent` only until the bound on the side
+ * of @p data admits @p data; the other bound trivially does, since @p x itself
+ * lies on the other side. Any search or insertion of @p data can then start
+ * at the returned node instead of the root.
  *
- * - `grandparent()`: Returns the grandparent of a given node.
- * - `uncle()`: Returns the uncle of a given node.
- * - `recolor()`: Handles the recolor case, fixing a double red violation.
- * - `left_rotate()`: Rotates around a node @p x once to the left.
- * - `right_rotate()`: Rotates around a node @p x once to the right.
- * - `restructure()`: Restructures the tree with respect to a node @p z,
- *                    fixing a double red violation.
- * - `fixup()`: Recursively fixes up the Red-Black tree after insertion.
+ * @param x    The finger; a node recently visited by the caller.
+ * @param data The value we want to search for or insert.
+ * @return     The lowest ancestor of @p x (possibly @p x itself) whose subtree
+ *             covers @p data. If that bound equals @p data, the bounding
+ *             ancestor is returned instead, since it holds @p data itself.
+ *
+ * @note The cost is proportional to the distance between @p x and the position
+ *       of @p data, which is O(1) amortized for nearly-sorted streams.
  */
+static Node *finger(Node *x, const int data) {
+    if (x->data < data) {
+        while (true) {
+            Node *y = x;
+            while (y->parent && y->parent->right == y) {
+                y = y->parent;
+            }
+            if (!y->parent || data < y->parent->data) {
+                return x;
+            }
+            if (data == y->parent->data) {
+                return y->parent;
+            }
+            x = y->parent;
+        }
+    } else {
+        while (true) {
+            Node *y = x;
+            while (y->parent && y->parent->left == y) {
+                y = y->parent;
+            }
+            if (!y->parent || y->parent->data < data) {
+                return x;
+            }
+            x = y->parent;
+        }
+    }
+}
+
 
 /**
- * \ingroup rbt_helpers
- * @brief Returns the grandparent of a given node in a Red-Black tree.
- *
- * This helper function makes the code easier to read.
- *
- * @param z A pointer to the grandchild of the node we want.
- * @return  A pointer to the grandparent node if it exists; NULL otherwise.
+ * \ingroup bst
+ * @brief Finds the first node whose value is not less than a given value.
  *
- * @note This function assumes that the provided node @p z and its parent are
- *       non-NULL. It is the caller's responsibility to ensure this condition is met
- *       before calling the function. Failing to do so may result in undefined behavior.
+ * @param root A pointer to the root of the BST.
+ * @param data The value to search for.
+ * @return     A pointer to the leftmost node with a value >= @p data, or NULL
+ *             if every value is smaller.
  */
-static Node *grandparent(Node *z) {
-    return z->parent->parent;
+static Node *bst_lower_bound(Node *root, const int data) {
+    Node *candidate = NULL;
+
+    while (root) {
+        if (data <= root->data) {
+            candidate = root;
+            root = root->left;
+        } else {
+            root = root->right;
+        }
+    }
+
+    return candidate;
 }
 
 
+#ifndef RBT_THREADED
+/* threaded builds store the successor and predecessor in every node instead */
 /**
- * \ingroup rbt_helpers
- * @brief Returns the uncle of a given node in a Red-Black tree.
+ * \ingroup bst
+ * @brief Returns the in-order successor of a node.
  *
- * The function returns the uncle of a node, which is defined as the sibling of
- * the node's parent.
+ * @param x A pointer to a (non-NULL) node.
+ * @return  A pointer to the node that follows @p x in sorted order, or NULL if
+ *          @p x is the maximum.
+ */
+static Node *bst_successor(Node *x) {
+    if (x->right) {
+        x = x->right;
+        while (x->left) {
+            x = x->left;
+        }
+        return x;
+    }
+
+    while (x->parent && x->parent->right == x) {
+        x = x->parent;
+    }
+    return x->parent;
+}
+
+
+/**
+ * \ingroup bst
+ * @brief Returns the in-order predecessor of a node.
  *
- * @param z A pointer to the node whose uncle is desired.
- * @return  A pointer to the uncle node if it exists; NULL otherwise. This is
- *          because if the grandparent does not exist, it implies that the uncle
- *          cannot exist.
+ * @param x A pointer to a (non-NULL) node.
+ * @return  A pointer to the node that precedes @p x in sorted order, or NULL
+ *          if @p x is the minimum.
  */
-static Node *uncle(Node *z)
-{
-    Node *gp = grandparent(z);
+static Node *bst_predecessor(Node *x) {
+    if (x->left) {
+        x = x->left;
+        while (x->right) {
+            x = x->right;
+        }
+        return x;
+    }
 
-    if (!gp) {
-        return NULL;
+    while (x->parent && x->parent->left == x) {
+        x = x->parent;
     }
+    return x->parent;
+}
+#endif
 
-    if (gp->left == z->parent) {
-        return gp->right;
-    } else {
-        return gp->left;
+
+/**
+ * \ingroup bst
+ * @brief Recomputes the subtree summary of a node from its own fields and its
+ *        children's summaries.
+ *
+ * Augmented builds keep a summary of every subtree in its root, e.g. the
+ * largest interval end with `RBT_INTERVAL`, or the aggregate of the values
+ * with `RBT_AUGMENT`. Any operation that changes the
+ * children of a node must call this on the node afterwards, bottom-up: the
+ * rotations do so for the two nodes they move, and `propagate()` handles the
+ * path above a node whose subtree changed. In other builds it does nothing.
+ *
+ * @param x A pointer to the (non-NULL) node to update.
+ */
+static void node_update(Node *x) {
+#ifdef RBT_INTERVAL
+    x->max_high = x->high;
+    if (x->left && x->left->max_high > x->max_high) {
+        x->max_high = x->left->max_high;
+    }
+    if (x->right && x->right->max_high > x->max_high) {
+        x->max_high = x->right->max_high;
+    }
+#endif
+#ifdef RBT_AUGMENT
+    x->agg = RBT_AGG_LIFT(x->value);
+    if (x->left) {
+        x->agg = RBT_AGG_COMBINE(x->left->agg, x->agg);
+    }
+    if (x->right) {
+        x->agg = RBT_AGG_COMBINE(x->agg, x->right->agg);
     }
+#endif
+#if !defined(RBT_INTERVAL) && !defined(RBT_AUGMENT)
+    (void)x;
+#endif
 }
 
 
 /**
- * \ingroup rbt_helpers
- * @brief Recolors the parent, uncle, and grandparent of a given node in a Red-Black tree.
+ * \ingroup bst
+ * @brief Recomputes the subtree summaries from a node up to the root.
  *
- * This function changes the color of the parent and uncle of the node @p z to BLACK,
- * and the color of the grandparent to RED.
+ * In augmented builds this makes insertion and deletion O(log n) even where
+ * the rebalancing itself would be O(1), e.g. with `rbt_insert_hint()`. In
+ * other builds it does nothing.
  *
- * @param z A pointer to the node we are recoloring with respect to.
- * @return  A pointer to the grandparent of the node @p z after recoloring.
+ * @param x A pointer to the lowest node whose subtree changed, or NULL.
+ */
+static void propagate(Node *x) {
+#if defined(RBT_INTERVAL) || defined(RBT_AUGMENT)
+    for (; x; x = x->parent) {
+        node_update(x);
+    }
+#else
+    (void)x;
+#endif
+}
+
+
+/**
+ * \ingroup bst
+ * @brief Builds a balanced subtree from values in ascending order.
  *
- * @note This function assumes that the node @p z, its parent, and its grandparent are
- *       non-NULL, and that it has an uncle. These conditions are met by definition
- *       since by property 3, nil nodes are treated as BLACK.
+ * The middle value becomes the root and both halves are built recursively, so
+ * every NULL child lies at depth @p red_depth or @p red_depth + 1. Coloring the
+ * nodes at @p red_depth RED therefore gives every path the same black height.
+ *
+ * @param keys      A pointer to the values, in ascending order.
+ * @param n         The number of values.
+ * @param depth     The depth of the subtree's root.
+ * @param red_depth The depth whose nodes are colored RED, or -1 for none.
+ * @param parent    The parent of the subtree's root.
+ * @param last      A pointer to the most recently built node in sorted order,
+ *                  used to link threaded builds. Updated on return.
+ * @return          A pointer to the root of the subtree, or NULL if @p n is 0.
  */
-static Node *recolor(Node *z) {
-    z->parent->color = BLACK;
-    uncle(z)->color = BLACK;
-    grandparent(z)->color = RED;
+static Node *build_sorted(const int *keys, size_t n, int depth, int red_depth, Node *parent, Node **last) {
+    if (!n) {
+        return NULL;
+    }
 
-    return grandparent(z);
+    size_t mid = n / 2;
+    Node *x = node_init(keys[mid]);
+    x->color = depth == red_depth ? RED : BLACK;
+    x->parent = parent;
+    x->left = build_sorted(keys, mid, depth + 1, red_depth, x, last);
+#ifdef RBT_THREADED
+    x->prev = *last;
+    if (*last) {
+        (*last)->next = x;
+    }
+#endif
+    *last = x;
+    x->right = build_sorted(keys + mid + 1, n - mid - 1, depth + 1, red_depth, x, last);
+    node_update(x);
+    return x;
 }
 
 
+
+
+
 /**
- * \ingroup rbt_helpers
- * @brief Performs a left rotation on the given node within a Red-Black tree.
- *
- * This function applies a left rotation to the node pointed to by @p x,
- * adjusting the tree's structure to maintain Red-Black properties. Below is an
- * ASCII art diagram illustrating the left rotation:
+ * \defgroup hash_index Hash Index
  *
- * @verbatim
- *    p              p
- *    |              |
- *    x              y
- *   / \            / \
- *  _   y    =>    x   z
- *     / \        / \
- *    T   z      _   T
- * @endverbatim
+ * This section covers the optional open-addressing index from values to
+ * nodes, enabled per tree with `rbt_set_hash_index()`. Slots are probed
+ * linearly and store the value next to the node pointer, so an exact-match
+ * lookup touches one slot and then the node itself instead of O(log n) nodes.
+ * The table is kept at most half full, and deletions shift the following
+ * slots back instead of leaving tombstones. If a value occurs more than once,
+ * the index maps it to any one of its nodes. Key operations include:
  *
- * Here, we label the left child of @p x as @p _ because it is irrelevant to the
- * rotation. Additionally, @p x's parent @p p is directly above @p x since we
- * need to check if @p x is a left or right child of @p p.
+ * - `hash_slot()`: Returns the home slot of a value.
+ * - `hash_locate()`, `hash_find()`: Look a value up.
+ * - `hash_place()`, `hash_add()`: Index a node.
+ * - `hash_erase()`: Empties a slot, shifting the following slots back.
+ * - `hash_remove()`, `hash_remove_subtree()`: Drop or redirect the entries of
+ *   nodes being unlinked.
+ * - `hash_resize()`: Reallocates the table and indexes every node again.
+ */
+
+/**
+ * \ingroup hash_index
+ * @brief A slot of the hash index; empty while `node` is NULL.
+ */
+typedef struct HashSlot {
+    Node *node;
+    int key;
+} HashSlot;
+
+
+/**
+ * \ingroup hash_index
+ * @brief Returns the slot at which the probe for a value starts.
  *
- * @param x Pointer to the node to rotate. This node becomes the left child of
- *          its right child after rotation.
- * @return  The new root of the subtree after the rotation, which was the right
- *          child of @p x before the rotation.
+ * The value is scrambled with Fibonacci hashing, so that runs of consecutive
+ * values spread over the whole table.
  *
- * @note This function assumes @p x's right child is non-NULL and it's the caller's
- *       responsibility to ensure this. These conditions are met by definition of
- *       how we call the function. We call the function with respect to @p z, so
- *       @p y is defined.
+ * @param tree A pointer to the tree, which has a hash index.
+ * @param key  The value.
+ * @return     The index of the home slot.
  */
-static Node *left_rotate(Node *x) {
-    Node *y = x->right;
+static size_t hash_slot(const Tree *tree, const int key) {
+    uint64_t h = (uint64_t)(uint32_t)key * 0x9e3779b97f4a7c15ull;
+    return (size_t)(h >> 32) & (tree->hash_capacity - 1);
+}
 
-    x->right = y->left;
-    if (y->left) {
-        y->left->parent = x;
-    }
 
-    y->parent = x->parent;
-    if (x->parent) {
-        if (x->parent->left == x) {
-            x->parent->left = y;
-        } else if (x->parent->right == x) {
-            x->parent->right = y;
+/**
+ * \ingroup hash_index
+ * @brief Finds the slot holding a value.
+ *
+ * @param tree A pointer to the tree, which has a hash index.
+ * @param key  The value to look for.
+ * @return     The index of its slot, or `SIZE_MAX` if it is not indexed.
+ */
+static size_t hash_locate(const Tree *tree, const int key) {
+    size_t mask = tree->hash_capacity - 1;
+
+    for (size_t i = hash_slot(tree, key); tree->hash[i].node; i = (i + 1) & mask) {
+        if (tree->hash[i].key == key) {
+            return i;
         }
     }
-
-    y->left = x;
-    x->parent = y;
-
-    return y;
+    return SIZE_MAX;
+}
+
+
+/**
+ * \ingroup hash_index
+ * @brief Looks a value up in the hash index.
+ *
+ * @param tree A pointer to the tree, which has a hash index.
+ * @param key  The value to look for.
+ * @return     A pointer to a node holding @p key, or NULL if there is none.
+ */
+static Node *hash_find(const Tree *tree, const int key) {
+    size_t i = hash_locate(tree, key);
+    return i == SIZE_MAX ? NULL : tree->hash[i].node;
+}
+
+
+/**
+ * \ingroup hash_index
+ * @brief Indexes a node, unless its value is indexed already.
+ *
+ * @param tree A pointer to the tree, whose hash index has a free slot.
+ * @param z    A pointer to a node of the tree.
+ */
+static void hash_place(Tree *tree, Node *z) {
+    size_t mask = tree->hash_capacity - 1;
+    size_t i = hash_slot(tree, z->data);
+    while (tree->hash[i].node) {
+        if (tree->hash[i].key == z->data) {
+            return;
+        }
+        i = (i + 1) & mask;
+    }
+
+    tree->hash[i].node = z;
+    tree->hash[i].key = z->data;
+    tree->hash_count++;
+}
+
+
+/**
+ * \ingroup hash_index
+ * @brief Empties a slot of the hash index.
+ *
+ * Later slots of the same probe sequence are shifted back into the gap, so
+ * that no probe ever stops early at it.
+ *
+ * @param tree A pointer to the tree, which has a hash index.
+ * @param i    The index of the occupied slot.
+ */
+static void hash_erase(Tree *tree, size_t i) {
+    size_t mask = tree->hash_capacity - 1;
+
+    for (size_t j = (i + 1) & mask; tree->hash[j].node; j = (j + 1) & mask) {
+        /* the entry at j may fill the gap at i unless its home lies cyclically in (i, j] */
+        size_t home = hash_slot(tree, tree->hash[j].key);
+        if (((j - home) & mask) >= ((j - i) & mask)) {
+            tree->hash[i] = tree->hash[j];
+            i = j;
+        }
+    }
+
+    tree->hash[i].node = NULL;
+    tree->hash_count--;
+}
+
+
+/**
+ * \ingroup hash_index
+ * @brief Updates the hash index for a node about to be unlinked.
+ *
+ * If the index maps the node's value to @p z and another node holds the same
+ * value, the entry is redirected to it; equal values are adjacent in sorted
+ * order. Otherwise the entry is erased.
+ *
+ * @param tree A pointer to the tree, which has a hash index.
+ * @param z    A pointer to the node, still linked into the tree.
+ */
+static void hash_remove(Tree *tree, Node *z) {
+    size_t i = hash_locate(tree, z->data);
+    if (i == SIZE_MAX || tree->hash[i].node != z) {
+        return;
+    }
+
+    Node *other = rbt_prev(z);
+    if (!other || other->data != z->data) {
+        other = rbt_next(z);
+    }
+    if (other && other->data == z->data) {
+        tree->hash[i].node = other;
+        return;
+    }
+
+    hash_erase(tree, i);
+}
+
+
+/**
+ * \ingroup hash_index
+ * @brief Reallocates the hash index and indexes every node of the tree.
+ *
+ * @param tree     A pointer to the tree.
+ * @param capacity The new number of slots, a power of two more than twice the
+ *                 size of the tree.
+ */
+static void hash_resize(Tree *tree, size_t capacity) {
+    HashSlot *hash = (HashSlot *)calloc(capacity, sizeof(HashSlot));
+    if (!hash) {
+        perror("hash_resize(): calloc failed");
+        exit(1);
+    }
+
+    free(tree->hash);
+    tree->hash = hash;
+    tree->hash_capacity = capacity;
+    tree->hash_count = 0;
+    for (Node *x = rbt_min(tree); x; x = rbt_next(x)) {
+        hash_place(tree, x);
+    }
+}
+
+
+/**
+ * \ingroup hash_index
+ * @brief Indexes a newly linked node.
+ *
+ * The table doubles before it would become more than half full.
+ *
+ * @param tree A pointer to the tree, which has a hash index.
+ * @param z    A pointer to the node, linked into the tree.
+ */
+static void hash_add(Tree *tree, Node *z) {
+    if (2 * (tree->hash_count + 1) > tree->hash_capacity) {
+        hash_resize(tree, 2 * tree->hash_capacity);
+    }
+    hash_place(tree, z);
+}
+
+
+/**
+ * \ingroup hash_index
+ * @brief Erases the entries of every value in a detached subtree.
+ *
+ * Every occurrence of those values was detached along with them, so their
+ * entries are erased outright.
+ *
+ * @param tree A pointer to the tree, which has a hash index.
+ * @param x    A pointer to the root of the detached subtree, which may be NULL.
+ */
+static void hash_remove_subtree(Tree *tree, Node *x) {
+    if (!x) {
+        return;
+    }
+
+    size_t i = hash_locate(tree, x->data);
+    if (i != SIZE_MAX) {
+        hash_erase(tree, i);
+    }
+    hash_remove_subtree(tree, x->left);
+    hash_remove_subtree(tree, x->right);
+}
+
+
+
+
+
+/**
+ * \defgroup rbt_helpers Red-Black Tree Helper Functions
+ *
+ * This section describes the helper functions used for maintaining the
+ * Red-Black tree properties. These functions are essential for internal
+ * operations such as rotations, insertions, deletions, and color adjustments
+ * which ensure the tree remains balanced and conforms to red-black tree rules.
+ * Key operations include:
+ *
+ * - `grandparent()`: Returns the grandparent of a given node.
+ * - `uncle()`: Returns the uncle of a given node.
+ * - `recolor()`: Handles the recolor case, fixing a double red violation.
+ * - `left_rotate()`: Rotates around a node @p x once to the left.
+ * - `right_rotate()`: Rotates around a node @p x once to the right.
+ * - `restructure()`: Restructures the tree with respect to a node @p z,
+ *                    fixing a double red violation.
+ * - `fixup()`: Recursively fixes up the Red-Black tree after insertion.
+ * - `reroot()`: Updates the root of the tree after a fixup.
+ * - `transplant()`: Replaces one subtree with another.
+ * - `erase_fixup()`: Iteratively fixes up the Red-Black tree after deletion.
+ * - `erase()`: Removes a node from the tree without freeing it.
+ * - `age_link()`, `age_unlink()`: Maintain the insertion order list of
+ *   `RBT_EXPIRY` builds.
+ * - `track_insert()`: Updates the cached minimum and maximum after an insertion.
+ * - `unlink_node()`: Unlinks a node, keeping the cached extremes and size up to date.
+ */
+
+/**
+ * \ingroup rbt_helpers
+ * @brief Returns the grandparent of a given node in a Red-Black tree.
+ *
+ * This helper function makes the code easier to read.
+ *
+ * @param z A pointer to the grandchild of the node we want.
+ * @return  A pointer to the grandparent node if it exists; NULL otherwise.
+ *
+ * @note This function assumes that the provided node @p z and its parent are
+ *       non-NULL. It is the caller's responsibility to ensure this condition is met
+ *       before calling the function. Failing to do so may result in undefined behavior.
+ */
+static Node *grandparent(Node *z) {
+    return z->parent->parent;
+}
+
+
+/**
+ * \ingroup rbt_helpers
+ * @brief Returns the uncle of a given node in a Red-Black tree.
+ *
+ * The function returns the uncle of a node, which is defined as the sibling of
+ * the node's parent.
+ *
+ * @param z A pointer to the node whose uncle is desired.
+ * @return  A pointer to the uncle node if it exists; NULL otherwise. This is
+ *          because if the grandparent does not exist, it implies that the uncle
+ *          cannot exist.
+ */
+static Node *uncle(Node *z)
+{
+    Node *gp = grandparent(z);
+
+    if (!gp) {
+        return NULL;
+    }
+
+    if (gp->left == z->parent) {
+        return gp->right;
+    } else {
+        return gp->left;
+    }
+}
+
+
+/**
+ * \ingroup rbt_helpers
+ * @brief Recolors the parent, uncle, and grandparent of a given node in a Red-Black tree.
+ *
+ * This function changes the color of the parent and uncle of the node @p z to BLACK,
+ * and the color of the grandparent to RED.
+ *
+ * @param z A pointer to the node we are recoloring with respect to.
+ * @return  A pointer to the grandparent of the node @p z after recoloring.
+ *
+ * @note This function assumes that the node @p z, its parent, and its grandparent are
+ *       non-NULL, and that it has an uncle. These conditions are met by definition
+ *       since by property 3, nil nodes are treated as BLACK.
+ */
+static Node *recolor(Node *z) {
+    z->parent->color = BLACK;
+    uncle(z)->color = BLACK;
+    grandparent(z)->color = RED;
+
+    return grandparent(z);
+}
+
+
+/**
+ * \ingroup rbt_helpers
+ * @brief Performs a left rotation on the given node within a Red-Black tree.
+ *
+ * This function applies a left rotation to the node pointed to by @p x,
+ * adjusting the tree's structure to maintain Red-Black properties. Below is an
+ * ASCII art diagram illustrating the left rotation:
+ *
+ * @verbatim
+ *    p              p
+ *    |              |
+ *    x              y
+ *   / \            / \
+ *  _   y    =>    x   z
+ *     / \        / \
+ *    T   z      _   T
+ * @endverbatim
+ *
+ * Here, we label the left child of @p x as @p _ because it is irrelevant to the
+ * rotation. Additionally, @p x's parent @p p is directly above @p x since we
+ * need to check if @p x is a left or right child of @p p.
+ *
+ * @param x Pointer to the node to rotate. This node becomes the left child of
+ *          its right child after rotation.
+ * @return  The new root of the subtree after the rotation, which was the right
+ *          child of @p x before the rotation.
+ *
+ * @note This function assumes @p x's right child is non-NULL and it's the caller's
+ *       responsibility to ensure this. These conditions are met by definition of
+ *       how we call the function. We call the function with respect to @p z, so
+ *       @p y is defined.
+ */
+static Node *left_rotate(Node *x) {
+    Node *y = x->right;
+
+    x->right = y->left;
+    if (y->left) {
+        y->left->parent = x;
+    }
+
+    y->parent = x->parent;
+    if (x->parent) {
+        if (x->parent->left == x) {
+            x->parent->left = y;
+        } else if (x->parent->right == x) {
+            x->parent->right = y;
+        }
+    }
+
+    y->left = x;
+    x->parent = y;
+
+    node_update(x);
+    node_update(y);
+    return y;
 }
 
 
@@ -402,6 +1142,8 @@ static Node *right_rotate(Node *x) {
     y->right = x;
     x->parent = y;
 
+    node_update(x);
+    node_update(y);
     return y;
 }
 
@@ -542,16 +1284,19 @@ static Node *restructure(Node *z) {
  *
  * @param z A pointer to the newly inserted node or a node that may cause a
  *          double red violation.
- * @return  A pointer to the root of the (valid Red-Black) tree after the
- *          adjustments.
+ * @return  A pointer to the node at which the fixup stopped; i.e. the highest
+ *          node that was recolored or restructured.
  *
  * @note The function recursively addresses two main cases:
  *       1. If @p z's parent is NULL, @p z is the root and is colored BLACK.
  *       2. If both @p z and its parent are RED, then it checks the color of @p z's uncle.
  *          - If the uncle is RED, we recolor.
  *          - If the uncle is BLACK or NULL, we restructure with respect to @p z.
- *       After (recursively) addressing these cases, the function ascends the tree to its
- *       root to return it.
+ *
+ * @note The function deliberately does not ascend to the root: the amortized
+ *       cost of a fixup is O(1), and walking to the root would make every
+ *       insertion O(log n) even when the insertion point is already known. Use
+ *       `reroot()` to find the (possibly new) root afterwards.
  */
 static Node *fixup(Node *z) {
     if (!z->parent) {
@@ -570,276 +1315,3515 @@ static Node *fixup(Node *z) {
         }
     }
 
-    while (z->parent) {
-        z = z->parent;
-    }
-
     return z;
 }
 
 
-
-
-
 /**
- * \defgroup formatter Tree Formatter
+ * \ingroup rbt_helpers
+ * @brief Updates the root of the tree after a fixup.
  *
- * This section covers all the helper functions for formatting so
- * we can pretty-print the tree.
- * Key operations include:
+ * A rotation around the root moves the old root one level down, so the new
+ * root is found by ascending from the old one. Since a fixup performs at most
+ * two rotations, this takes O(1) steps.
  *
- * - `height()`: Returns the height of the tree.
- * - `col()`: Returns the column position for a given height.
+ * @param tree A pointer to the tree whose root may have changed.
  */
+static void reroot(Tree *tree) {
+    while (tree->root->parent) {
+        tree->root = tree->root->parent;
+    }
+}
+
 
 /**
- * \ingroup formatter
- * @brief Calculates the height of the tree.
+ * \ingroup rbt_helpers
+ * @brief Replaces the subtree rooted at @p u with the subtree rooted at @p v.
  *
- * This function computes the height of the tree recursively.
+ * Only @p u's parent (or the root of the tree) and @p v's parent pointer are
+ * updated; @p u's own children are left untouched.
  *
- * @param root A pointer to the root node of the tree.
- * @return     The height of the tree.
+ * @param tree A pointer to the tree containing @p u.
+ * @param u    A pointer to the node being replaced.
+ * @param v    A pointer to the replacement, which may be NULL.
  */
-static int height(Node *root) {
-    if (!root) {
-        return 0;
+static void transplant(Tree *tree, Node *u, Node *v) {
+    if (!u->parent) {
+        tree->root = v;
+    } else if (u->parent->left == u) {
+        u->parent->left = v;
+    } else {
+        u->parent->right = v;
     }
 
-    int left_height = height(root->left);
-    int right_height = height(root->right);
-    return (right_height < left_height ? left_height : right_height) + 1;
+    if (v) {
+        v->parent = u->parent;
+    }
 }
 
 
 /**
- * \ingroup formatter
- * @brief Calculates the column position for a given height.
+ * \ingroup rbt_helpers
+ * @brief Fixes up the Red-Black tree after deletion to maintain its properties.
  *
- * This function determines the column position based on the height of the tree,
- * which is used for pretty printing purposes.
+ * Removing a BLACK node leaves every path through @p x one BLACK node short;
+ * we think of @p x as carrying an "extra" black. The loop pushes the extra
+ * black up the tree until it can be absorbed, considering @p x's sibling @p w:
  *
- * @param h The height of the tree.
- * @return  The calculated column position.
+ * 1. @p w is RED: rotate around @p parent so that @p x gets a BLACK sibling.
+ * 2. @p w is BLACK with two BLACK children: recolor @p w RED and move the
+ *    extra black up to @p parent.
+ * 3. @p w is BLACK and its far child is BLACK: rotate around @p w so that its
+ *    far child becomes RED (reducing to case 4).
+ * 4. @p w is BLACK and its far child is RED: rotate around @p parent and
+ *    recolor; the extra black is absorbed and we are done.
+ *
+ * @param tree   A pointer to the tree.
+ * @param x      A pointer to the node carrying the extra black, which may be
+ *               NULL since NULL nodes are BLACK.
+ * @param parent A pointer to @p x's parent. It is passed explicitly because
+ *               @p x may be NULL.
  */
-int col(int h) {
-    if (h == 1)
+static void erase_fixup(Tree *tree, Node *x, Node *parent) {
+    while (x != tree->root && (!x || x->color == BLACK)) {
+        if (parent->left == x) {
+            Node *w = parent->right;
+            if (w->color == RED) {
+                w->color = BLACK;
+                parent->color = RED;
+                left_rotate(parent);
+                w = parent->right;
+            }
+
+            if ((!w->left || w->left->color == BLACK) && (!w->right || w->right->color == BLACK)) {
+                w->color = RED;
+                x = parent;
+                parent = x->parent;
+            } else {
+                if (!w->right || w->right->color == BLACK) {
+                    w->left->color = BLACK;
+                    w->color = RED;
+                    right_rotate(w);
+                    w = parent->right;
+                }
+
+                w->color = parent->color;
+                parent->color = BLACK;
+                w->right->color = BLACK;
+                left_rotate(parent);
+                break;
+            }
+        } else {
+            Node *w = parent->left;
+            if (w->color == RED) {
+                w->color = BLACK;
+                parent->color = RED;
+                right_rotate(parent);
+                w = parent->left;
+            }
+
+            if ((!w->left || w->left->color == BLACK) && (!w->right || w->right->color == BLACK)) {
+                w->color = RED;
+                x = parent;
+                parent = x->parent;
+            } else {
+                if (!w->left || w->left->color == BLACK) {
+                    w->right->color = BLACK;
+                    w->color = RED;
+                    left_rotate(w);
+                    w = parent->left;
+                }
+
+                w->color = parent->color;
+                parent->color = BLACK;
+                w->left->color = BLACK;
+                right_rotate(parent);
+                break;
+            }
+        }
+
+        /* a rotation around the root moves the root down a level */
+        reroot(tree);
+    }
+
+    reroot(tree);
+    if (x) {
+        x->color = BLACK;
+    }
+    tree->root->color = BLACK;
+}
+
+
+/**
+ * \ingroup rbt_helpers
+ * @brief Removes a node from the Red-Black tree without freeing it.
+ *
+ * If @p z has at most one child, it is replaced by that child. Otherwise it is
+ * replaced by its in-order successor @p y, which is first spliced out of its
+ * own position. Nodes are relinked rather than having their data swapped, so
+ * pointers to the remaining nodes stay valid. If the node that was physically
+ * removed from its position was BLACK, `erase_fixup()` restores the Red-Black
+ * properties.
+ *
+ * @param tree A pointer to the tree containing @p z.
+ * @param z    A pointer to the node to remove.
+ */
+static void erase(Tree *tree, Node *z) {
+    Node *y = z;
+    Node *x = NULL;
+    Node *x_parent = NULL;
+    Color removed = z->color;
+
+    if (!z->left) {
+        x = z->right;
+        x_parent = z->parent;
+        transplant(tree, z, z->right);
+    } else if (!z->right) {
+        x = z->left;
+        x_parent = z->parent;
+        transplant(tree, z, z->left);
+    } else {
+        y = z->right;
+        while (y->left) {
+            y = y->left;
+        }
+        removed = y->color;
+        x = y->right;
+
+        if (y->parent == z) {
+            x_parent = y;
+        } else {
+            x_parent = y->parent;
+            transplant(tree, y, y->right);
+            y->right = z->right;
+            y->right->parent = y;
+        }
+
+        transplant(tree, z, y);
+        y->left = z->left;
+        y->left->parent = y;
+        y->color = z->color;
+    }
+
+    z->left = NULL;
+    z->right = NULL;
+    z->parent = NULL;
+    propagate(x_parent);
+
+    if (removed == BLACK && tree->root) {
+        erase_fixup(tree, x, x_parent);
+    }
+}
+
+
+#ifdef RBT_EXPIRY
+/**
+ * \ingroup rbt_helpers
+ * @brief Appends a node to the insertion order list as the newest entry.
+ *
+ * @param tree A pointer to the tree.
+ * @param z    A pointer to the node, not yet in the list.
+ */
+static void age_link(Tree *tree, Node *z) {
+    z->older = tree->newest;
+    z->newer = NULL;
+    if (tree->newest) {
+        tree->newest->newer = z;
+    } else {
+        tree->oldest = z;
+    }
+    tree->newest = z;
+}
+
+
+/**
+ * \ingroup rbt_helpers
+ * @brief Removes a node from the insertion order list.
+ *
+ * If the expiry clock hand points at the node, it moves on to the next newer
+ * one.
+ *
+ * @param tree A pointer to the tree.
+ * @param z    A pointer to the node, which is in the list.
+ */
+static void age_unlink(Tree *tree, Node *z) {
+    if (z->older) {
+        z->older->newer = z->newer;
+    } else {
+        tree->oldest = z->newer;
+    }
+    if (z->newer) {
+        z->newer->older = z->older;
+    } else {
+        tree->newest = z->older;
+    }
+    if (tree->hand == z) {
+        tree->hand = z->newer;
+    }
+    if (z->expires) {
+        tree->expiring--;
+    }
+    z->older = NULL;
+    z->newer = NULL;
+}
+
+
+/**
+ * \ingroup rbt_helpers
+ * @brief Removes every node of a detached subtree from the insertion order list.
+ *
+ * @param tree A pointer to the tree the subtree was detached from.
+ * @param root A pointer to the root of the subtree, which may be NULL.
+ */
+static void age_unlink_subtree(Tree *tree, Node *root) {
+    if (!root) {
+        return;
+    }
+
+    age_unlink_subtree(tree, root->left);
+    age_unlink_subtree(tree, root->right);
+    age_unlink(tree, root);
+}
+#endif
+
+
+/**
+ * \ingroup rbt_helpers
+ * @brief Updates the cached minimum and maximum after inserting a node.
+ *
+ * A new leaf can only become the minimum by being linked as the left child of
+ * the current minimum (the only empty slot before it in sorted order), and
+ * symmetrically for the maximum, so this is an O(1) check. It must be called
+ * before the fixup, since rotations may move @p z.
+ *
+ * In a threaded build, the leaf is also spliced into the successor list: a
+ * left child immediately precedes its parent, and a right child immediately
+ * follows it. Rotations preserve the in-order sequence, so the links never
+ * need to be touched by `left_rotate()` or `right_rotate()`.
+ *
+ * In augmented builds, the summaries of the leaf and its ancestors are
+ * refreshed with `propagate()`. In `RBT_EXPIRY` builds, the leaf becomes the
+ * newest entry. If the tree has a hash index, the leaf is indexed.
+ *
+ * @param tree A pointer to the tree.
+ * @param z    A pointer to the newly linked leaf.
+ */
+static void track_insert(Tree *tree, Node *z) {
+    propagate(z);
+    if (tree->hash) {
+        hash_add(tree, z);
+    }
+#ifdef RBT_EXPIRY
+    age_link(tree, z);
+#endif
+
+    if (!tree->min || tree->min->left == z) {
+        tree->min = z;
+    }
+    if (!tree->max || tree->max->right == z) {
+        tree->max = z;
+    }
+
+#ifdef RBT_THREADED
+    if (!z->parent) {
+        return;
+    }
+
+    if (z->parent->left == z) {
+        z->next = z->parent;
+        z->prev = z->parent->prev;
+    } else {
+        z->prev = z->parent;
+        z->next = z->parent->next;
+    }
+    if (z->next) {
+        z->next->prev = z;
+    }
+    if (z->prev) {
+        z->prev->next = z;
+    }
+#endif
+}
+
+
+/**
+ * \ingroup rbt_helpers
+ * @brief Unlinks a node from the tree, keeping the cached extremes, successor
+ *        links and size.
+ *
+ * Rotations never change which node is leftmost or rightmost, so only
+ * insertion and deletion have to maintain `Tree::min` and `Tree::max`. The
+ * successor of the minimum is found in O(1): the minimum has no left child, so
+ * its right subtree is at most a single RED node.
+ *
+ * @param tree A pointer to the tree containing @p z.
+ * @param z    A pointer to the node to unlink. The caller frees it.
+ */
+static void unlink_node(Tree *tree, Node *z) {
+    if (tree->hash) {
+        hash_remove(tree, z);
+    }
+
+    if (tree->min == z) {
+        tree->min = rbt_next(z);
+    }
+    if (tree->max == z) {
+        tree->max = rbt_prev(z);
+    }
+
+#ifdef RBT_THREADED
+    if (z->next) {
+        z->next->prev = z->prev;
+    }
+    if (z->prev) {
+        z->prev->next = z->next;
+    }
+    z->next = NULL;
+    z->prev = NULL;
+#endif
+#ifdef RBT_EXPIRY
+    age_unlink(tree, z);
+#endif
+
+    erase(tree, z);
+    tree->size--;
+
+    /* a compaction pass in progress restarts, skipping what it already moved */
+    if (tree->compact_cursor == z) {
+        tree->compact_cursor = tree->root;
+    }
+}
+
+
+
+
+
+/**
+ * \defgroup split_join Split and Join
+ *
+ * This section covers the bulk operations on Red-Black trees. Joining two
+ * trees around a middle node walks down the spine of the taller tree to the
+ * black height of the shorter one and links them there, costing O(difference
+ * in black heights). Splitting a tree by key joins the pieces hanging off the
+ * search path; the costs telescope, so a split is O(log n) in total. Key
+ * operations include:
+ *
+ * - `black_height()`: Returns the black height of a tree.
+ * - `join()`: Joins two trees and a middle node into one tree.
+ * - `split()`: Splits a tree into the nodes before and after a key.
+ * - `join2()`: Joins two trees without a middle node.
+ * - `key_buffer_append()`: Collects visited values into a growable array.
+ * - `subtree_size()`: Counts the nodes in a subtree.
+ */
+
+/**
+ * \ingroup split_join
+ * @brief Returns the black height of a tree.
+ *
+ * By property 5, every path has the same number of BLACK nodes, so it is
+ * enough to count along the left spine.
+ *
+ * @param root A pointer to the root of the tree.
+ * @return     The number of BLACK nodes on a path from @p root to a NULL node.
+ */
+static int black_height(Node *root) {
+    int h = 0;
+    for (; root; root = root->left) {
+        h += root->color == BLACK;
+    }
+    return h;
+}
+
+
+/**
+ * \ingroup split_join
+ * @brief Joins two trees and a middle node into one Red-Black tree.
+ *
+ * Every value in @p l must order before @p k, and every value in @p r after
+ * it. Both roots are first colored BLACK, which keeps them valid Red-Black
+ * trees. If the black heights are equal, @p k simply becomes the new root.
+ * Otherwise, say @p l is taller: we descend the right spine of @p l to the
+ * first BLACK node @p c with the black height of @p r, and replace it with
+ * @p k colored RED, with children @p c and @p r:
+ *
+ * @verbatim
+ *        l                   l
+ *         \                   \
+ *          p                   p
+ *           \        =>         \
+ *            c                   k (RED)
+ *                               / \
+ *                              c   r
+ * @endverbatim
+ *
+ * Black heights are unchanged, so the only possible violation is a double red
+ * between @p k and @p p, which is exactly what `fixup()` repairs after an
+ * insertion.
+ *
+ * @param l A pointer to the root of the left tree, which may be NULL.
+ * @param k A pointer to the detached middle node.
+ * @param r A pointer to the root of the right tree, which may be NULL.
+ * @return  A pointer to the root of the joined tree.
+ */
+static Node *join(Node *l, Node *k, Node *r) {
+    if (l) {
+        l->parent = NULL;
+        l->color = BLACK;
+    }
+    if (r) {
+        r->parent = NULL;
+        r->color = BLACK;
+    }
+
+    int hl = black_height(l);
+    int hr = black_height(r);
+    k->parent = NULL;
+
+    if (hl == hr) {
+        k->left = l;
+        k->right = r;
+        if (l) {
+            l->parent = k;
+        }
+        if (r) {
+            r->parent = k;
+        }
+        k->color = BLACK;
+        node_update(k);
+        return k;
+    }
+
+    Node *root = hl > hr ? l : r;
+    Node *p = NULL;
+    Node *c = root;
+    int h = hl > hr ? hl : hr;
+    int target = hl > hr ? hr : hl;
+
+    while (c && !(c->color == BLACK && h == target)) {
+        h -= c->color == BLACK;
+        p = c;
+        c = hl > hr ? c->right : c->left;
+    }
+
+    if (hl > hr) {
+        k->left = c;
+        k->right = r;
+        p->right = k;
+        if (r) {
+            r->parent = k;
+        }
+    } else {
+        k->left = l;
+        k->right = c;
+        p->left = k;
+        if (l) {
+            l->parent = k;
+        }
+    }
+    if (c) {
+        c->parent = k;
+    }
+    k->parent = p;
+    k->color = RED;
+    propagate(k);
+
+    fixup(k);
+    while (root->parent) {
+        root = root->parent;
+    }
+    return root;
+}
+
+
+/**
+ * \ingroup split_join
+ * @brief Splits a tree into the nodes before and after a key.
+ *
+ * The node at the root of @p x goes to whichever side it belongs to, and the
+ * function recurses into the one child subtree that straddles the key; the
+ * pieces are reassembled with `join()`.
+ *
+ * @param x         A pointer to the root of the tree to split, which may be
+ *                  NULL. Its parent pointer is ignored.
+ * @param key       The value to split at.
+ * @param inclusive Whether nodes equal to @p key go to the left tree.
+ * @param l         A pointer that receives the root of the tree of values
+ *                  less than (or equal to, if @p inclusive) @p key.
+ * @param r         A pointer that receives the root of the remaining values.
+ */
+static void split(Node *x, const int key, bool inclusive, Node **l, Node **r) {
+    if (!x) {
+        *l = NULL;
+        *r = NULL;
+        return;
+    }
+
+    Node *a = NULL;
+    Node *b = NULL;
+    Node *xl = x->left;
+    Node *xr = x->right;
+    if (xl) {
+        xl->parent = NULL;
+    }
+    if (xr) {
+        xr->parent = NULL;
+    }
+
+    if (x->data < key || (inclusive && x->data == key)) {
+        split(xr, key, inclusive, &a, &b);
+        *l = join(xl, x, a);
+        *r = b;
+    } else {
+        split(xl, key, inclusive, &a, &b);
+        *l = a;
+        *r = join(b, x, xr);
+    }
+}
+
+
+/**
+ * \ingroup split_join
+ * @brief Joins two trees without a middle node.
+ *
+ * The maximum of @p l is removed from it with `erase()` and used as the middle
+ * node for `join()`.
+ *
+ * @param l A pointer to the root of the left tree, which may be NULL.
+ * @param r A pointer to the root of the right tree, which may be NULL.
+ * @return  A pointer to the root of the joined tree.
+ */
+static Node *join2(Node *l, Node *r) {
+    if (!l || !r) {
+        return l ? l : r;
+    }
+
+    Tree left;
+    rbt_init_intrusive(&left);
+    left.root = l;
+    l->parent = NULL;
+
+    Node *k = l;
+    while (k->right) {
+        k = k->right;
+    }
+    erase(&left, k);
+
+    return join(left.root, k, r);
+}
+
+
+/**
+ * \ingroup split_join
+ * @brief A growable array of values collected by an iteration.
+ */
+typedef struct {
+    int *keys;
+    size_t count;
+    size_t capacity;
+} KeyBuffer;
+
+
+/**
+ * \ingroup split_join
+ * @brief Appends a visited value to a `KeyBuffer`; an `RbtVisitor`.
+ *
+ * @param data The value being visited.
+ * @param ctx  A pointer to the `KeyBuffer`.
+ */
+static void key_buffer_append(int data, void *ctx) {
+    KeyBuffer *buf = (KeyBuffer *)ctx;
+
+    if (buf->count == buf->capacity) {
+        buf->capacity = buf->capacity ? 2 * buf->capacity : 64;
+        buf->keys = (int *)realloc(buf->keys, buf->capacity * sizeof(int));
+        if (!buf->keys) {
+            perror("key_buffer_append(): realloc failed");
+            exit(1);
+        }
+    }
+
+    buf->keys[buf->count++] = data;
+}
+
+
+/**
+ * \ingroup split_join
+ * @brief Counts the nodes in a subtree.
+ *
+ * @param root A pointer to the root of the subtree.
+ * @return     The number of nodes in the subtree.
+ */
+static size_t subtree_size(Node *root) {
+    if (!root) {
+        return 0;
+    }
+
+    return subtree_size(root->left) + 1 + subtree_size(root->right);
+}
+
+
+
+
+
+/**
+ * \defgroup small Small-Set Representation
+ *
+ * This section covers the inline sorted array used by `RBT_ENGINE_ADAPTIVE`
+ * trees while they hold at most `RBT_SMALL_MAX` values, and the switch to and
+ * from Red-Black nodes. Such a tree is in its small representation exactly
+ * when `Tree::inline_values` is set. Key operations include:
+ *
+ * - `small_rank()`: Counts the values less than a given value.
+ * - `small_insert()`, `small_delete()`, `small_erase_range()`: Update the array.
+ * - `bulk_load()`: Links a balanced tree of sorted values into an empty tree.
+ * - `promote()`: Moves the values from the array into Red-Black nodes.
+ * - `demote()`: Moves the values back into the array once the tree is small.
+ */
+
+/**
+ * \ingroup small
+ * @brief Counts the values in the array that are less than @p data.
+ *
+ * With SSE2, four values are compared per instruction, and the scan stops at
+ * the first vector that is not entirely less than @p data.
+ *
+ * @param tree A pointer to the tree, in its small representation.
+ * @param data The value to rank.
+ * @return     The index at which @p data is, or would be, inserted.
+ */
+static size_t small_rank(const Tree *tree, const int data) {
+#ifdef __SSE2__
+    __m128i key = _mm_set1_epi32(data);
+    size_t rank = 0;
+    for (size_t i = 0; i < tree->size; i += 4) {
+        __m128i v = _mm_loadu_si128((const __m128i *)&tree->small[i]);
+        unsigned bits = _mm_movemask_ps(_mm_castsi128_ps(_mm_cmplt_epi32(v, key)));
+        if (tree->size - i < 4) {
+            bits &= (1u << (tree->size - i)) - 1;
+        }
+        rank += __builtin_popcount(bits);
+        if (bits != 0xf) {
+            break;
+        }
+    }
+    return rank;
+#else
+    size_t rank = 0;
+    while (rank < tree->size && tree->small[rank] < data) {
+        rank++;
+    }
+    return rank;
+#endif
+}
+
+
+/**
+ * \ingroup small
+ * @brief Inserts a value into the array, if there is room.
+ *
+ * @param tree A pointer to the tree, in its small representation.
+ * @param data The value to insert.
+ * @return     true if the value was inserted, false if the array is full.
+ */
+static bool small_insert(Tree *tree, const int data) {
+    if (tree->size == RBT_SMALL_MAX) {
+        return false;
+    }
+
+    size_t i = small_rank(tree, data);
+    memmove(&tree->small[i + 1], &tree->small[i], (tree->size - i) * sizeof(int));
+    tree->small[i] = data;
+    tree->size++;
+    return true;
+}
+
+
+/**
+ * \ingroup small
+ * @brief Deletes one occurrence of a value from the array.
+ *
+ * @param tree A pointer to the tree, in its small representation.
+ * @param data The value to delete.
+ * @return     true if the value was found and deleted, false otherwise.
+ */
+static bool small_delete(Tree *tree, const int data) {
+    size_t i = small_rank(tree, data);
+    if (i == tree->size || tree->small[i] != data) {
+        return false;
+    }
+
+    tree->size--;
+    memmove(&tree->small[i], &tree->small[i + 1], (tree->size - i) * sizeof(int));
+    return true;
+}
+
+
+/**
+ * \ingroup small
+ * @brief Deletes every value in [@p lo, @p hi] from the array.
+ *
+ * @param tree A pointer to the tree, in its small representation.
+ * @param lo   The smallest value to delete.
+ * @param hi   The largest value to delete.
+ * @return     The number of values deleted.
+ */
+static size_t small_erase_range(Tree *tree, const int lo, const int hi) {
+    if (hi < lo) {
+        return 0;
+    }
+
+    size_t first = small_rank(tree, lo);
+    size_t last = first;
+    while (last < tree->size && tree->small[last] <= hi) {
+        last++;
+    }
+
+    memmove(&tree->small[first], &tree->small[last], (tree->size - last) * sizeof(int));
+    tree->size -= last - first;
+    return last - first;
+}
+
+
+/**
+ * \ingroup small
+ * @brief Links a balanced Red-Black tree of sorted values into an empty tree.
+ *
+ * See `rbt_build_sorted()`. Nothing is recorded in the write-ahead log.
+ *
+ * @param tree A pointer to the tree, whose `root` is NULL.
+ * @param keys A pointer to the values, in ascending order.
+ * @param n    The number of values.
+ */
+static void bulk_load(Tree *tree, const int *keys, size_t n) {
+    /* the depth of the deepest level, which is red unless it is complete */
+    int red_depth = 0;
+    for (size_t m = n; m > 1; m /= 2) {
+        red_depth++;
+    }
+    bool complete = ((n + 1) & n) == 0;
+
+    Node *last = NULL;
+    tree->root = build_sorted(keys, n, 0, complete ? -1 : red_depth, NULL, &last);
+    if (tree->root) {
+        tree->root->color = BLACK;
+    }
+    tree->size = n;
+    tree->max = last;
+    for (Node *x = tree->root; x; x = x->left) {
+        tree->min = x;
+    }
+#ifdef RBT_EXPIRY
+    for (Node *x = tree->min; x; x = rbt_next(x)) {
+        age_link(tree, x);
+    }
+#endif
+    if (tree->hash) {
+        size_t capacity = tree->hash_capacity;
+        while (capacity < 2 * n) {
+            capacity *= 2;
+        }
+        hash_resize(tree, capacity);
+    }
+}
+
+
+/**
+ * \ingroup small
+ * @brief Moves the values of a full array into Red-Black nodes.
+ *
+ * @param tree A pointer to the tree, in its small representation.
+ */
+static void promote(Tree *tree) {
+    int keys[RBT_SMALL_SLOTS];
+    memcpy(keys, tree->small, sizeof(keys));
+
+    /* the node fields overlay the array */
+    tree->inline_values = false;
+    tree->root = NULL;
+    tree->min = NULL;
+    tree->max = NULL;
+    tree->compact_cursor = NULL;
+    tree->slabs = NULL;
+    tree->fill = NULL;
+    bulk_load(tree, keys, tree->size);
+}
+
+
+/**
+ * \ingroup small
+ * @brief Moves the values of an `RBT_ENGINE_ADAPTIVE` tree back into the
+ *        array once it has shrunk to half of `RBT_SMALL_MAX`.
+ *
+ * The gap between the two thresholds keeps a tree that hovers around
+ * `RBT_SMALL_MAX` values from switching back and forth on every operation.
+ *
+ * @param tree A pointer to the tree, which may use any engine.
+ */
+static void demote(Tree *tree) {
+    if (tree->engine != RBT_ENGINE_ADAPTIVE || tree->inline_values || tree->size > RBT_SMALL_MAX / 2) {
+        return;
+    }
+
+    int keys[RBT_SMALL_SLOTS] = { 0 };
+    size_t i = 0;
+    for (Node *x = tree->min; x; x = rbt_next(x)) {
+        keys[i++] = x->data;
+    }
+
+    /* slabs still holding detached nodes must not update the array */
+    subtree_destroy(tree->root);
+    slab_orphan(tree);
+    memcpy(tree->small, keys, sizeof(keys));
+    tree->inline_values = true;
+#ifdef RBT_EXPIRY
+    tree->oldest = NULL;
+    tree->newest = NULL;
+    tree->hand = NULL;
+#endif
+    if (tree->hash) {
+        memset(tree->hash, 0, tree->hash_capacity * sizeof(HashSlot));
+        tree->hash_count = 0;
+    }
+}
+
+
+
+
+
+#ifdef RBT_EXPIRY
+/**
+ * \defgroup expiry_helpers Expiry Helper Functions
+ *
+ * This section covers the incremental expiry and eviction of trees compiled
+ * with `RBT_EXPIRY`. Nodes are kept in a list in insertion order, which a
+ * clock hand walks a few entries per insertion, removing those that have
+ * expired; bounded trees also evict a few entries per insertion while they
+ * are over their bounds. Both cost O(1) per operation. Key operations include:
+ *
+ * - `clock_now()`: Reads the clock of a tree.
+ * - `is_expired()`: Checks whether an entry has expired.
+ * - `sweep()`: Advances the clock hand, removing expired entries.
+ * - `evict()`: Evicts one entry according to the policy of the tree.
+ * - `enforce_bounds()`: Runs the expiry and eviction due after an insertion.
+ * - `live_match()`: Finds a live entry among the duplicates of a key.
+ * - `reap_min()`, `reap_max()`: Remove expired entries from either end.
+ */
+
+/**
+ * \ingroup expiry_helpers
+ * @brief Returns the current time on the clock of a tree.
+ *
+ * @param tree A pointer to the tree.
+ * @return     The time from `Tree::clock`, or from a monotonic clock in
+ *             milliseconds if it is NULL.
+ */
+static uint64_t clock_now(const Tree *tree) {
+    if (tree->clock) {
+        return tree->clock();
+    }
+
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+
+/**
+ * \ingroup expiry_helpers
+ * @brief Returns whether a node has expired.
+ *
+ * @param x   A pointer to the node.
+ * @param now The current time on the tree's clock.
+ * @return    true if the node has an expiry time and it has passed.
+ */
+static bool is_expired(const Node *x, uint64_t now) {
+    return x->expires && x->expires <= now;
+}
+
+
+/**
+ * \ingroup expiry_helpers
+ * @brief Advances the clock hand, removing the expired entries it passes.
+ *
+ * The clock is read at most once, and not at all while no entry has an
+ * expiry time.
+ *
+ * @param tree  A pointer to the tree, which is not intrusive.
+ * @param steps The most entries to examine.
+ * @param keep  A node that must not be removed, or NULL.
+ * @return      The number of entries removed.
+ */
+static size_t sweep(Tree *tree, size_t steps, Node *keep) {
+    size_t removed = 0;
+    uint64_t now = 0;
+
+    for (; steps && tree->expiring; steps--) {
+        Node *x = tree->hand ? tree->hand : tree->oldest;
+        tree->hand = x->newer;
+        if (x == keep || !x->expires) {
+            continue;
+        }
+
+        if (!now) {
+            now = clock_now(tree);
+        }
+        if (x->expires <= now) {
+            rbt_delete_node(tree, x);
+            removed++;
+        }
+    }
+
+    tree->expired += removed;
+    return removed;
+}
+
+
+/**
+ * \ingroup expiry_helpers
+ * @brief Evicts one entry of a tree according to `Tree::policy`.
+ *
+ * @param tree A pointer to the tree, which is not intrusive.
+ * @param keep A node that must not be evicted, or NULL.
+ * @return     true if an entry was evicted, false if only @p keep is left.
+ */
+static bool evict(Tree *tree, Node *keep) {
+    Node *victim = NULL;
+
+    if (tree->policy == RBT_EVICT_EXPIRED && tree->expiring) {
+        uint64_t now = clock_now(tree);
+        if (tree->oldest != keep && is_expired(tree->oldest, now)) {
+            victim = tree->oldest;
+        }
+        for (size_t i = 0; i < RBT_EXPIRY_STEPS && !victim; i++) {
+            Node *x = tree->hand ? tree->hand : tree->oldest;
+            tree->hand = x->newer;
+            if (x != keep && is_expired(x, now)) {
+                victim = x;
+            }
+        }
+        if (victim) {
+            rbt_delete_node(tree, victim);
+            tree->expired++;
+            return true;
+        }
+    }
+
+    if (tree->policy == RBT_EVICT_SMALLEST) {
+        victim = tree->min == keep ? rbt_next(keep) : tree->min;
+    } else {
+        victim = tree->oldest == keep ? keep->newer : tree->oldest;
+    }
+    if (!victim) {
+        return false;
+    }
+
+    rbt_delete_node(tree, victim);
+    tree->evicted++;
+    return true;
+}
+
+
+/**
+ * \ingroup expiry_helpers
+ * @brief Runs the expiry and eviction due after inserting a node.
+ *
+ * @param tree A pointer to the tree, backed by the Red-Black engine.
+ * @param z    A pointer to the node just inserted, which is kept, or NULL.
+ */
+static void enforce_bounds(Tree *tree, Node *z) {
+    if (tree->intrusive) {
+        return;
+    }
+
+    sweep(tree, RBT_EXPIRY_STEPS, z);
+    for (int i = 0; i < RBT_EVICT_STEPS && tree->max_entries && tree->size > tree->max_entries; i++) {
+        if (!evict(tree, z)) {
+            break;
+        }
+    }
+}
+
+
+/**
+ * \ingroup expiry_helpers
+ * @brief Returns a live node with the same value as a given node.
+ *
+ * Duplicates are adjacent in sorted order, so if @p x has expired the run of
+ * nodes equal to it is scanned from its start for one that has not.
+ *
+ * @param tree A pointer to the tree.
+ * @param x    A pointer to a node of @p tree, or NULL.
+ * @return     @p x if it is live, another live node with the same value, or
+ *             NULL if there is none.
+ */
+static Node *live_match(Tree *tree, Node *x) {
+    if (!x || !tree->expiring) {
+        return x;
+    }
+
+    uint64_t now = clock_now(tree);
+    if (!is_expired(x, now)) {
+        return x;
+    }
+
+    const int data = x->data;
+    for (x = bst_lower_bound(tree->root, data); x && x->data == data; x = rbt_next(x)) {
+        if (!is_expired(x, now)) {
+            return x;
+        }
+    }
+    return NULL;
+}
+
+
+/**
+ * \ingroup expiry_helpers
+ * @brief Removes the expired entries at the low end of a tree.
+ *
+ * Afterwards `Tree::min` is live, so it can be returned or removed as the
+ * smallest entry.
+ *
+ * @param tree A pointer to the tree, backed by the Red-Black engine.
+ */
+static void reap_min(Tree *tree) {
+    if (!tree->expiring) {
+        return;
+    }
+
+    uint64_t now = clock_now(tree);
+    while (tree->min && is_expired(tree->min, now)) {
+        rbt_delete_node(tree, tree->min);
+        tree->expired++;
+    }
+}
+
+
+/**
+ * \ingroup expiry_helpers
+ * @brief Removes the expired entries at the high end of a tree.
+ *
+ * @param tree A pointer to the tree, backed by the Red-Black engine.
+ */
+static void reap_max(Tree *tree) {
+    if (!tree->expiring) {
+        return;
+    }
+
+    uint64_t now = clock_now(tree);
+    while (tree->max && is_expired(tree->max, now)) {
+        rbt_delete_node(tree, tree->max);
+        tree->expired++;
+    }
+}
+#endif
+
+
+
+
+
+/**
+ * \defgroup formatter Tree Formatter
+ *
+ * This section covers all the helper functions for formatting so
+ * we can pretty-print the tree.
+ * Key operations include:
+ *
+ * - `height()`: Returns the height of the tree.
+ * - `col()`: Returns the column position for a given height.
+ */
+
+/**
+ * \ingroup formatter
+ * @brief Calculates the height of the tree.
+ *
+ * This function computes the height of the tree recursively.
+ *
+ * @param root A pointer to the root node of the tree.
+ * @return     The height of the tree.
+ */
+static int height(Node *root) {
+    if (!root) {
+        return 0;
+    }
+
+    int left_height = height(root->left);
+    int right_height = height(root->right);
+    return (right_height < left_height ? left_height : right_height) + 1;
+}
+
+
+/**
+ * \ingroup formatter
+ * @brief Calculates the column position for a given height.
+ *
+ * This function determines the column position based on the height of the tree,
+ * which is used for pretty printing purposes.
+ *
+ * @param h The height of the tree.
+ * @return  The calculated column position.
+ */
+int col(int h) {
+    if (h == 1)
+        return 1;
+    return col(h - 1) + col(h - 1) + 1;
+}
+
+
+
+
+
+/**
+ * \ingroup formatter
+ * @section printing_section Printing Section
+ *
+ * This section is dedicated to the functions required for printing the tree. These
+ * functions are specifically designed for pretty printing and do not directly relate
+ * to the tree's logical operations.
+ * Key operations include:
+ *
+ * - `print_treee()`: Utility function to pretty print the tree.
+ * - `rbt_print_tree()`: Pretty prints the tree.
+ * - `rbt_inorder()`: Traverses the tree in order.
+ */
+
+/**
+ * @brief Utility function to print the tree structure.
+ *
+ * This function prints the tree structure. It uses matrix representation for
+ * the tree where each node's position is calculated based on its height and
+ * position in the tree.
+ *
+ * @param mat_tree  The matrix representation of the tree's structure.
+ * @param mat_color The matrix representing the color of each node in the tree.
+ * @param root      A pointer to the root node of the tree.
+ * @param c         The column position for the root.
+ * @param r         The row position for the root.
+ * @param h         The height of the tree.
+ */
+static void print_tree(int **mat_tree, char **mat_color, Node *root, int c, int r, int h) {
+    if (!root) {
+        return;
+    }
+
+    mat_tree[r][c] = root->data;
+    mat_color[r][c] = root->color == RED ? 'R' : 'B';
+    print_tree(mat_tree, mat_color, root->left, c - pow(2, h - 2), r + 1, h - 1);
+    print_tree(mat_tree, mat_color, root->right, c + pow(2, h - 2), r + 1, h - 1);
+}
+
+
+/**
+ * \ingroup formatter
+ * @brief Prints the entire Red-Black Tree.
+ *
+ * Prints the tree in a structured manner to visualize its layout, including the color of each node.
+ * This is useful for debugging and verifying the structure of the tree.
+ *
+ * @param root A pointer to the root node of the Red-Black Tree.
+ */
+void rbt_print_tree(Node *root) {
+    int h = height(root);
+    int c = col(h);
+
+    int **mat_tree = (int **)malloc(h * sizeof(int *));
+    char **mat_color = (char **)malloc(h * sizeof(char *));
+
+    for (int i = 0; i < h; i++) {
+        mat_tree[i] = (int *)malloc(c * sizeof(int));
+        mat_color[i] = (char *)malloc(c * sizeof(char));
+    }
+
+    print_tree(mat_tree, mat_color, root, c / 2, 0, h);
+    for (int i = 0; i < h; i++) {
+        for (int j = 0; j < c; j++) {
+            if (mat_tree[i][j] == 0) {
+                printf("     ");
+            } else {
+                printf("%d(%c) ", mat_tree[i][j], mat_color[i][j]);
+            }
+        }
+        printf("\n");
+    }
+}
+
+
+/**
+ * \ingroup formatter
+ * @brief Performs an inorder traversal of the Red-Black Tree.
+ *
+ * Prints the elements of the tree in an in-order fashion. This function can be used
+ * for debugging purposes to visualize the tree structure and contents.
+ *
+ * @param root A pointer to the root node of the Red-Black Tree.
+ */
+void rbt_inorder(Node *root) {
+    if (!root) {
+        return;
+    }
+
+    rbt_inorder(root->left);
+    printf("%d ", root->data);
+    rbt_inorder(root->right);
+}
+
+
+
+
+
+/**
+ * \defgroup rbt Red-Black Tree
+ *
+ * This section documents the public facing API for the red-black tree. It includes
+ * functions for creating the tree, inserting nodes, searching for values, and
+ * other utilities that facilitate interaction with the red-black tree data structure.
+ * Key operations include:
+ *
+ * - `rbt_init()`: Initializes a new tree with a NULL root and size of 0.
+ * - `rbt_destroy()`: Frees the memory allocated for the entire tree.
+ * - `rbt_insert()`: Inserts a new node into the Red-Black tree, fixing up recursively to maintain
+ *                   the balance properties.
+ * - `rbt_search()`: Recursively searches for a node by its value, adhering to BST search semantics.
+ * - `rbt_insert_hint()`: Inserts a new node starting from a nearby node instead of the root.
+ * - `rbt_search_from()`: Searches for a value starting from a nearby node (finger search).
+ * - `rbt_delete()`, `rbt_delete_node()`: Deletes a value or a given node, fixing up to maintain
+ *                   the balance properties.
+ * - `rbt_min()`, `rbt_max()`: Return the cached smallest and largest nodes in O(1).
+ * - `rbt_pop_min()`, `rbt_pop_max()`: Remove the smallest or largest value.
+ * - `rbt_next()`, `rbt_prev()`: Step through the tree in sorted order; O(1) in threaded builds.
+ * - `rbt_init_engine()`: Initializes a tree backed by another engine, e.g. a B+-tree.
+ * - `rbt_contains()`, `rbt_foreach()`, `rbt_range()`: Engine-independent search and iteration.
+ * - `rbt_erase_range()`: Deletes every value in a range with O(log n) restructuring.
+ * - `rbt_detach_range()`, `rbt_free_detached()`: Detach a range and free it later.
+ * - `rbt_build_sorted()`: Builds a balanced tree from sorted values in O(n).
+ * - `rbt_attach_wal()`: Records every change to the tree in a write-ahead log.
+ *
+ * Trees created here are also added to a process-wide registry (see the memory
+ * accounting section) and removed again by `rbt_destroy()`.
+ */
+
+/**
+ * @brief Initializes a new Red-Black tree.
+ *
+ * This function dynamically allocates memory for a new Red-Black tree structure,
+ * sets its root to NULL, and initializes its size to 0. It returns a pointer to
+ * the newly created tree.
+ *
+ * @return A pointer to the newly initialized Red-Black tree if successful,
+ *         error and exits otherwise.
+ *
+ * @note The function checks for successful memory allocation and exits the program
+ *       with an error message if allocation fails. This ensures that the function
+ *       returns a valid pointer to a Red-Black tree.
+ */
+Tree *rbt_init() {
+    return rbt_init_engine(RBT_ENGINE_RB);
+}
+
+
+/**
+ * \ingroup rbt
+ * @brief Initializes a new tree backed by a given engine.
+ *
+ * `rbt_init()` is equivalent to `rbt_init_engine(RBT_ENGINE_RB)`.
+ *
+ * @param engine The data structure backing the tree.
+ * @return A pointer to the newly initialized tree if successful,
+ *         error and exits otherwise.
+ */
+Tree *rbt_init_engine(Engine engine) {
+    Tree *tree = (Tree *)(malloc(sizeof(Tree)));
+    if (!tree) {
+        perror("rbt_init(): malloc failed");
+        exit(1);
+    }
+
+    memset(tree->small, 0, sizeof(tree->small));
+    tree->root = NULL;
+    tree->min = NULL;
+    tree->max = NULL;
+    tree->compact_cursor = NULL;
+    tree->slabs = NULL;
+    tree->fill = NULL;
+    tree->size = 0;
+    tree->engine = engine;
+    tree->inline_values = engine == RBT_ENGINE_ADAPTIVE;
+    tree->intrusive = false;
+    tree->compact_gen = 0;
+    tree->bptree = NULL;
+    if (engine == RBT_ENGINE_BPLUS) {
+        tree->bptree = bpt_init();
+    } else if (engine == RBT_ENGINE_BUCKET) {
+        tree->buckets = bkt_init();
+    }
+    tree->wal = NULL;
+    tree->name = NULL;
+    tree->hash = NULL;
+    tree->hash_capacity = 0;
+    tree->hash_count = 0;
+#ifdef RBT_EXPIRY
+    tree->oldest = NULL;
+    tree->newest = NULL;
+    tree->hand = NULL;
+    tree->max_entries = 0;
+    tree->policy = RBT_EVICT_OLDEST;
+    tree->clock = NULL;
+    tree->evicted = 0;
+    tree->expired = 0;
+    tree->expiring = 0;
+#endif
+
+    pthread_mutex_lock(&registry_lock);
+    tree->reg_prev = NULL;
+    tree->reg_next = registry;
+    if (registry) {
+        registry->reg_prev = tree;
+    }
+    registry = tree;
+    pthread_mutex_unlock(&registry_lock);
+    return tree;
+}
+
+
+/**
+ * \ingroup rbt
+ * @brief Destroys a Red-Black tree and frees its memory.
+ *
+ * This function recursively frees the memory allocated for the nodes of a Red-Black
+ * tree. It ensures that all associated memory is released to prevent memory leaks.
+ *
+ * @param tree A pointer to the Red-Black tree to be destroyed.
+ *
+ * @note This function recursively destroys the entire tree. To destroy a single node,
+ *       use `node_destroy()` instead.
+ */
+void rbt_destroy(Tree *tree) {
+    if (!tree) {
+        return;
+    }
+
+    pthread_mutex_lock(&registry_lock);
+    if (tree->reg_prev) {
+        tree->reg_prev->reg_next = tree->reg_next;
+    } else {
+        registry = tree->reg_next;
+    }
+    if (tree->reg_next) {
+        tree->reg_next->reg_prev = tree->reg_prev;
+    }
+    pthread_mutex_unlock(&registry_lock);
+
+    if (tree->engine == RBT_ENGINE_BPLUS) {
+        bpt_destroy(tree->bptree);
+    } else if (tree->engine == RBT_ENGINE_BUCKET) {
+        bkt_destroy(tree->buckets);
+    } else if (!tree->inline_values) {
+        subtree_destroy(tree->root);
+        slab_orphan(tree);
+    }
+    free(tree->hash);
+    free(tree);
+}
+
+
+/**
+ * \ingroup rbt
+ * @brief Inserts a value into the Red-Black tree.
+ *
+ * function first inserts the new node using standard BST rules,
+ * empirically setting equality to the left subtree. After insertion, we perform
+ * a (potentially) recursive fixup starting at the newly inserted node.
+ *
+ * @note The root node may change as a result of these adjustments. This is
+ *       because we may rotate around the root of the tree. It is important to use
+ *       this new root for future operations on the tree.
+ *
+ * @param tree A pointer to the the tree.
+ * @param data The integer value to be inserted.
+ * @return     A pointer to the root of the tree, or NULL if the tree is not
+ *             backed by the Red-Black engine.
+ */
+Node *rbt_insert(Tree *tree, const int data) {
+    if (tree->wal) {
+        wal_append(tree->wal, WAL_INSERT, data, 0);
+    }
+
+    if (tree->engine == RBT_ENGINE_BPLUS) {
+        bpt_insert(tree->bptree, data);
+        tree->size++;
+        return NULL;
+    }
+    if (tree->engine == RBT_ENGINE_BUCKET) {
+        bkt_insert(tree->buckets, data);
+        tree->size++;
+        return NULL;
+    }
+    if (tree->inline_values) {
+        if (small_insert(tree, data)) {
+            return NULL;
+        }
+        promote(tree);
+    }
+
+    Node *z = NULL;
+    tree->root = bst_insert(tree->root, data, &z);
+    track_insert(tree, z);
+
+    fixup(z);
+    reroot(tree);
+    tree->size++;
+#ifdef RBT_EXPIRY
+    enforce_bounds(tree, z);
+#endif
+    return tree->engine == RBT_ENGINE_RB ? tree->root : NULL;
+}
+
+
+/**
+ * \ingroup rbt
+ * @brief Inserts a value into the Red-Black tree, starting near a hint.
+ *
+ * Instead of descending from the root, this function ascends from @p hint via
+ * `parent` only as far as needed to reach the subtree that covers @p data (see
+ * `finger()`), inserts there, and fixes up as usual. For sorted or nearly-sorted
+ * streams, passing the previously inserted node as the hint makes every
+ * insertion cost O(1) amortized plus rebalancing. Values beyond the current
+ * minimum or maximum are linked directly next to the cached extreme,
+ * regardless of the hint.
+ *
+ * @param tree A pointer to the tree.
+ * @param hint A node of @p tree close to where @p data belongs, or NULL to
+ *             insert from the root.
+ * @param data The integer value to be inserted.
+ * @return     A pointer to the newly inserted node, suitable as the next hint,
+ *             or NULL if the tree is not backed by the Red-Black engine.
+ */
+Node *rbt_insert_hint(Tree *tree, Node *hint, const int data) {
+    if (tree->engine != RBT_ENGINE_RB) {
+        rbt_insert(tree, data);
+        return NULL;
+    }
+
+    if (tree->wal) {
+        wal_append(tree->wal, WAL_INSERT, data, 0);
+    }
+
+    Node *z = NULL;
+    if (tree->max && tree->max->data < data) {
+        z = bst_insert_at(tree->max, data);
+    } else if (tree->min && data <= tree->min->data) {
+        z = bst_insert_at(tree->min, data);
+    } else if (!hint) {
+        tree->root = bst_insert(tree->root, data, &z);
+    } else {
+        z = bst_insert_at(finger(hint, data), data);
+    }
+    track_insert(tree, z);
+
+    fixup(z);
+    reroot(tree);
+    tree->size++;
+#ifdef RBT_EXPIRY
+    enforce_bounds(tree, z);
+#endif
+    return z;
+}
+
+
+/**
+ * \ingroup rbt
+ * @brief Searches for a node with a given value in a Red-Black Tree.
+ *
+ * This function acts as a wrapper for the `bst_search()` function, initiating a search
+ * for a node containing the specified @p data within a Red-Black Tree.
+ *
+ * If the tree has a hash index (see `rbt_set_hash_index()`), the node is
+ * looked up there instead. In `RBT_EXPIRY` builds, expired nodes are skipped:
+ * @p data is reported absent only if every occurrence of it has expired.
+ *
+ * @param tree A pointer to the Red-Black Tree we want to search.
+ * @param data The value to search for.
+ * @return A pointer to the node containing @p data if found, NULL otherwise.
+ */
+Node *rbt_search(Tree *tree, const int data) {
+    if (tree->inline_values) {
+        return NULL;
+    }
+
+    Node *x = tree->hash ? hash_find(tree, data) : bst_search(tree->root, data);
+#ifdef RBT_EXPIRY
+    x = live_match(tree, x);
+#endif
+    return x;
+}
+
+
+/**
+ * \ingroup rbt
+ * @brief Searches for a value, starting from a recently visited node.
+ *
+ * This is the finger search counterpart of `rbt_search()`: the search ascends
+ * from @p start only as far as needed (see `finger()`) before descending.
+ * Without level links the climb can still reach the root even when @p data is
+ * adjacent to the finger (e.g. from the root's predecessor to its successor),
+ * so a lookup costs O(log n) in the worst case; over a sequence of lookups
+ * in sorted order it costs O(1) amortized.
+ *
+ * @param tree  A pointer to the Red-Black Tree we want to search.
+ * @param start A node of @p tree, e.g. the result of the previous lookup, or
+ *              NULL to search from the root.
+ * @param data  The value to search for.
+ * @return A pointer to the node containing @p data if found, NULL otherwise.
+ */
+Node *rbt_search_from(Tree *tree, Node *start, const int data) {
+    if (tree->inline_values) {
+        return NULL;
+    }
+    Node *x = start ? bst_search(finger(start, data), data) : bst_search(tree->root, data);
+#ifdef RBT_EXPIRY
+    x = live_match(tree, x);
+#endif
+    return x;
+}
+
+
+/**
+ * \ingroup rbt
+ * @brief Deletes a node from the Red-Black tree and frees it.
+ *
+ * The node is unlinked from the tree (see `erase()`) and the tree is fixed up
+ * so that it remains a valid Red-Black tree. Pointers to every other node stay
+ * valid.
+ *
+ * @param tree A pointer to the tree.
+ * @param node A pointer to a node of @p tree, e.g. returned by `rbt_search()`.
+ */
+void rbt_delete_node(Tree *tree, Node *node) {
+    if (tree->wal) {
+        wal_append(tree->wal, WAL_DELETE, node->data, 0);
+    }
+
+    unlink_node(tree, node);
+    node_destroy(node);
+}
+
+
+/**
+ * \ingroup rbt
+ * @brief Deletes a value from the Red-Black tree.
+ *
+ * If @p data occurs more than once, only one occurrence is deleted. In
+ * `RBT_EXPIRY` builds, expired occurrences are skipped, as by `rbt_search()`.
+ *
+ * @param tree A pointer to the tree.
+ * @param data The value to delete.
+ * @return     true if a node was deleted, false if @p data was not found.
+ */
+bool rbt_delete(Tree *tree, const int data) {
+    if (tree->engine == RBT_ENGINE_BPLUS) {
+        if (!bpt_delete(tree->bptree, data)) {
+            return false;
+        }
+        if (tree->wal) {
+            wal_append(tree->wal, WAL_DELETE, data, 0);
+        }
+        tree->size--;
+        return true;
+    }
+    if (tree->engine == RBT_ENGINE_BUCKET) {
+        if (!bkt_delete(tree->buckets, data)) {
+            return false;
+        }
+        if (tree->wal) {
+            wal_append(tree->wal, WAL_DELETE, data, 0);
+        }
+        tree->size--;
+        return true;
+    }
+    if (tree->inline_values) {
+        if (!small_delete(tree, data)) {
+            return false;
+        }
+        if (tree->wal) {
+            wal_append(tree->wal, WAL_DELETE, data, 0);
+        }
+        return true;
+    }
+
+    Node *node = tree->hash ? hash_find(tree, data) : bst_search(tree->root, data);
+#ifdef RBT_EXPIRY
+    node = live_match(tree, node);
+#endif
+    if (!node) {
+        return false;
+    }
+
+    rbt_delete_node(tree, node);
+    demote(tree);
+    return true;
+}
+
+
+/**
+ * \ingroup rbt
+ * @brief Returns the node with the smallest value in O(1).
+ *
+ * @param tree A pointer to the tree.
+ * @return     A pointer to the leftmost node, or NULL if the tree is empty.
+ */
+Node *rbt_min(Tree *tree) {
+    return tree->inline_values ? NULL : tree->min;
+}
+
+
+/**
+ * \ingroup rbt
+ * @brief Returns the node with the largest value in O(1).
+ *
+ * @param tree A pointer to the tree.
+ * @return     A pointer to the rightmost node, or NULL if the tree is empty.
+ */
+Node *rbt_max(Tree *tree) {
+    return tree->inline_values ? NULL : tree->max;
+}
+
+
+/**
+ * \ingroup rbt
+ * @brief Removes the smallest value from the tree.
+ *
+ * Together with `rbt_insert()` this lets the tree act as a priority queue;
+ * no search is needed since the minimum is cached. In `RBT_EXPIRY` builds,
+ * expired values at the low end are removed first and counted in
+ * `Tree::expired`, so only a live value is returned.
+ *
+ * @param tree A pointer to the tree.
+ * @param data A pointer that receives the removed value. May be NULL.
+ * @return     true if a value was removed, false if the tree is empty.
+ */
+bool rbt_pop_min(Tree *tree, int *data) {
+    if (tree->inline_values) {
+        if (!tree->size) {
+            return false;
+        }
+        int value = tree->small[0];
+        if (data) {
+            *data = value;
+        }
+        return rbt_delete(tree, value);
+    }
+    if (tree->engine == RBT_ENGINE_BPLUS) {
+        BPNode *leaf = tree->bptree->root;
+        if (!leaf) {
+            return false;
+        }
+        while (!leaf->leaf) {
+            leaf = leaf->u.children[0];
+        }
+        int value = leaf->keys[0];
+        if (data) {
+            *data = value;
+        }
+        return rbt_delete(tree, value);
+    }
+    if (tree->engine == RBT_ENGINE_BUCKET) {
+        if (!tree->size) {
+            return false;
+        }
+        int value = rbt_entry(tree->buckets->index.min, Bucket, node)->keys[0];
+        if (data) {
+            *data = value;
+        }
+        return rbt_delete(tree, value);
+    }
+#ifdef RBT_EXPIRY
+    reap_min(tree);
+#endif
+    if (!tree->min) {
+        return false;
+    }
+
+    if (data) {
+        *data = tree->min->data;
+    }
+    rbt_delete_node(tree, tree->min);
+    demote(tree);
+    return true;
+}
+
+
+/**
+ * \ingroup rbt
+ * @brief Removes the largest value from the tree.
+ *
+ * Like `rbt_pop_min()`, expired values at the high end are removed first in
+ * `RBT_EXPIRY` builds.
+ *
+ * @param tree A pointer to the tree.
+ * @param data A pointer that receives the removed value. May be NULL.
+ * @return     true if a value was removed, false if the tree is empty.
+ */
+bool rbt_pop_max(Tree *tree, int *data) {
+    if (tree->inline_values) {
+        if (!tree->size) {
+            return false;
+        }
+        int value = tree->small[tree->size - 1];
+        if (data) {
+            *data = value;
+        }
+        return rbt_delete(tree, value);
+    }
+    if (tree->engine == RBT_ENGINE_BPLUS) {
+        BPNode *leaf = tree->bptree->root;
+        if (!leaf) {
+            return false;
+        }
+        while (!leaf->leaf) {
+            leaf = leaf->u.children[leaf->count];
+        }
+        int value = leaf->keys[leaf->count - 1];
+        if (data) {
+            *data = value;
+        }
+        return rbt_delete(tree, value);
+    }
+    if (tree->engine == RBT_ENGINE_BUCKET) {
+        if (!tree->size) {
+            return false;
+        }
+        Bucket *last = rbt_entry(tree->buckets->index.max, Bucket, node);
+        int value = last->keys[last->count - 1];
+        if (data) {
+            *data = value;
+        }
+        return rbt_delete(tree, value);
+    }
+#ifdef RBT_EXPIRY
+    reap_max(tree);
+#endif
+    if (!tree->max) {
+        return false;
+    }
+
+    if (data) {
+        *data = tree->max->data;
+    }
+    rbt_delete_node(tree, tree->max);
+    demote(tree);
+    return true;
+}
+
+
+/**
+ * \ingroup rbt
+ * @brief Returns the node that follows a given node in sorted order.
+ *
+ * Starting from `rbt_min()`, repeated calls visit every node in sorted order
+ * without recursion or allocation. When compiled with `RBT_THREADED` each step
+ * is a single pointer load; otherwise the successor is found through the
+ * parent pointers in O(1) amortized (O(log n) worst case) time.
+ *
+ * @param node A pointer to a node of the tree.
+ * @return     A pointer to the in-order successor of @p node, or NULL if
+ *             @p node is the maximum.
+ */
+Node *rbt_next(Node *node) {
+#ifdef RBT_THREADED
+    return node->next;
+#else
+    return bst_successor(node);
+#endif
+}
+
+
+/**
+ * \ingroup rbt
+ * @brief Returns the node that precedes a given node in sorted order.
+ *
+ * @param node A pointer to a node of the tree.
+ * @return     A pointer to the in-order predecessor of @p node, or NULL if
+ *             @p node is the minimum.
+ */
+Node *rbt_prev(Node *node) {
+#ifdef RBT_THREADED
+    return node->prev;
+#else
+    return bst_predecessor(node);
+#endif
+}
+
+
+/**
+ * \ingroup rbt
+ * @brief Returns whether a value is present in the tree.
+ *
+ * Unlike `rbt_search()`, this works with every engine.
+ *
+ * @param tree A pointer to the tree.
+ * @param data The value to search for.
+ * @return     true if @p data is present, false otherwise.
+ */
+bool rbt_contains(Tree *tree, const int data) {
+    if (tree->engine == RBT_ENGINE_BPLUS) {
+        return bpt_contains(tree->bptree, data);
+    }
+    if (tree->engine == RBT_ENGINE_BUCKET) {
+        return bkt_contains(tree->buckets, data);
+    }
+    if (tree->inline_values) {
+        size_t i = small_rank(tree, data);
+        return i < tree->size && tree->small[i] == data;
+    }
+
+    return rbt_search(tree, data) != NULL;
+}
+
+
+/**
+ * \ingroup rbt
+ * @brief Visits every value in the tree in sorted order.
+ *
+ * @param tree  A pointer to the tree.
+ * @param visit The function called for every value.
+ * @param ctx   An opaque pointer passed to @p visit.
+ */
+void rbt_foreach(Tree *tree, RbtVisitor visit, void *ctx) {
+    rbt_range(tree, INT_MIN, INT_MAX, visit, ctx);
+}
+
+
+/**
+ * \ingroup rbt
+ * @brief Visits every value in [@p lo, @p hi] in sorted order.
+ *
+ * The first value is found in O(log n); every following one is an in-order
+ * step, so a range of k values costs O(log n + k).
+ *
+ * @param tree  A pointer to the tree.
+ * @param lo    The smallest value to visit.
+ * @param hi    The largest value to visit.
+ * @param visit The function called for every value.
+ * @param ctx   An opaque pointer passed to @p visit.
+ */
+void rbt_range(Tree *tree, const int lo, const int hi, RbtVisitor visit, void *ctx) {
+    if (tree->engine == RBT_ENGINE_BPLUS) {
+        bpt_range(tree->bptree, lo, hi, visit, ctx);
+        return;
+    }
+    if (tree->engine == RBT_ENGINE_BUCKET) {
+        bkt_range(tree->buckets, lo, hi, visit, ctx);
+        return;
+    }
+    if (tree->inline_values) {
+        for (size_t i = small_rank(tree, lo); i < tree->size && tree->small[i] <= hi; i++) {
+            visit(tree->small[i], ctx);
+        }
+        return;
+    }
+
+#ifdef RBT_EXPIRY
+    uint64_t now = tree->expiring ? clock_now(tree) : 0;
+#endif
+    for (Node *x = bst_lower_bound(tree->root, lo); x && x->data <= hi; x = rbt_next(x)) {
+#ifdef RBT_EXPIRY
+        if (is_expired(x, now)) {
+            continue;
+        }
+#endif
+        visit(x->data, ctx);
+    }
+}
+
+
+/**
+ * \ingroup rbt
+ * @brief Detaches every value in [@p lo, @p hi] from the tree.
+ *
+ * The tree is split at @p lo and @p hi and the outer pieces are joined again,
+ * so the restructuring costs O(log n) regardless of how many values are
+ * removed; counting them costs O(k). The detached nodes form a valid
+ * Red-Black tree of their own, which the caller can free later, e.g. on a
+ * background thread, with `rbt_free_detached()`.
+ *
+ * @param tree  A pointer to the tree, backed by the Red-Black engine.
+ * @param lo    The smallest value to detach.
+ * @param hi    The largest value to detach.
+ * @param count A pointer that receives the number of detached nodes. May be NULL.
+ * @return      A pointer to the root of the detached nodes, or NULL if no value
+ *              lies in the range.
+ */
+Node *rbt_detach_range(Tree *tree, const int lo, const int hi, size_t *count) {
+    Node *first = hi < lo || tree->inline_values ? NULL : bst_lower_bound(tree->root, lo);
+    if (count) {
+        *count = 0;
+    }
+    if (!first || hi < first->data) {
+        return NULL;
+    }
+
+    if (tree->wal) {
+        wal_append(tree->wal, WAL_ERASE_RANGE, lo, hi);
+    }
+
+    Node *before = rbt_prev(first);
+    Node *after = NULL;
+    Node *below, *rest, *middle, *above;
+    split(tree->root, lo, false, &below, &rest);
+    split(rest, hi, true, &middle, &above);
+
+    if (above) {
+        after = above;
+        while (after->left) {
+            after = after->left;
+        }
+    }
+
+    tree->root = join2(below, above);
+    if (tree->root) {
+        tree->root->parent = NULL;
+        tree->root->color = BLACK;
+    }
+    if (tree->compact_cursor && lo <= tree->compact_cursor->data && tree->compact_cursor->data <= hi) {
+        tree->compact_cursor = tree->root;
+    }
+    middle->parent = NULL;
+    middle->color = BLACK;
+
+    if (!before) {
+        tree->min = after;
+    }
+    if (!after) {
+        tree->max = before;
+    }
+#ifdef RBT_THREADED
+    if (before) {
+        before->next = after;
+    }
+    if (after) {
+        after->prev = before;
+    }
+#endif
+
+#ifdef RBT_EXPIRY
+    age_unlink_subtree(tree, middle);
+#endif
+    if (tree->hash) {
+        hash_remove_subtree(tree, middle);
+    }
+
+    size_t removed = subtree_size(middle);
+    tree->size -= removed;
+    if (count) {
+        *count = removed;
+    }
+    return middle;
+}
+
+
+/**
+ * \ingroup rbt
+ * @brief Frees nodes detached by `rbt_detach_range()`.
+ *
+ * This only touches the detached nodes, so it may run on another thread while
+ * the tree they came from is in use.
+ *
+ * @param root A pointer to the root of the detached nodes, which may be NULL.
+ */
+void rbt_free_detached(Node *root) {
+    subtree_destroy(root);
+}
+
+
+/**
+ * \ingroup rbt
+ * @brief Deletes every value in [@p lo, @p hi] from the tree.
+ *
+ * On the Red-Black engine the range is detached in O(log n) with
+ * `rbt_detach_range()` and its nodes are then freed in bulk, so the cost of a
+ * large purge is dominated by freeing memory rather than rebalancing. The
+ * B+-tree and bucketed engines delete the values one at a time.
+ *
+ * @param tree A pointer to the tree.
+ * @param lo   The smallest value to delete.
+ * @param hi   The largest value to delete.
+ * @return     The number of values deleted.
+ */
+size_t rbt_erase_range(Tree *tree, const int lo, const int hi) {
+    size_t count = 0;
+
+    if (tree->inline_values) {
+        count = small_erase_range(tree, lo, hi);
+        if (count && tree->wal) {
+            wal_append(tree->wal, WAL_ERASE_RANGE, lo, hi);
+        }
+        return count;
+    }
+    if (tree->engine == RBT_ENGINE_RB || tree->engine == RBT_ENGINE_ADAPTIVE) {
+        rbt_free_detached(rbt_detach_range(tree, lo, hi, &count));
+        demote(tree);
+        return count;
+    }
+
+    KeyBuffer buf = { NULL, 0, 0 };
+    rbt_range(tree, lo, hi, key_buffer_append, &buf);
+    for (size_t i = 0; i < buf.count; i++) {
+        count += rbt_delete(tree, buf.keys[i]);
+    }
+
+    free(buf.keys);
+    return count;
+}
+
+
+/**
+ * \ingroup rbt
+ * @brief Builds a balanced tree from values in ascending order.
+ *
+ * On an empty tree backed by the Red-Black engine, the nodes are allocated and
+ * linked in a single O(n) pass: every subtree is rooted at the middle of its
+ * range, and nodes on the deepest level are colored RED when that level is
+ * incomplete, so no rotation is ever needed. An empty adaptive tree copies up
+ * to `RBT_SMALL_MAX` values into its array, or is built the same way.
+ * Otherwise the values are inserted one at a time. Either way, a tree bounded
+ * by `rbt_set_bounds()` is left within its bounds.
+ *
+ * @param tree A pointer to the tree.
+ * @param keys A pointer to the values, in ascending order.
+ * @param n    The number of values.
+ */
+void rbt_build_sorted(Tree *tree, const int *keys, size_t n) {
+    if (tree->engine == RBT_ENGINE_BPLUS || tree->engine == RBT_ENGINE_BUCKET || tree->size) {
+        for (size_t i = 0; i < n; i++) {
+            rbt_insert(tree, keys[i]);
+        }
+        return;
+    }
+
+    if (tree->inline_values && n <= RBT_SMALL_MAX) {
+        memcpy(tree->small, keys, n * sizeof(int));
+        tree->size = n;
+    } else {
+        if (tree->inline_values) {
+            promote(tree);
+        }
+        bulk_load(tree, keys, n);
+    }
+
+    if (tree->wal) {
+        for (size_t i = 0; i < n; i++) {
+            wal_append(tree->wal, WAL_INSERT, keys[i], 0);
+        }
+    }
+#ifdef RBT_EXPIRY
+    /* the bulk load can overshoot the bounds by more than one call evicts */
+    while (tree->max_entries && tree->size > tree->max_entries) {
+        enforce_bounds(tree, NULL);
+    }
+#endif
+}
+
+
+/**
+ * \ingroup rbt
+ * @brief Records every subsequent change to the tree in a write-ahead log.
+ *
+ * Insertions, deletions and range erasures are appended to @p wal (see
+ * `wal.h`). Changes made through the intrusive interface are not recorded.
+ * The tree does not own the log: close it with `wal_close()` after the tree
+ * is no longer modified.
+ *
+ * @param tree A pointer to the tree.
+ * @param wal  A pointer to an open log, or NULL to stop recording.
+ */
+void rbt_attach_wal(Tree *tree, Wal *wal) {
+    tree->wal = wal;
+}
+
+
+
+
+
+/**
+ * \defgroup intrusive Intrusive Red-Black Tree
+ *
+ * This section documents the intrusive interface. Instead of the library
+ * allocating a `Node` per value, callers embed a `Node` in their own structures
+ * and link it into the tree directly, much like the Linux kernel's rbtree. The
+ * tree is ordered by a caller-supplied comparator, and the same `fixup()`,
+ * `restructure()`, rotation and `erase()` logic keeps it balanced. The library
+ * never allocates or frees memory on this path. Key operations include:
+ *
+ * - `rbt_init_intrusive()`: Initializes a caller-owned tree.
+ * - `rbt_link()`: Links a caller-owned node into the tree.
+ * - `rbt_find()`: Searches for a node by key using a comparator.
+ * - `rbt_unlink()`: Unlinks a node from the tree without freeing it.
+ *
+ * Use `rbt_entry()` to get from a `Node` back to the structure embedding it,
+ * and `rbt_min()`/`rbt_next()` to iterate.
+ */
+
+/**
+ * \ingroup intrusive
+ * @brief Initializes a caller-owned tree for intrusive use.
+ *
+ * The tree is typically a global, a stack variable, or embedded in another
+ * structure. Since the library owns neither the tree nor its nodes, such a
+ * tree must not be passed to `rbt_destroy()`; unlink the nodes instead.
+ *
+ * @param tree A pointer to the tree to initialize.
+ */
+void rbt_init_intrusive(Tree *tree) {
+    tree->root = NULL;
+    tree->min = NULL;
+    tree->max = NULL;
+    tree->compact_cursor = NULL;
+    tree->slabs = NULL;
+    tree->fill = NULL;
+    tree->size = 0;
+    tree->engine = RBT_ENGINE_RB;
+    tree->inline_values = false;
+    tree->intrusive = true;
+    tree->compact_gen = 0;
+    tree->bptree = NULL;
+    tree->wal = NULL;
+    tree->name = NULL;
+    tree->reg_prev = NULL;
+    tree->reg_next = NULL;
+    tree->hash = NULL;
+    tree->hash_capacity = 0;
+    tree->hash_count = 0;
+#ifdef RBT_EXPIRY
+    tree->oldest = NULL;
+    tree->newest = NULL;
+    tree->hand = NULL;
+    tree->max_entries = 0;
+    tree->policy = RBT_EVICT_OLDEST;
+    tree->clock = NULL;
+    tree->evicted = 0;
+    tree->expired = 0;
+    tree->expiring = 0;
+#endif
+}
+
+
+/**
+ * \ingroup intrusive
+ * @brief Links a caller-owned node into the tree.
+ *
+ * The node is placed using standard BST rules under @p cmp, with equality to
+ * the left subtree, and the tree is then fixed up exactly as in
+ * `rbt_insert()`. Only the link fields of @p node are written; `Node::data`
+ * is left untouched, so callers may use it as a cached key. As in
+ * `rbt_insert()`, the node also becomes the interval [data, data] in
+ * `RBT_INTERVAL` builds, and `Node::value` is set to `Node::data` in
+ * `RBT_AUGMENT` builds; use `rbt_set_value()` afterwards to attach another
+ * value.
+ *
+ * @param tree A pointer to the tree.
+ * @param node A pointer to the node embedded in the caller's structure. It
+ *             must not currently be linked into any tree.
+ * @param cmp  A function returning a negative, zero or positive value if its
+ *             first argument orders before, with or after its second.
+ * @return     @p node.
+ */
+Node *rbt_link(Tree *tree, Node *node, RbtCompare cmp) {
+    Node *parent = NULL;
+    Node **link = &tree->root;
+
+    while (*link) {
+        parent = *link;
+        link = cmp(node, parent) <= 0 ? &parent->left : &parent->right;
+    }
+
+    node->color = RED;
+    node->slab = false;
+    node->left = NULL;
+    node->right = NULL;
+    node->parent = parent;
+#ifdef RBT_THREADED
+    node->next = NULL;
+    node->prev = NULL;
+#endif
+#ifdef RBT_INTERVAL
+    node->high = node->data;
+    node->max_high = node->data;
+#endif
+#ifdef RBT_AUGMENT
+    node->value = node->data;
+    node->agg = RBT_AGG_LIFT(node->data);
+#endif
+#ifdef RBT_EXPIRY
+    node->expires = 0;
+    node->older = NULL;
+    node->newer = NULL;
+#endif
+    *link = node;
+    track_insert(tree, node);
+
+    fixup(node);
+    reroot(tree);
+    tree->size++;
+    return node;
+}
+
+
+/**
+ * \ingroup intrusive
+ * @brief Searches for a node by key.
+ *
+ * @param tree A pointer to the tree.
+ * @param key  A pointer to the key to search for, in whatever form @p cmp
+ *             expects.
+ * @param cmp  A function returning a negative, zero or positive value if
+ *             @p key orders before, with or after the given node. It must be
+ *             consistent with the comparator used by `rbt_link()`.
+ * @return     A pointer to a node matching @p key if found, NULL otherwise.
+ */
+Node *rbt_find(Tree *tree, const void *key, RbtKeyCompare cmp) {
+    Node *x = tree->root;
+
+    while (x) {
+        int c = cmp(key, x);
+        if (!c) {
+            return x;
+        }
+        x = c < 0 ? x->left : x->right;
+    }
+
+    return NULL;
+}
+
+
+/**
+ * \ingroup intrusive
+ * @brief Unlinks a node from the tree without freeing it.
+ *
+ * The tree is fixed up exactly as in `rbt_delete_node()`; afterwards the node
+ * belongs to the caller again and may be freed or linked elsewhere.
+ *
+ * @param tree A pointer to the tree.
+ * @param node A pointer to a node linked into @p tree.
+ */
+void rbt_unlink(Tree *tree, Node *node) {
+    unlink_node(tree, node);
+}
+
+
+
+
+
+/**
+ * \defgroup compact Compaction
+ *
+ * This section documents the incremental compaction of a tree into slabs
+ * (see the slab allocation section). Key operations include:
+ *
+ * - `preorder_next()`: Returns the next node in depth-first preorder.
+ * - `relocate()`: Moves a node into a slab, fixing every pointer to it.
+ * - `rbt_compact()`: Relocates a bounded number of nodes.
+ */
+
+/**
+ * \ingroup compact
+ * @brief Returns the node that follows a node in depth-first preorder.
+ *
+ * @param x A pointer to a (non-NULL) node.
+ * @return  A pointer to the next node in preorder, or NULL if @p x is last.
+ */
+static Node *preorder_next(Node *x) {
+    if (x->left) {
+        return x->left;
+    }
+    if (x->right) {
+        return x->right;
+    }
+
+    while (x->parent) {
+        if (x->parent->left == x && x->parent->right) {
+            return x->parent->right;
+        }
+        x = x->parent;
+    }
+    return NULL;
+}
+
+
+/**
+ * \ingroup compact
+ * @brief Moves a node into the slab being filled and frees its old copy.
+ *
+ * Every pointer to the node is redirected to the copy: its parent's child
+ * pointer (or the root), its children's parent pointers, the cached extremes
+ * and, in threaded and `RBT_EXPIRY` builds, its neighbors' list links.
+ *
+ * @param tree A pointer to the tree.
+ * @param x    A pointer to the node to move.
+ * @return     A pointer to the node's new location.
+ */
+static Node *relocate(Tree *tree, Node *x) {
+    Node *y = slab_alloc(tree);
+    *y = *x;
+    y->slab = true;
+
+    if (!y->parent) {
+        tree->root = y;
+    } else if (y->parent->left == x) {
+        y->parent->left = y;
+    } else {
+        y->parent->right = y;
+    }
+    if (y->left) {
+        y->left->parent = y;
+    }
+    if (y->right) {
+        y->right->parent = y;
+    }
+
+    if (tree->min == x) {
+        tree->min = y;
+    }
+    if (tree->max == x) {
+        tree->max = y;
+    }
+#ifdef RBT_THREADED
+    if (y->next) {
+        y->next->prev = y;
+    }
+    if (y->prev) {
+        y->prev->next = y;
+    }
+#endif
+#ifdef RBT_EXPIRY
+    if (y->older) {
+        y->older->newer = y;
+    } else {
+        tree->oldest = y;
+    }
+    if (y->newer) {
+        y->newer->older = y;
+    } else {
+        tree->newest = y;
+    }
+    if (tree->hand == x) {
+        tree->hand = y;
+    }
+#endif
+    if (tree->hash) {
+        size_t i = hash_locate(tree, y->data);
+        if (tree->hash[i].node == x) {
+            tree->hash[i].node = y;
+        }
+    }
+
+    node_destroy(x);
+    return y;
+}
+
+
+/**
+ * \ingroup compact
+ * @brief Relocates up to @p budget nodes into contiguous slabs.
+ *
+ * After long insert/delete churn, nodes that are adjacent in the tree are
+ * scattered across the heap. A compaction pass copies every node, in
+ * depth-first preorder, into freshly allocated slabs of `RBT_SLAB_BYTES`, so
+ * that a parent and the top of its left subtree share cache lines and pages.
+ * Each call handles at most @p budget nodes and returns, so a pass can be
+ * spread over many calls, e.g. between requests; the tree may be used and
+ * modified freely between calls. Nodes inserted or rotated above the cursor
+ * during a pass may be left in place until the next pass.
+ *
+ * @warning Relocated nodes move: any `Node *` held by the caller, e.g. a hint
+ *          for `rbt_insert_hint()`, is invalid after this call.
+ *
+ * @param tree   A pointer to the tree. Intrusive trees and other engines are
+ *               left untouched.
+ * @param budget The maximum number of nodes to visit in this call.
+ * @return       true if the pass finished, in which case the next call starts
+ *               a new pass; false if more calls are needed.
+ */
+bool rbt_compact(Tree *tree, size_t budget) {
+    if (tree->engine != RBT_ENGINE_RB || tree->intrusive) {
+        return true;
+    }
+
+    if (!tree->compact_cursor) {
+        if (tree->fill) {
+            slab_release(tree->fill);
+            tree->fill = NULL;
+        }
+        tree->compact_gen++;
+        tree->compact_cursor = tree->root;
+    }
+
+    for (; budget && tree->compact_cursor; budget--) {
+        Node *x = tree->compact_cursor;
+        if (!x->slab || slab_of(x)->gen != tree->compact_gen) {
+            x = relocate(tree, x);
+        }
+        tree->compact_cursor = preorder_next(x);
+    }
+
+    if (tree->compact_cursor) {
+        return false;
+    }
+
+    /* nothing more goes into the last slab of the pass */
+    if (tree->fill) {
+        slab_release(tree->fill);
+        tree->fill = NULL;
+    }
+    return true;
+}
+
+
+
+
+
+/**
+ * \defgroup hash Hash Index
+ *
+ * This section documents the optional hash index of a tree (see the
+ * `hash_index` helpers). Key operations include:
+ *
+ * - `rbt_set_hash_index()`: Adds or removes the index.
+ */
+
+/**
+ * \ingroup hash
+ * @brief Adds or removes a hash index for exact-match lookups.
+ *
+ * With the index, `rbt_search()`, `rbt_contains()` and `rbt_delete()` find a
+ * value in one or two cache misses instead of O(log n), while ordered
+ * operations keep using the tree. Every insertion and deletion updates the
+ * index, a table of 16-byte slots kept between a quarter and half full.
+ * Only trees backed by the Red-Black or the adaptive engine, and not set up
+ * with `rbt_init_intrusive()`, can have one.
+ *
+ * @param tree A pointer to the tree.
+ * @param on   true to build the index from the values present, false to free it.
+ */
+void rbt_set_hash_index(Tree *tree, bool on) {
+    free(tree->hash);
+    tree->hash = NULL;
+    tree->hash_capacity = 0;
+    tree->hash_count = 0;
+    if (!on || tree->intrusive || (tree->engine != RBT_ENGINE_RB && tree->engine != RBT_ENGINE_ADAPTIVE)) {
+        return;
+    }
+
+    size_t capacity = 64;
+    while (capacity < 2 * tree->size) {
+        capacity *= 2;
+    }
+    hash_resize(tree, capacity);
+}
+
+
+
+
+
+/**
+ * \defgroup parallel Parallel Traversal
+ *
+ * This section covers whole-tree jobs run on several threads. The tree is cut
+ * into runs of adjacent values at the subtrees of a fixed depth: below its
+ * black height every subtree of that depth exists, so the runs are all
+ * non-empty and of comparable size. Each thread starts with a queue of
+ * adjacent runs, works through it from the front, and steals from the back of
+ * the others' queues once its own is empty, which evens out the runs that
+ * turn out larger. Key operations include:
+ *
+ * - `rbt_parallel_for()`: Visits every value.
+ * - `rbt_parallel_reduce()`: Reduces every value in order.
+ */
+
+/**
+ * \ingroup parallel
+ * @def PARALLEL_MIN
+ * @brief The number of values below which a tree is visited on one thread.
+ */
+#define PARALLEL_MIN 4096
+
+/**
+ * \ingroup parallel
+ * @def PARALLEL_TASKS
+ * @brief The number of runs each thread starts with.
+ */
+#define PARALLEL_TASKS 8
+
+/**
+ * \ingroup parallel
+ * @brief The runs not yet taken from one thread's queue, guarded by `lock`.
+ */
+typedef struct TaskQueue {
+    pthread_mutex_t lock;
+    size_t head;
+    size_t tail;
+} TaskQueue;
+
+/**
+ * \ingroup parallel
+ * @brief A parallel traversal in progress.
+ *
+ * Run t visits the nodes from `starts[t]` up to, but excluding,
+ * `starts[t + 1]`. On the bucketed engine, the nodes are those of the tree of
+ * buckets and every key of a bucket is visited. A reduction folds run t into
+ * the accumulator at `accs + t * size`; otherwise `visit` is called.
+ */
+typedef struct ParallelJob {
+    Node **starts;
+    size_t tasks;
+    bool buckets;
+    TaskQueue *queues;
+    unsigned workers;
+    RbtVisitor visit;
+    RbtFold fold;
+    void *ctx;
+    unsigned char *accs;
+    size_t size;
+#ifdef RBT_EXPIRY
+    uint64_t now;
+#endif
+} ParallelJob;
+
+/**
+ * \ingroup parallel
+ * @brief The argument of a thread of a parallel traversal.
+ */
+typedef struct ParallelWorker {
+    ParallelJob *job;
+    unsigned id;
+} ParallelWorker;
+
+/**
+ * \ingroup parallel
+ * @brief Adapts a fold to `rbt_foreach()` when a reduction runs on one thread.
+ */
+typedef struct SerialFold {
+    RbtFold fold;
+    void *acc;
+    void *ctx;
+} SerialFold;
+
+
+/**
+ * \ingroup parallel
+ * @brief Folds one value into the accumulator of a `SerialFold`.
+ *
+ * @param data The value.
+ * @param ctx  A pointer to the `SerialFold`.
+ */
+static void serial_fold(int data, void *ctx) {
+    SerialFold *s = (SerialFold *)ctx;
+    s->fold(s->acc, data, s->ctx);
+}
+
+
+/**
+ * \ingroup parallel
+ * @brief Records, in order, the first node of every subtree at a given depth.
+ *
+ * @param x      A pointer to the root of the subtree, which may be NULL.
+ * @param depth  The depth of the subtrees below @p x.
+ * @param starts The array receiving the nodes.
+ * @param count  A pointer to the number of nodes recorded so far.
+ */
+static void collect_starts(Node *x, int depth, Node **starts, size_t *count) {
+    if (!x) {
+        return;
+    }
+    if (!depth) {
+        while (x->left) {
+            x = x->left;
+        }
+        starts[(*count)++] = x;
+        return;
+    }
+
+    collect_starts(x->left, depth - 1, starts, count);
+    collect_starts(x->right, depth - 1, starts, count);
+}
+
+
+/**
+ * \ingroup parallel
+ * @brief Visits or folds one value of a run.
+ *
+ * @param job  A pointer to the traversal.
+ * @param acc  A pointer to the run's accumulator, or NULL to call `visit`.
+ * @param data The value.
+ */
+static void parallel_visit(ParallelJob *job, void *acc, int data) {
+    if (acc) {
+        job->fold(acc, data, job->ctx);
+    } else {
+        job->visit(data, job->ctx);
+    }
+}
+
+
+/**
+ * \ingroup parallel
+ * @brief Visits the values of one run in ascending order.
+ *
+ * @param job A pointer to the traversal.
+ * @param t   The index of the run.
+ */
+static void run_task(ParallelJob *job, size_t t) {
+    Node *end = t + 1 < job->tasks ? job->starts[t + 1] : NULL;
+    void *acc = job->fold ? job->accs + t * job->size : NULL;
+
+    for (Node *x = job->starts[t]; x != end; x = rbt_next(x)) {
+        if (job->buckets) {
+            Bucket *bucket = rbt_entry(x, Bucket, node);
+            for (int i = 0; i < bucket->count; i++) {
+                parallel_visit(job, acc, bucket->keys[i]);
+            }
+            continue;
+        }
+#ifdef RBT_EXPIRY
+        if (is_expired(x, job->now)) {
+            continue;
+        }
+#endif
+        parallel_visit(job, acc, x->data);
+    }
+}
+
+
+/**
+ * \ingroup parallel
+ * @brief Runs the runs of a thread's own queue, then steals from the others.
+ *
+ * Runs are only ever taken, never added, so a thread that finds every queue
+ * empty is done.
+ *
+ * @param arg A pointer to the thread's `ParallelWorker`.
+ * @return    NULL.
+ */
+static void *parallel_worker(void *arg) {
+    ParallelWorker *w = (ParallelWorker *)arg;
+    ParallelJob *job = w->job;
+
+    while (true) {
+        size_t t = SIZE_MAX;
+        for (unsigned k = 0; k < job->workers && t == SIZE_MAX; k++) {
+            TaskQueue *q = &job->queues[(w->id + k) % job->workers];
+            pthread_mutex_lock(&q->lock);
+            if (q->head < q->tail) {
+                t = k ? --q->tail : q->head++;
+            }
+            pthread_mutex_unlock(&q->lock);
+        }
+        if (t == SIZE_MAX) {
+            return NULL;
+        }
+        run_task(job, t);
+    }
+}
+
+
+/**
+ * \ingroup parallel
+ * @brief Returns the number of threads a traversal of a tree should use.
+ *
+ * @param tree     A pointer to the tree.
+ * @param nthreads The number of threads asked for, or 0 for one per online CPU.
+ * @return         The number of threads, or 1 if the tree should be visited
+ *                 on the calling thread.
+ */
+static unsigned parallel_workers(const Tree *tree, unsigned nthreads) {
+    if (tree->size < PARALLEL_MIN || tree->engine == RBT_ENGINE_BPLUS || tree->inline_values) {
         return 1;
-    return col(h - 1) + col(h - 1) + 1;
+    }
+    if (!nthreads) {
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        nthreads = cpus > 0 ? (unsigned)cpus : 1;
+    }
+    return nthreads;
+}
+
+
+/**
+ * \ingroup parallel
+ * @brief Cuts a tree into runs and visits them on several threads.
+ *
+ * The depth at which the tree is cut gives about `PARALLEL_TASKS` runs per
+ * thread, but stays below the black height of the tree, so that every subtree
+ * at that depth exists. For a reduction, `accs` is allocated here and every
+ * accumulator is set to the identity at @p identity.
+ *
+ * @param tree     A pointer to the tree.
+ * @param job      A pointer to the traversal, with `visit` or `fold`, `ctx` and
+ *                 `size` set.
+ * @param identity A pointer to the identity of a reduction, or NULL.
+ * @param workers  The number of threads, at least 2.
+ */
+static void parallel_run(Tree *tree, ParallelJob *job, const void *identity, unsigned workers) {
+    job->buckets = tree->engine == RBT_ENGINE_BUCKET;
+    Node *root = job->buckets ? tree->buckets->index.root : tree->root;
+    Node *min = job->buckets ? tree->buckets->index.min : tree->min;
+
+    int black_height = 0;
+    for (Node *x = root; x; x = x->left) {
+        black_height += x->color == BLACK;
+    }
+    int depth = 0;
+    while (depth + 1 < black_height && ((size_t)1 << depth) < (size_t)workers * PARALLEL_TASKS) {
+        depth++;
+    }
+
+    job->starts = (Node **)malloc((((size_t)1 << depth) + 1) * sizeof(Node *));
+    job->queues = (TaskQueue *)malloc(workers * sizeof(TaskQueue));
+    ParallelWorker *w = (ParallelWorker *)malloc(workers * sizeof(ParallelWorker));
+    pthread_t *threads = (pthread_t *)malloc(workers * sizeof(pthread_t));
+    if (!job->starts || !job->queues || !w || !threads) {
+        perror("parallel_run(): malloc failed");
+        exit(1);
+    }
+
+    /* the minimum starts the first run even if the leftmost path ends above the cut */
+    job->tasks = 1;
+    job->starts[0] = min;
+    collect_starts(root, depth, job->starts, &job->tasks);
+    if (job->tasks > 1 && job->starts[1] == min) {
+        memmove(job->starts, job->starts + 1, --job->tasks * sizeof(Node *));
+    }
+
+    job->accs = NULL;
+    if (identity) {
+        job->accs = (unsigned char *)malloc(job->tasks * job->size);
+        if (!job->accs) {
+            perror("parallel_run(): malloc failed");
+            exit(1);
+        }
+        for (size_t t = 0; t < job->tasks; t++) {
+            memcpy(job->accs + t * job->size, identity, job->size);
+        }
+    }
+#ifdef RBT_EXPIRY
+    job->now = tree->expiring ? clock_now(tree) : 0;
+#endif
+
+    job->workers = workers;
+    for (unsigned i = 0; i < workers; i++) {
+        pthread_mutex_init(&job->queues[i].lock, NULL);
+        job->queues[i].head = job->tasks * i / workers;
+        job->queues[i].tail = job->tasks * (i + 1) / workers;
+        w[i].job = job;
+        w[i].id = i;
+    }
+    for (unsigned i = 1; i < workers; i++) {
+        if (pthread_create(&threads[i], NULL, parallel_worker, &w[i])) {
+            perror("parallel_run(): pthread_create failed");
+            exit(1);
+        }
+    }
+    parallel_worker(&w[0]);
+    for (unsigned i = 1; i < workers; i++) {
+        pthread_join(threads[i], NULL);
+    }
+
+    for (unsigned i = 0; i < workers; i++) {
+        pthread_mutex_destroy(&job->queues[i].lock);
+    }
+    free(threads);
+    free(w);
+    free(job->queues);
+    free(job->starts);
+}
+
+
+/**
+ * \ingroup parallel
+ * @brief Visits every value in the tree on several threads.
+ *
+ * The tree is cut into about eight tasks per thread, each a run of adjacent
+ * values, which the threads take from per-thread queues and steal from each
+ * other once their own queue is empty. @p fn is called concurrently and in no
+ * particular order, so it must be thread-safe. The tree must not be modified
+ * until the function returns. Trees backed by the B+-tree engine, and small
+ * trees, are visited on the calling thread alone.
+ *
+ * @param tree     A pointer to the tree.
+ * @param fn       The function called for every value.
+ * @param ctx      An opaque pointer passed to @p fn.
+ * @param nthreads The number of threads, including the calling one, or 0 for
+ *                 one per online CPU.
+ */
+void rbt_parallel_for(Tree *tree, RbtVisitor fn, void *ctx, unsigned nthreads) {
+    unsigned workers = parallel_workers(tree, nthreads);
+    if (workers == 1) {
+        rbt_foreach(tree, fn, ctx);
+        return;
+    }
+
+    ParallelJob job;
+    job.visit = fn;
+    job.fold = NULL;
+    job.ctx = ctx;
+    job.size = 0;
+    parallel_run(tree, &job, NULL, workers);
+}
+
+
+/**
+ * \ingroup parallel
+ * @brief Reduces every value in the tree on several threads, in order.
+ *
+ * Each task folds its run of values, in ascending order, into its own copy of
+ * the identity; the accumulators are then combined from left to right, so
+ * the result equals a sequential fold over `rbt_foreach()` whenever
+ * @p combine is associative with the identity as its neutral element. The
+ * tasks are scheduled as in `rbt_parallel_for()`.
+ *
+ * @param tree     A pointer to the tree.
+ * @param result   A pointer to an accumulator holding the identity, which
+ *                 receives the result.
+ * @param size     The size of an accumulator in bytes.
+ * @param fold     The function adding a value to an accumulator.
+ * @param combine  The function merging two adjacent accumulators.
+ * @param ctx      An opaque pointer passed to @p fold and @p combine.
+ * @param nthreads The number of threads, including the calling one, or 0 for
+ *                 one per online CPU.
+ */
+void rbt_parallel_reduce(Tree *tree, void *result, size_t size, RbtFold fold, RbtCombine combine,
+                         void *ctx, unsigned nthreads) {
+    unsigned workers = parallel_workers(tree, nthreads);
+    if (workers == 1) {
+        SerialFold s = { fold, result, ctx };
+        rbt_foreach(tree, serial_fold, &s);
+        return;
+    }
+
+    ParallelJob job;
+    job.visit = NULL;
+    job.fold = fold;
+    job.ctx = ctx;
+    job.size = size;
+    parallel_run(tree, &job, result, workers);
+
+    memcpy(result, job.accs, size);
+    for (size_t t = 1; t < job.tasks; t++) {
+        combine(result, job.accs + t * size, ctx);
+    }
+    free(job.accs);
+}
+
+
+
+
+
+/**
+ * \defgroup memory Memory Accounting
+ *
+ * This section documents how trees report their memory footprint, and the
+ * process-wide registry of live trees used to find the ones worth compacting
+ * or moving to another engine. Key operations include:
+ *
+ * - `rbt_memory_usage()`: Reports the footprint of a tree.
+ * - `rbt_set_name()`: Labels a tree for `rbt_registry_dump()`.
+ * - `rbt_registry_dump()`: Lists every live tree with its footprint.
+ */
+
+/**
+ * \ingroup memory
+ * @brief Returns the number of bytes the allocator actually reserved for a block.
+ *
+ * @param ptr       A pointer returned by malloc().
+ * @param requested The number of bytes that were requested for @p ptr.
+ * @return          The usable size of @p ptr with glibc, @p requested otherwise.
+ */
+static size_t usable_size(void *ptr, size_t requested) {
+#ifdef __GLIBC__
+    (void)requested;
+    return malloc_usable_size(ptr);
+#else
+    (void)ptr;
+    return requested;
+#endif
 }
 
 
+/**
+ * \ingroup memory
+ * @brief Adds the nodes of a B+-tree subtree to a memory report.
+ *
+ * @param node A pointer to the root of the subtree, which may be NULL.
+ * @param mem  A pointer to the report to update.
+ */
+static void bpnode_usage(BPNode *node, RbtMemory *mem) {
+    if (!node) {
+        return;
+    }
 
+    mem->nodes++;
+    mem->node_bytes += sizeof(BPNode);
+    mem->slack_bytes += usable_size(node, sizeof(BPNode)) - sizeof(BPNode);
+    if (!node->leaf) {
+        for (int i = 0; i <= node->count; i++) {
+            bpnode_usage(node->u.children[i], mem);
+        }
+    }
+}
 
 
 /**
- * \ingroup formatter
- * @section printing_section Printing Section
+ * \ingroup memory
+ * @brief Reports the memory footprint of a tree.
  *
- * This section is dedicated to the functions required for printing the tree. These
- * functions are specifically designed for pretty printing and do not directly relate
- * to the tree's logical operations.
- * Key operations include:
+ * This visits every node to measure allocator slack, so it costs O(n). The
+ * nodes of an intrusive tree belong to the caller and are not counted.
  *
- * - `print_treee()`: Utility function to pretty print the tree.
- * - `rbt_print_tree()`: Pretty prints the tree.
- * - `rbt_inorder()`: Traverses the tree in order.
+ * @param tree A pointer to the tree.
+ * @return     The footprint of @p tree.
+ */
+RbtMemory rbt_memory_usage(Tree *tree) {
+    RbtMemory mem = { 0, 0, 0, 0, 0, 0, 0.0 };
+
+    if (tree->engine == RBT_ENGINE_BPLUS) {
+        bpnode_usage(tree->bptree->root, &mem);
+        mem.other_bytes += sizeof(BPTree);
+    } else if (tree->engine == RBT_ENGINE_BUCKET) {
+        for (Node *x = tree->buckets->index.min; x; x = rbt_next(x)) {
+            mem.nodes++;
+            mem.node_bytes += sizeof(Bucket);
+            mem.slack_bytes += usable_size(rbt_entry(x, Bucket, node), sizeof(Bucket)) - sizeof(Bucket);
+        }
+        mem.other_bytes += sizeof(BucketTree);
+    } else if (!tree->intrusive && !tree->inline_values) {
+        for (Node *x = tree->min; x; x = rbt_next(x)) {
+            mem.nodes++;
+            mem.node_bytes += sizeof(Node);
+            if (!x->slab) {
+                mem.slack_bytes += usable_size(x, sizeof(Node)) - sizeof(Node);
+            }
+        }
+
+        /* slots of relocated nodes that have since been deleted stay reserved */
+        pthread_mutex_lock(&slab_lock);
+        for (Slab *s = tree->slabs; s; s = s->next) {
+            size_t live = atomic_load(&s->live) - (s == tree->fill);
+            mem.free_bytes += (s->capacity - live) * sizeof(Node);
+            mem.other_bytes += RBT_SLAB_BYTES - s->capacity * sizeof(Node);
+        }
+        pthread_mutex_unlock(&slab_lock);
+    }
+
+    if (!tree->intrusive) {
+        mem.other_bytes += sizeof(Tree);
+    }
+    mem.other_bytes += tree->hash_capacity * sizeof(HashSlot);
+    if (tree->wal) {
+        mem.other_bytes += sizeof(Wal) + tree->wal->capacity;
+    }
+
+    mem.total_bytes = mem.node_bytes + mem.slack_bytes + mem.free_bytes + mem.other_bytes;
+    if (tree->size) {
+        mem.overhead_per_value = (double)mem.total_bytes / tree->size - sizeof(int);
+    }
+    return mem;
+}
+
+
+/**
+ * \ingroup memory
+ * @brief Sets the label under which a tree is listed by `rbt_registry_dump()`.
+ *
+ * @param tree A pointer to the tree.
+ * @param name A string that outlives the tree (e.g. a literal), or NULL.
  */
+void rbt_set_name(Tree *tree, const char *name) {
+    tree->name = name;
+}
+
 
 /**
- * @brief Utility function to print the tree structure.
+ * \ingroup memory
+ * @brief Writes one line per live tree with its size and footprint.
  *
- * This function prints the tree structure. It uses matrix representation for
- * the tree where each node's position is calculated based on its height and
- * position in the tree.
+ * Every tree created with `rbt_init()` or `rbt_init_engine()` is listed, most
+ * recently created first, until it is passed to `rbt_destroy()`. The registry
+ * itself may be used from several threads, but as with every other function,
+ * a tree must not be modified while it is being measured.
  *
- * @param mat_tree  The matrix representation of the tree's structure.
- * @param mat_color The matrix representing the color of each node in the tree.
- * @param root      A pointer to the root node of the tree.
- * @param c         The column position for the root.
- * @param r         The row position for the root.
- * @param h         The height of the tree.
+ * @param out The stream to write to, e.g. stderr.
+ * @return    The total footprint of every live tree, in bytes.
  */
-static void print_tree(int **mat_tree, char **mat_color, Node *root, int c, int r, int h) {
-    if (!root) {
-        return;
+size_t rbt_registry_dump(FILE *out) {
+    static const char *engines[] = { "rb", "bplus", "adapt", "bucket" };
+    size_t total = 0;
+
+    pthread_mutex_lock(&registry_lock);
+    fprintf(out, "%-18s %-20s %-6s %12s %14s %12s %10s\n",
+            "tree", "name", "engine", "size", "bytes", "slack", "overhead");
+    for (Tree *tree = registry; tree; tree = tree->reg_next) {
+        RbtMemory mem = rbt_memory_usage(tree);
+        fprintf(out, "%-18p %-20s %-6s %12zu %14zu %12zu %9.1fB\n", (void *)tree,
+                tree->name ? tree->name : "-", engines[tree->engine], tree->size,
+                mem.total_bytes, mem.slack_bytes, mem.overhead_per_value);
+        total += mem.total_bytes;
     }
+    fprintf(out, "total: %zu bytes\n", total);
+    pthread_mutex_unlock(&registry_lock);
+    return total;
+}
 
-    mat_tree[r][c] = root->data;
-    mat_color[r][c] = root->color == RED ? 'R' : 'B';
-    print_tree(mat_tree, mat_color, root->left, c - pow(2, h - 2), r + 1, h - 1);
-    print_tree(mat_tree, mat_color, root->right, c + pow(2, h - 2), r + 1, h - 1);
+
+
+
+
+#ifdef RBT_INTERVAL
+/**
+ * \defgroup interval Interval Tree
+ *
+ * This section documents the interval tree, available when compiled with
+ * `RBT_INTERVAL`. Each node stores an interval [data, high] and the largest
+ * `high` of its subtree (`Node::max_high`), which `node_update()` keeps
+ * correct through rotations, insertion, deletion and split/join. Key
+ * operations include:
+ *
+ * - `rbt_insert_interval()`: Inserts an interval.
+ * - `rbt_delete_interval()`: Deletes an interval.
+ * - `rbt_interval_overlaps()`: Visits every interval overlapping another.
+ * - `rbt_interval_stab()`: Visits every interval containing a point.
+ */
+
+/**
+ * \ingroup interval
+ * @brief Visits the intervals of a subtree that overlap [@p a, @p b].
+ *
+ * @param x     A pointer to the root of the subtree, which may be NULL.
+ * @param a     The start of the query interval.
+ * @param b     The end of the query interval.
+ * @param visit The function called for every overlapping interval, or NULL.
+ * @param ctx   An opaque pointer passed to @p visit.
+ * @return      The number of overlapping intervals in the subtree.
+ */
+static size_t overlaps(Node *x, const int a, const int b, RbtIntervalVisitor visit, void *ctx) {
+    size_t count = 0;
+
+    /* every interval below x ends before a */
+    while (x && x->max_high >= a) {
+        count += overlaps(x->left, a, b, visit, ctx);
+
+        /* x and everything to its right start after b */
+        if (x->data > b) {
+            break;
+        }
+        if (x->high >= a) {
+            if (visit) {
+                visit(x->data, x->high, ctx);
+            }
+            count++;
+        }
+        x = x->right;
+    }
+
+    return count;
 }
 
 
 /**
- * \ingroup formatter
- * @brief Prints the entire Red-Black Tree.
+ * \ingroup interval
+ * @brief Inserts the interval [@p low, @p high].
  *
- * Prints the tree in a structured manner to visualize its layout, including the color of each node.
- * This is useful for debugging and verifying the structure of the tree.
+ * The tree is ordered by @p low. Intervals are not recorded by an attached
+ * write-ahead log, which only stores values.
  *
- * @param root A pointer to the root node of the Red-Black Tree.
+ * @param tree A pointer to the tree, backed by the Red-Black engine.
+ * @param low  The start of the interval.
+ * @param high The end of the interval; swapped with @p low if smaller.
+ * @return     A pointer to the new node, or NULL if the tree is not backed by
+ *             the Red-Black engine.
  */
-void rbt_print_tree(Node *root) {
-    int h = height(root);
-    int c = col(h);
+Node *rbt_insert_interval(Tree *tree, int low, int high) {
+    if (tree->engine != RBT_ENGINE_RB) {
+        return NULL;
+    }
+    if (high < low) {
+        int t = low;
+        low = high;
+        high = t;
+    }
 
-    int **mat_tree = (int **)malloc(h * sizeof(int *));
-    char **mat_color = (char **)malloc(h * sizeof(char *));
+    Node *z = NULL;
+    tree->root = bst_insert(tree->root, low, &z);
+    z->high = high;
+    track_insert(tree, z);
 
-    for (int i = 0; i < h; i++) {
-        mat_tree[i] = (int *)malloc(c * sizeof(int));
-        mat_color[i] = (char *)malloc(c * sizeof(char));
+    fixup(z);
+    reroot(tree);
+    tree->size++;
+#ifdef RBT_EXPIRY
+    enforce_bounds(tree, z);
+#endif
+    return z;
+}
+
+
+/**
+ * \ingroup interval
+ * @brief Deletes one occurrence of the interval [@p low, @p high].
+ *
+ * @param tree A pointer to the tree.
+ * @param low  The start of the interval.
+ * @param high The end of the interval.
+ * @return     true if the interval was found and deleted, false otherwise.
+ */
+bool rbt_delete_interval(Tree *tree, const int low, const int high) {
+    if (tree->inline_values) {
+        return low == high && rbt_delete(tree, low);
     }
 
-    print_tree(mat_tree, mat_color, root, c / 2, 0, h);
-    for (int i = 0; i < h; i++) {
-        for (int j = 0; j < c; j++) {
-            if (mat_tree[i][j] == 0) {
-                printf("     ");
-            } else {
-                printf("%d(%c) ", mat_tree[i][j], mat_color[i][j]);
-            }
+    for (Node *x = bst_lower_bound(tree->root, low); x && x->data == low; x = rbt_next(x)) {
+        if (x->high == high) {
+            rbt_delete_node(tree, x);
+            demote(tree);
+            return true;
         }
-        printf("\n");
     }
+
+    return false;
 }
 
 
 /**
- * \ingroup formatter
- * @brief Performs an inorder traversal of the Red-Black Tree.
+ * \ingroup interval
+ * @brief Visits every interval that overlaps [@p a, @p b], ordered by start.
  *
- * Prints the elements of the tree in an in-order fashion. This function can be used
- * for debugging purposes to visualize the tree structure and contents.
+ * Subtrees whose intervals all end before @p a, or all start after @p b, are
+ * skipped. Each reported interval still costs up to a root-to-leaf walk, so a
+ * query reporting k intervals costs O(min(n, (k + 1) log n)) in the worst
+ * case; it approaches O(log n + k) only when the reported intervals are
+ * clustered together in the tree. While an `RBT_ENGINE_ADAPTIVE` tree keeps
+ * its values inline, each value v is the interval [v, v], as for a value
+ * inserted with `rbt_insert()`.
  *
- * @param root A pointer to the root node of the Red-Black Tree.
+ * @param tree  A pointer to the tree.
+ * @param a     The start of the query interval.
+ * @param b     The end of the query interval.
+ * @param visit The function called for every overlapping interval, or NULL
+ *              to only count them.
+ * @param ctx   An opaque pointer passed to @p visit.
+ * @return      The number of overlapping intervals.
  */
-void rbt_inorder(Node *root) {
-    if (!root) {
-        return;
+size_t rbt_interval_overlaps(Tree *tree, const int a, const int b, RbtIntervalVisitor visit, void *ctx) {
+    if (b < a) {
+        return 0;
+    }
+    if (tree->inline_values) {
+        /* each value v is the interval [v, v], so the overlaps are a run of the array */
+        size_t count = 0;
+        for (size_t i = small_rank(tree, a); i < tree->size && tree->small[i] <= b; i++) {
+            if (visit) {
+                visit(tree->small[i], tree->small[i], ctx);
+            }
+            count++;
+        }
+        return count;
     }
 
-    rbt_inorder(root->left);
-    printf("%d ", root->data);
-    rbt_inorder(root->right);
+    return overlaps(tree->root, a, b, visit, ctx);
+}
+
+
+/**
+ * \ingroup interval
+ * @brief Visits every interval that contains @p point (a stabbing query).
+ *
+ * This is `rbt_interval_overlaps(tree, point, point, visit, ctx)`.
+ *
+ * @param tree  A pointer to the tree.
+ * @param point The point to stab.
+ * @param visit The function called for every interval containing @p point,
+ *              or NULL to only count them.
+ * @param ctx   An opaque pointer passed to @p visit.
+ * @return      The number of intervals containing @p point.
+ */
+size_t rbt_interval_stab(Tree *tree, const int point, RbtIntervalVisitor visit, void *ctx) {
+    return rbt_interval_overlaps(tree, point, point, visit, ctx);
 }
+#endif
 
 
 
 
 
+#ifdef RBT_AUGMENT
 /**
- * \defgroup rbt Red-Black Tree
+ * \defgroup augment Range Aggregates
  *
- * This section documents the public facing API for the red-black tree. It includes
- * functions for creating the tree, inserting nodes, searching for values, and
- * other utilities that facilitate interaction with the red-black tree data structure.
- * Key operations include:
+ * This section documents the aggregate augmentation, available when compiled
+ * with `RBT_AUGMENT`. Each node carries a value and the aggregate of the
+ * values in its subtree (`Node::agg`) under the monoid selected by
+ * `RBT_AUGMENT`, which `node_update()` keeps correct through rotations,
+ * insertion, deletion and split/join. Key operations include:
  *
- * - `rbt_init()`: Initializes a new tree with a NULL root and size of 0.
- * - `rbt_destroy()`: Frees the memory allocated for the entire tree.
- * - `rbt_insert()`: Inserts a new node into the Red-Black tree, fixing up recursively to maintain
- *                   the balance properties.
- * - `rbt_search()`: Recursively searches for a node by its value, adhering to BST search semantics.
+ * - `rbt_insert_value()`: Inserts a key with an attached value.
+ * - `rbt_set_value()`: Replaces the value attached to a node.
+ * - `rbt_range_aggregate()`: Aggregates the values in a key range in O(log n).
  */
 
 /**
- * @brief Initializes a new Red-Black tree.
+ * \ingroup augment
+ * @brief Returns the aggregate of a subtree.
  *
- * This function dynamically allocates memory for a new Red-Black tree structure,
- * sets its root to NULL, and initializes its size to 0. It returns a pointer to
- * the newly created tree.
+ * @param x A pointer to the root of the subtree, which may be NULL.
+ * @return  The aggregate stored in @p x, or `RBT_AGG_IDENTITY` for NULL.
+ */
+static RbtAgg agg_of(Node *x) {
+    return x ? x->agg : (RbtAgg)RBT_AGG_IDENTITY;
+}
+
+
+/**
+ * \ingroup augment
+ * @brief Inserts a key with an attached value.
  *
- * @return A pointer to the newly initialized Red-Black tree if successful,
- *         error and exits otherwise.
+ * Values are not recorded by an attached write-ahead log, which only stores
+ * keys.
  *
- * @note The function checks for successful memory allocation and exits the program
- *       with an error message if allocation fails. This ensures that the function
- *       returns a valid pointer to a Red-Black tree.
+ * @param tree  A pointer to the tree, backed by the Red-Black engine.
+ * @param data  The key to insert.
+ * @param value The value attached to @p data.
+ * @return      A pointer to the new node, or NULL if the tree is not backed by
+ *              the Red-Black engine.
  */
-Tree *rbt_init() {
-    Tree *tree = (Tree *)(malloc(sizeof(Tree)));
-    if (!tree) {
-        perror("rbt_init(): malloc failed");
-        exit(1);
+Node *rbt_insert_value(Tree *tree, const int data, const int value) {
+    if (tree->engine != RBT_ENGINE_RB) {
+        return NULL;
     }
 
-    tree->root = NULL;
-    tree->size = 0;
-    return tree;
+    Node *z = NULL;
+    tree->root = bst_insert(tree->root, data, &z);
+    z->value = value;
+    track_insert(tree, z);
+
+    fixup(z);
+    reroot(tree);
+    tree->size++;
+#ifdef RBT_EXPIRY
+    enforce_bounds(tree, z);
+#endif
+    return z;
 }
 
 
 /**
- * \ingroup rbt
- * @brief Destroys a Red-Black tree and frees its memory.
+ * \ingroup augment
+ * @brief Replaces the value attached to a node.
  *
- * This function recursively frees the memory allocated for the nodes of a Red-Black
- * tree. It ensures that all associated memory is released to prevent memory leaks.
+ * The aggregates of the node's ancestors are updated in O(log n).
  *
- * @param tree A pointer to the Red-Black tree to be destroyed.
+ * @param tree  A pointer to the tree.
+ * @param node  A pointer to a node of @p tree.
+ * @param value The new value.
+ */
+void rbt_set_value(Tree *tree, Node *node, const int value) {
+    (void)tree;
+    node->value = value;
+    propagate(node);
+}
+
+
+/**
+ * \ingroup augment
+ * @brief Aggregates the values of every key in [@p lo, @p hi].
  *
- * @note This function recursively destroys the entire tree. To destroy a single node,
- *       use `node_destroy()` instead.
+ * Only the two boundary paths below the node where they diverge are walked,
+ * using the aggregates stored in the subtrees hanging off them, so this costs
+ * O(log n) regardless of how many keys lie in the range. While an
+ * `RBT_ENGINE_ADAPTIVE` tree keeps its values inline, each value is its own
+ * attached value, as for a key inserted with `rbt_insert()`, and the array is
+ * scanned instead.
+ *
+ * Unlike `rbt_range()`, this does not filter expired entries in `RBT_EXPIRY`
+ * builds: they stay in the stored aggregates until the clock hand removes
+ * them. Call `rbt_expire()` with a budget of `Tree::size` first for an exact
+ * result.
+ *
+ * @param tree A pointer to the tree.
+ * @param lo   The smallest key to include.
+ * @param hi   The largest key to include.
+ * @return     The aggregate of the values in key order, or `RBT_AGG_IDENTITY`
+ *             if the range is empty or the tree is backed by neither the
+ *             Red-Black nor the adaptive engine.
  */
-void rbt_destroy(Tree *tree) {
-    if (!tree || !tree->root) {
-        return;
+RbtAgg rbt_range_aggregate(Tree *tree, const int lo, const int hi) {
+    if (tree->inline_values) {
+        /* each value is attached to itself, as by node_init() */
+        RbtAgg agg = RBT_AGG_IDENTITY;
+        for (size_t i = small_rank(tree, lo); i < tree->size && tree->small[i] <= hi; i++) {
+            agg = RBT_AGG_COMBINE(agg, RBT_AGG_LIFT(tree->small[i]));
+        }
+        return agg;
     }
 
-    if (tree->root->left) {
-        node_destroy(tree->root->left);
-        tree->root->left = NULL;
+    Node *split = tree->root;
+    while (split && (split->data < lo || split->data > hi)) {
+        split = split->data < lo ? split->right : split->left;
     }
-    if (tree->root->right) {
-        node_destroy(tree->root->right);
-        tree->root->right = NULL;
+    if (!split) {
+        return RBT_AGG_IDENTITY;
     }
 
-    free(tree->root);
-    free(tree);
+    /* everything left of the split node is <= hi; keep the part >= lo */
+    RbtAgg left = RBT_AGG_IDENTITY;
+    for (Node *x = split->left; x;) {
+        if (x->data >= lo) {
+            left = RBT_AGG_COMBINE(RBT_AGG_COMBINE(RBT_AGG_LIFT(x->value), agg_of(x->right)), left);
+            x = x->left;
+        } else {
+            x = x->right;
+        }
+    }
+
+    /* everything right of the split node is >= lo; keep the part <= hi */
+    RbtAgg right = RBT_AGG_IDENTITY;
+    for (Node *x = split->right; x;) {
+        if (x->data <= hi) {
+            right = RBT_AGG_COMBINE(right, RBT_AGG_COMBINE(agg_of(x->left), RBT_AGG_LIFT(x->value)));
+            x = x->right;
+        } else {
+            x = x->left;
+        }
+    }
+
+    return RBT_AGG_COMBINE(RBT_AGG_COMBINE(left, RBT_AGG_LIFT(split->value)), right);
 }
+#endif
+
 
 
+
+
+#ifdef RBT_EXPIRY
 /**
- * \ingroup rbt
- * @brief Inserts a value into the Red-Black tree.
+ * \defgroup expiry Bounded Trees and Expiry
  *
- * function first inserts the new node using standard BST rules,
- * empirically setting equality to the left subtree. After insertion, we perform
- * a (potentially) recursive fixup starting at the newly inserted node.
+ * This section documents bounded trees with expiring entries, available when
+ * compiled with `RBT_EXPIRY`. Each node carries an expiry time and links to
+ * its neighbors in insertion order. Expired entries are hidden from lookups
+ * as soon as they expire and removed by a clock hand that every insertion
+ * advances by `RBT_EXPIRY_STEPS` entries; a bounded tree also evicts up to
+ * `RBT_EVICT_STEPS` entries per insertion while it is over its bounds. Key
+ * operations include:
  *
- * @note The root node may change as a result of these adjustments. This is
- *       because we may rotate around the root of the tree. It is important to use
- *       this new root for future operations on the tree.
+ * - `rbt_set_bounds()`: Bounds the number of entries or bytes of a tree.
+ * - `rbt_insert_ttl()`: Inserts a value that expires after a given time.
+ * - `rbt_expire()`: Advances the clock hand, e.g. while the tree is idle.
+ * - `rbt_set_clock()`: Replaces the clock expiry times are measured on.
+ */
+
+/**
+ * \ingroup expiry
+ * @brief Bounds the size of a tree, evicting entries as it is filled.
  *
- * @param tree A pointer to the the tree.
- * @param data The integer value to be inserted.
- * @return     A pointer to the root of the tree.
+ * Every later insertion that leaves the tree over its bounds evicts up to
+ * `RBT_EVICT_STEPS` entries chosen by @p policy, so a tree whose bounds are
+ * lowered shrinks gradually instead of in one sweep. The entry being inserted
+ * is never evicted by its own insertion. Evictions are recorded by an attached
+ * write-ahead log as deletions.
+ *
+ * @param tree        A pointer to the tree, backed by the Red-Black engine and
+ *                    not intrusive.
+ * @param max_entries The most entries to keep, or 0 for no limit on entries.
+ * @param max_bytes   The most bytes of nodes to keep, counted as
+ *                    `sizeof(Node)` per entry, or 0 for no limit on bytes.
+ * @param policy      Which entries to evict first.
+ * @return            true if the bounds were set, false if @p tree cannot be
+ *                    bounded.
  */
-Node *rbt_insert(Tree *tree, const int data) {
+bool rbt_set_bounds(Tree *tree, size_t max_entries, size_t max_bytes, EvictPolicy policy) {
+    if (tree->engine != RBT_ENGINE_RB || tree->intrusive) {
+        return false;
+    }
+
+    if (max_bytes) {
+        size_t by_bytes = max_bytes < sizeof(Node) ? 1 : max_bytes / sizeof(Node);
+        if (!max_entries || by_bytes < max_entries) {
+            max_entries = by_bytes;
+        }
+    }
+
+    tree->max_entries = max_entries;
+    tree->policy = policy;
+    return true;
+}
+
+
+/**
+ * \ingroup expiry
+ * @brief Inserts a value that expires after a given time.
+ *
+ * An expired entry is invisible to `rbt_search()`, `rbt_contains()`,
+ * `rbt_range()`, `rbt_delete()` and `rbt_pop_min()` at once, and is removed
+ * later by the clock hand (see `rbt_expire()`). The exception is
+ * `rbt_range_aggregate()`, which counts it until it is removed. Expiry times
+ * are not recorded by an attached write-ahead log, which only stores values.
+ *
+ * @param tree A pointer to the tree, backed by the Red-Black engine.
+ * @param data The value to insert.
+ * @param ttl  The time to live, in units of the tree's clock (milliseconds by
+ *             default), or 0 for an entry that never expires.
+ * @return     A pointer to the new node, or NULL if the tree is not backed by
+ *             the Red-Black engine.
+ */
+Node *rbt_insert_ttl(Tree *tree, const int data, uint64_t ttl) {
+    if (tree->engine != RBT_ENGINE_RB) {
+        return NULL;
+    }
+    if (tree->wal) {
+        wal_append(tree->wal, WAL_INSERT, data, 0);
+    }
+
     Node *z = NULL;
     tree->root = bst_insert(tree->root, data, &z);
+    if (ttl) {
+        z->expires = clock_now(tree) + ttl;
+        tree->expiring++;
+    }
+    track_insert(tree, z);
 
-    tree->root = fixup(z);
+    fixup(z);
+    reroot(tree);
     tree->size++;
-    return tree->root;
+    enforce_bounds(tree, z);
+    return z;
 }
 
 
 /**
- * \ingroup rbt
- * @brief Searches for a node with a given value in a Red-Black Tree.
+ * \ingroup expiry
+ * @brief Advances the expiry clock hand, removing the expired entries it passes.
  *
- * This function acts as a wrapper for the `bst_search()` function, initiating a search
- * for a node containing the specified @p data within a Red-Black Tree.
+ * Every insertion already advances the hand by `RBT_EXPIRY_STEPS` entries;
+ * this lets an idle tree be cleaned up, e.g. from a timer.
  *
- * @param tree A pointer to the Red-Black Tree we want to search.
- * @param data The value to search for.
- * @return A pointer to the node containing @p data if found, NULL otherwise.
+ * @param tree   A pointer to the tree.
+ * @param budget The most entries to examine.
+ * @return       The number of expired entries removed.
  */
-Node *rbt_search(Tree *tree, const int data) {
-    return bst_search(tree->root, data);
+size_t rbt_expire(Tree *tree, size_t budget) {
+    if (tree->intrusive) {
+        return 0;
+    }
+
+    return sweep(tree, budget, NULL);
+}
+
+
+/**
+ * \ingroup expiry
+ * @brief Replaces the clock expiry times are measured on.
+ *
+ * @param tree  A pointer to the tree.
+ * @param clock The new clock, or NULL for a monotonic clock in milliseconds.
+ *              Entries already inserted keep their expiry times.
+ */
+void rbt_set_clock(Tree *tree, RbtClock clock) {
+    tree->clock = clock;
 }
+#endif
@@ -24,16 +24,47 @@
  *   nodes in the tree.
  * - Node: A structure representing a node within the Red-Black Tree. It
  *   includes the node's data, its color, and pointers to its children and
- *   parent.
+ *   parent. When compiled with `RBT_THREADED`, every node also links to its
+ *   in-order successor and predecessor, so iteration with `rbt_next()` and
+ *   `rbt_prev()` costs a single pointer load per step.
  * - Tree: A structure representing the Red-Black Tree itself, encapsulating a
  *   pointer to its root and the total number of nodes in the tree.
  *
  * Key Functions (Declared):
  * - rbt_init(): Creates and returns a new instance of a Red-Black Tree.
+ * - rbt_init_engine(): Creates a tree backed by a given engine, e.g. a B+-tree.
  * - rbt_destroy(): Destroys the Red-Black Tree, freeing all
  *   allocated memory.
  * - rbt_insert(): Inserts a new element with the
  *   specified data into the tree.
+ * - rbt_insert_hint(): Inserts a new element starting from a nearby node.
+ * - rbt_search_from(): Searches for an element starting from a nearby node.
+ * - rbt_delete(): Deletes an element with the specified data from the tree.
+ * - rbt_min(), rbt_max(): Return the smallest and largest elements in O(1).
+ * - rbt_pop_min(), rbt_pop_max(): Remove the smallest or largest element.
+ * - rbt_next(), rbt_prev(): Step to the next or previous element in sorted order.
+ * - rbt_contains(): Returns whether an element is present, for every engine.
+ * - rbt_foreach(), rbt_range(): Visit every element, or every element in a range,
+ *   in sorted order for every engine.
+ * - rbt_erase_range(): Deletes every element in a range with O(log n) restructuring.
+ * - rbt_build_sorted(): Builds a balanced tree from sorted values in O(n).
+ * - rbt_attach_wal(): Records every change to the tree in a write-ahead log.
+ * - rbt_insert_interval(), rbt_delete_interval(), rbt_interval_overlaps(),
+ *   rbt_interval_stab(): The interval tree, when compiled with `RBT_INTERVAL`.
+ * - rbt_insert_value(), rbt_set_value(), rbt_range_aggregate(): Keyed values
+ *   with O(log n) range aggregates, when compiled with `RBT_AUGMENT`.
+ * - rbt_set_bounds(), rbt_insert_ttl(), rbt_expire(), rbt_set_clock(): Bounded
+ *   trees with expiring entries, when compiled with `RBT_EXPIRY`.
+ * - rbt_compact(): Relocates nodes into contiguous slabs in bounded slices.
+ * - rbt_set_hash_index(): Maintains a hash index for O(1) exact-match lookups.
+ * - rbt_parallel_for(), rbt_parallel_reduce(): Visit or reduce every element on
+ *   several threads.
+ * - rbt_memory_usage(): Reports the memory footprint of a tree.
+ * - rbt_set_name(), rbt_registry_dump(): Label trees and list every live tree
+ *   with its footprint.
+ * - rbt_init_intrusive(), rbt_link(), rbt_find(), rbt_unlink(): The intrusive
+ *   interface, where callers embed a Node in their own structures and the
+ *   library never allocates.
  * - rbt_inorder(): Conducts an inorder traversal of the tree.
  * - rbt_print_tree(): Prints the structure of the tree.
  *
@@ -46,7 +77,113 @@
  * @author Warren Kim
  */
 
+#ifndef RBT_H
+#define RBT_H
+
 #include <stddef.h>
+#include <stdbool.h>
+#include <stdio.h>
+
+/**
+ * @def RBT_SLAB_BYTES
+ * @brief The size (and alignment) of the slabs `rbt_compact()` relocates nodes into.
+ *
+ * It must be a power of two. On Linux, slabs of 2 MiB or more are marked for transparent huge
+ * pages, e.g. with `-DRBT_SLAB_BYTES=0x200000`, which saves TLB misses on large trees.
+ */
+#ifndef RBT_SLAB_BYTES
+#define RBT_SLAB_BYTES (64 * 1024)
+#endif
+
+/**
+ * @def RBT_SMALL_MAX
+ * @brief The number of values an `RBT_ENGINE_ADAPTIVE` tree stores inline before switching to
+ *        Red-Black nodes.
+ *
+ * The tree switches back once it shrinks to half of this. `RBT_SMALL_SLOTS` rounds it up to a
+ * whole number of 16-byte SIMD vectors.
+ */
+#ifndef RBT_SMALL_MAX
+#define RBT_SMALL_MAX 16
+#endif
+#define RBT_SMALL_SLOTS ((RBT_SMALL_MAX + 3) / 4 * 4)
+
+#ifdef RBT_EXPIRY
+#include <stdint.h>
+
+/**
+ * @def RBT_EXPIRY_STEPS
+ * @brief The number of entries the expiry clock hand examines on every insertion into a tree
+ *        compiled with `RBT_EXPIRY`.
+ *
+ * Each insertion into a bounded tree also evicts at most `RBT_EVICT_STEPS` entries, so neither
+ * expiry nor eviction ever sweeps the whole tree at once.
+ */
+#ifndef RBT_EXPIRY_STEPS
+#define RBT_EXPIRY_STEPS 2
+#endif
+
+/**
+ * @def RBT_EVICT_STEPS
+ * @brief The most entries evicted by a single insertion into a tree over its bounds.
+ *
+ * It must be at least 2, so that a tree whose bounds were lowered shrinks while it is filled.
+ */
+#ifndef RBT_EVICT_STEPS
+#define RBT_EVICT_STEPS 2
+#endif
+#endif
+
+#ifdef RBT_AUGMENT
+#include <limits.h>
+
+/**
+ * @def RBT_AUGMENT
+ * @brief Selects the aggregate every node keeps of its subtree.
+ *
+ * Compile with `-DRBT_AUGMENT=RBT_AGG_SUM` (the default for a bare
+ * `-DRBT_AUGMENT`), `RBT_AGG_MIN`, `RBT_AGG_MAX` or `RBT_AGG_COUNT`. Any other
+ * monoid can be used by defining `RBT_AGG_TYPE`, `RBT_AGG_IDENTITY`,
+ * `RBT_AGG_LIFT(value)` and `RBT_AGG_COMBINE(a, b)` for every file that
+ * includes this header, e.g. with `-include`. `RBT_AGG_COMBINE` must be
+ * associative with `RBT_AGG_IDENTITY` as its identity; it is always applied in
+ * key order, so it need not be commutative.
+ */
+#define RBT_AGG_SUM 1
+#define RBT_AGG_MIN 2
+#define RBT_AGG_MAX 3
+#define RBT_AGG_COUNT 4
+
+#if defined(RBT_AGG_COMBINE)
+/* a custom monoid, defined by the user */
+#elif RBT_AUGMENT == RBT_AGG_MIN
+#define RBT_AGG_TYPE int
+#define RBT_AGG_IDENTITY INT_MAX
+#define RBT_AGG_LIFT(value) (value)
+#define RBT_AGG_COMBINE(a, b) ((a) < (b) ? (a) : (b))
+#elif RBT_AUGMENT == RBT_AGG_MAX
+#define RBT_AGG_TYPE int
+#define RBT_AGG_IDENTITY INT_MIN
+#define RBT_AGG_LIFT(value) (value)
+#define RBT_AGG_COMBINE(a, b) ((a) > (b) ? (a) : (b))
+#elif RBT_AUGMENT == RBT_AGG_COUNT
+#define RBT_AGG_TYPE size_t
+#define RBT_AGG_IDENTITY 0
+#define RBT_AGG_LIFT(value) ((void)(value), (size_t)1)
+#define RBT_AGG_COMBINE(a, b) ((a) + (b))
+#else
+#define RBT_AGG_TYPE long long
+#define RBT_AGG_IDENTITY 0
+#define RBT_AGG_LIFT(value) ((long long)(value))
+#define RBT_AGG_COMBINE(a, b) ((a) + (b))
+#endif
+
+/**
+ * @typedef RbtAgg
+ * @brief The type of the subtree aggregate selected by `RBT_AUGMENT`.
+ */
+typedef RBT_AGG_TYPE RbtAgg;
+#endif
 
 /**
  * @typedef enum Color
@@ -70,6 +207,10 @@ typedef enum { RED, BLACK } Color;
  * @var Node::color
  * The color of the node is either red or black.
  *
+ * @var Node::slab
+ * Whether the node was relocated into a slab by `rbt_compact()` rather than allocated on its own.
+ * It occupies padding after `color`, so it does not grow the node.
+ *
  * @var Node::left
  * Pointer to the left child of the node. If the node does not have a left child, this pointer is NULL.
  *
@@ -81,15 +222,234 @@ typedef enum { RED, BLACK } Color;
  *
  * @var Node::data
  * The data stored in the node. For simplicity, this implementation considers an integer.
+ *
+ * @var Node::next
+ * Only present when compiled with `RBT_THREADED`. Pointer to the in-order successor of the node,
+ * or NULL for the maximum.
+ *
+ * @var Node::prev
+ * Only present when compiled with `RBT_THREADED`. Pointer to the in-order predecessor of the node,
+ * or NULL for the minimum.
+ *
+ * @var Node::high
+ * Only present when compiled with `RBT_INTERVAL`. The end of the interval [data, high] stored in
+ * the node; `data` is its start and the key the tree is ordered by.
+ *
+ * @var Node::max_high
+ * Only present when compiled with `RBT_INTERVAL`. The largest `high` in the subtree rooted at the
+ * node, which lets overlap queries skip subtrees that end before the query starts.
+ *
+ * @var Node::value
+ * Only present when compiled with `RBT_AUGMENT`. The value attached to the key `data`, e.g. a
+ * metric sample. It defaults to `data` itself.
+ *
+ * @var Node::agg
+ * Only present when compiled with `RBT_AUGMENT`. The aggregate of `value` over the subtree rooted
+ * at the node, in key order.
+ *
+ * @var Node::expires
+ * Only present when compiled with `RBT_EXPIRY`. The time, on the tree's clock, at which the entry
+ * expires, or 0 if it never does.
+ *
+ * @var Node::older
+ * Only present when compiled with `RBT_EXPIRY`. Pointer to the entry inserted just before this
+ * one, or NULL for the oldest.
+ *
+ * @var Node::newer
+ * Only present when compiled with `RBT_EXPIRY`. Pointer to the entry inserted just after this
+ * one, or NULL for the newest.
  */
 typedef struct Node {
     Color color;
+    bool slab;
     struct Node  *left;
     struct Node  *right;
     struct Node  *parent;
     int data;
+#ifdef RBT_THREADED
+    struct Node  *next;
+    struct Node  *prev;
+#endif
+#ifdef RBT_INTERVAL
+    int high;
+    int max_high;
+#endif
+#ifdef RBT_AUGMENT
+    int value;
+    RbtAgg agg;
+#endif
+#ifdef RBT_EXPIRY
+    uint64_t expires;
+    struct Node  *older;
+    struct Node  *newer;
+#endif
 } Node;
 
+/**
+ * @typedef enum Engine
+ * @enum Engine
+ * @brief The data structure backing a Tree.
+ *
+ * - RBT_ENGINE_RB: The Red-Black tree of `Node`s described in this file.
+ * - RBT_ENGINE_BPLUS: A B+-tree with cache-line-sized nodes (see `bptree.h`),
+ *   better suited to large, lookup-heavy sets.
+ * - RBT_ENGINE_ADAPTIVE: Up to `RBT_SMALL_MAX` values are kept in a sorted
+ *   array inside the `Tree` itself, with no further allocation; larger sets
+ *   switch to the Red-Black engine, and switch back once they shrink to half
+ *   of that. Suited to many small sets.
+ * - RBT_ENGINE_BUCKET: A Red-Black tree whose nodes each hold a sorted bucket
+ *   of up to `RBT_BUCKET_KEYS` values (see `bucket.h`), which takes far less
+ *   memory per value and fewer cache misses per lookup on large sets.
+ *
+ * The engine-independent functions (`rbt_insert()`, `rbt_delete()`,
+ * `rbt_contains()`, `rbt_foreach()`, `rbt_range()`, `rbt_destroy()`) work with
+ * every engine, as do `rbt_pop_min()`, `rbt_pop_max()`, `rbt_erase_range()`
+ * and `rbt_build_sorted()`. Functions that take or return a `Node *` are
+ * specific to the Red-Black engine; on other engines they return NULL (or
+ * false), or must not be used.
+ */
+typedef enum { RBT_ENGINE_RB, RBT_ENGINE_BPLUS, RBT_ENGINE_ADAPTIVE, RBT_ENGINE_BUCKET } Engine;
+
+/**
+ * @typedef RbtVisitor
+ * @brief A function called for every value visited by an iteration.
+ *
+ * @param data The value being visited.
+ * @param ctx  The opaque pointer passed to the iteration function.
+ */
+typedef void (*RbtVisitor)(int data, void *ctx);
+
+/**
+ * @typedef RbtIntervalVisitor
+ * @brief A function called for every interval reported by an overlap query.
+ *
+ * @param low  The start of the interval.
+ * @param high The end of the interval.
+ * @param ctx  The opaque pointer passed to the query.
+ */
+typedef void (*RbtIntervalVisitor)(int low, int high, void *ctx);
+
+/**
+ * @typedef RbtFold
+ * @brief Adds a value to an accumulator, for `rbt_parallel_reduce()`.
+ *
+ * @param acc  A pointer to the accumulator.
+ * @param data The value, visited in ascending order within the accumulator.
+ * @param ctx  The opaque pointer passed to the reduction.
+ */
+typedef void (*RbtFold)(void *acc, int data, void *ctx);
+
+/**
+ * @typedef RbtCombine
+ * @brief Merges the accumulator of the values that follow into another, for
+ *        `rbt_parallel_reduce()`.
+ *
+ * @param acc  A pointer to the accumulator of the earlier values, updated in place.
+ * @param next A pointer to the accumulator of the values right after them.
+ * @param ctx  The opaque pointer passed to the reduction.
+ */
+typedef void (*RbtCombine)(void *acc, const void *next, void *ctx);
+
+/**
+ * @typedef RbtCompare
+ * @brief Orders two nodes of an intrusive tree.
+ *
+ * @param a A pointer to the first node.
+ * @param b A pointer to the second node.
+ * @return  A negative, zero or positive value if @p a orders before, with or
+ *          after @p b.
+ */
+typedef int (*RbtCompare)(const Node *a, const Node *b);
+
+/**
+ * @typedef RbtKeyCompare
+ * @brief Compares a search key with a node of an intrusive tree.
+ *
+ * @param key  A pointer to the key being searched for.
+ * @param node A pointer to a node of the tree.
+ * @return     A negative, zero or positive value if @p key orders before,
+ *             with or after @p node.
+ */
+typedef int (*RbtKeyCompare)(const void *key, const Node *node);
+
+#ifdef RBT_EXPIRY
+/**
+ * @typedef enum EvictPolicy
+ * @enum EvictPolicy
+ * @brief Which entry a bounded tree evicts when it holds too many.
+ *
+ * - RBT_EVICT_OLDEST: The entry inserted longest ago.
+ * - RBT_EVICT_SMALLEST: The entry with the smallest value.
+ * - RBT_EVICT_EXPIRED: The oldest entry if it has expired, else an expired
+ *   entry found by the clock hand within `RBT_EXPIRY_STEPS` entries, else the
+ *   oldest entry anyway.
+ */
+typedef enum { RBT_EVICT_OLDEST, RBT_EVICT_SMALLEST, RBT_EVICT_EXPIRED } EvictPolicy;
+
+/**
+ * @typedef RbtClock
+ * @brief Returns the current time in the units of `Node::expires`.
+ */
+typedef uint64_t (*RbtClock)(void);
+#endif
+
+/**
+ * @def rbt_entry
+ * @brief Returns the structure embedding a given `Node`.
+ *
+ * @param ptr    A pointer to the embedded `Node`.
+ * @param type   The type of the embedding structure.
+ * @param member The name of the `Node` member within @p type.
+ */
+#define rbt_entry(ptr, type, member) ((type *)((char *)(ptr) - offsetof(type, member)))
+
+struct BPTree;
+struct BucketTree;
+struct HashSlot;
+struct Wal;
+struct Slab;
+
+/**
+ * @typedef struct RbtMemory
+ * @struct RbtMemory
+ * @brief The memory footprint of a tree, as reported by `rbt_memory_usage()`.
+ *
+ * @var RbtMemory::nodes
+ * The number of nodes allocated by the tree (`Node`s, `BPNode`s on the B+-tree engine, or
+ * `Bucket`s on the bucketed engine).
+ *
+ * @var RbtMemory::node_bytes
+ * The bytes requested from the allocator for those nodes.
+ *
+ * @var RbtMemory::slack_bytes
+ * The bytes the allocator handed out beyond what was requested (rounding to its size
+ * classes). Only measured with glibc; 0 elsewhere.
+ *
+ * @var RbtMemory::free_bytes
+ * The bytes held by the tree but not used by any node: the slots of slabs (see `rbt_compact()`)
+ * whose nodes have been deleted or not yet filled. A slab is only returned to the allocator once
+ * all of its nodes are gone.
+ *
+ * @var RbtMemory::other_bytes
+ * The bytes of the `Tree` itself, of slab headers and of any attached write-ahead log buffer.
+ *
+ * @var RbtMemory::total_bytes
+ * The sum of all of the above.
+ *
+ * @var RbtMemory::overhead_per_value
+ * The bytes spent per stored value on anything but the value itself (links, color,
+ * slack, spare key slots), i.e. `total_bytes / size - sizeof(int)`.
+ */
+typedef struct RbtMemory {
+    size_t nodes;
+    size_t node_bytes;
+    size_t slack_bytes;
+    size_t free_bytes;
+    size_t other_bytes;
+    size_t total_bytes;
+    double overhead_per_value;
+} RbtMemory;
+
 /**
  * @typedef struct Tree
  * @struct Tree
@@ -99,16 +459,151 @@ typedef struct Node {
  * and the total number of nodes within the tree, providing a high-level interface for operations
  * on the tree such as insertion, and search.
  *
+ * So that millions of small trees stay cheap, fields that are never needed at the same time
+ * share storage: the node fields (`root` through `fill`) overlay `small`, which an
+ * `RBT_ENGINE_ADAPTIVE` tree only uses while it has no nodes, and `bptree` overlays `buckets`.
+ *
  * @var Tree::root
  * Pointer to the root node of the Red-Black Tree. It points to NULL when the tree is empty.
  *
+ * @var Tree::min
+ * Pointer to the leftmost (smallest) node, or NULL when the tree is empty. It is maintained by
+ * insertion and deletion; rotations never change which node is leftmost.
+ *
+ * @var Tree::max
+ * Pointer to the rightmost (largest) node, or NULL when the tree is empty.
+ *
+ * @var Tree::compact_cursor
+ * The next node to relocate in preorder, or NULL when no compaction pass is in progress.
+ *
+ * @var Tree::slabs
+ * The slabs holding nodes relocated by `rbt_compact()`, linked through the slabs.
+ *
+ * @var Tree::fill
+ * The slab that nodes are currently being relocated into, or NULL.
+ *
+ * @var Tree::small
+ * The values of an `RBT_ENGINE_ADAPTIVE` tree in ascending order while `inline_values` is set;
+ * the first `size` slots are used.
+ *
  * @var Tree::size
  * The total number of nodes in the tree. This count helps in operations that may require knowledge
  * of the tree's size, such as balancing, validation, and traversal optimizations.
+ *
+ * @var Tree::engine
+ * The data structure backing the tree, chosen when the tree is created.
+ *
+ * @var Tree::inline_values
+ * Whether the values are kept in `small` rather than in nodes, i.e. the tree is backed by the
+ * adaptive engine and small enough.
+ *
+ * @var Tree::intrusive
+ * Whether the tree was set up with `rbt_init_intrusive()`, i.e. its nodes belong to the caller.
+ *
+ * @var Tree::compact_gen
+ * The number of the current (or last) compaction pass. Nodes in slabs of this pass are not moved
+ * again.
+ *
+ * @var Tree::bptree
+ * Pointer to the B+-tree holding the values when `engine` is RBT_ENGINE_BPLUS. `root`, `min`
+ * and `max` are then NULL.
+ *
+ * @var Tree::buckets
+ * Pointer to the bucketed tree holding the values when `engine` is RBT_ENGINE_BUCKET. `root`,
+ * `min` and `max` are then NULL.
+ *
+ * @var Tree::wal
+ * Pointer to the write-ahead log that records every change to the tree (see `wal.h`), or NULL.
+ *
+ * @var Tree::name
+ * A label shown by `rbt_registry_dump()`, set with `rbt_set_name()`, or NULL.
+ *
+ * @var Tree::reg_prev
+ * Pointer to the previous tree in the registry of live trees, or NULL.
+ *
+ * @var Tree::reg_next
+ * Pointer to the next tree in the registry of live trees, or NULL.
+ *
+ * @var Tree::hash
+ * The open-addressing index from values to nodes enabled with `rbt_set_hash_index()`, or NULL.
+ *
+ * @var Tree::hash_capacity
+ * The number of slots of @p hash, a power of two.
+ *
+ * @var Tree::hash_count
+ * The number of occupied slots of @p hash, i.e. of distinct values in the tree.
+ *
+ * @var Tree::oldest
+ * Only present when compiled with `RBT_EXPIRY`. The head of the list of nodes in insertion order,
+ * linked through `Node::newer`.
+ *
+ * @var Tree::newest
+ * Only present when compiled with `RBT_EXPIRY`. The tail of the list of nodes in insertion order.
+ *
+ * @var Tree::hand
+ * Only present when compiled with `RBT_EXPIRY`. The next node the expiry clock hand examines; it
+ * walks from `oldest` to `newest` and starts over. NULL means `oldest`.
+ *
+ * @var Tree::max_entries
+ * Only present when compiled with `RBT_EXPIRY`. The number of entries above which insertions
+ * evict, or 0 if the tree is unbounded. Set with `rbt_set_bounds()`.
+ *
+ * @var Tree::policy
+ * Only present when compiled with `RBT_EXPIRY`. Which entries are evicted first.
+ *
+ * @var Tree::clock
+ * Only present when compiled with `RBT_EXPIRY`. The clock expiry times are read from, or NULL for
+ * a monotonic clock in milliseconds.
+ *
+ * @var Tree::evicted
+ * Only present when compiled with `RBT_EXPIRY`. The number of entries evicted to stay in bounds.
+ *
+ * @var Tree::expired
+ * Only present when compiled with `RBT_EXPIRY`. The number of expired entries removed.
+ *
+ * @var Tree::expiring
+ * Only present when compiled with `RBT_EXPIRY`. The number of entries with an expiry time; the
+ * clock hand stands still while it is 0.
  */
 typedef struct Tree {
-    Node *root;
+    union {
+        struct {
+            Node *root;
+            Node *min;
+            Node *max;
+            Node *compact_cursor;
+            struct Slab *slabs;
+            struct Slab *fill;
+        };
+        int small[RBT_SMALL_SLOTS];
+    };
     size_t size;
+    Engine engine;
+    bool inline_values;
+    bool intrusive;
+    unsigned compact_gen;
+    union {
+        struct BPTree *bptree;
+        struct BucketTree *buckets;
+    };
+    struct Wal *wal;
+    const char *name;
+    struct Tree *reg_prev;
+    struct Tree *reg_next;
+    struct HashSlot *hash;
+    size_t hash_capacity;
+    size_t hash_count;
+#ifdef RBT_EXPIRY
+    Node *oldest;
+    Node *newest;
+    Node *hand;
+    size_t max_entries;
+    EvictPolicy policy;
+    RbtClock clock;
+    size_t evicted;
+    size_t expired;
+    size_t expiring;
+#endif
 } Tree;
 
 /**
@@ -127,6 +622,17 @@ typedef struct Tree {
  */
 Tree *rbt_init();
 
+/**
+ * @brief Initializes a new tree backed by a given engine.
+ *
+ * `rbt_init()` is equivalent to `rbt_init_engine(RBT_ENGINE_RB)`.
+ *
+ * @param engine The data structure backing the tree.
+ * @return A pointer to the newly initialized tree if successful,
+ *         error and exits otherwise.
+ */
+Tree *rbt_init_engine(Engine engine);
+
 /**
  * @brief Destroys a Red-Black tree and frees its memory.
  *
@@ -153,7 +659,8 @@ void rbt_destroy(Tree *tree);
  *
  * @param tree A pointer to the the tree.
  * @param data The integer value to be inserted.
- * @return     A pointer to the root of the tree.
+ * @return     A pointer to the root of the tree, or NULL if the tree is not
+ *             backed by the Red-Black engine.
  */
 Node *rbt_insert(Tree *tree, const int data);
 
@@ -188,3 +695,574 @@ void rbt_print_tree(Node *root);
  * @return A pointer to the node containing @p data if found, NULL otherwise.
  */
 Node *rbt_search(Tree *tree, const int data);
+
+/**
+ * @brief Inserts a value into the Red-Black tree, starting near a hint.
+ *
+ * Instead of descending from the root, this function ascends from @p hint via
+ * `parent` only as far as needed to reach the subtree that covers @p data,
+ * inserts there, and fixes up as usual. For sorted or nearly-sorted streams,
+ * passing the previously inserted node as the hint makes every insertion cost
+ * O(1) amortized plus rebalancing.
+ *
+ * @param tree A pointer to the tree.
+ * @param hint A node of @p tree close to where @p data belongs, or NULL to
+ *             insert from the root.
+ * @param data The integer value to be inserted.
+ * @return     A pointer to the newly inserted node, suitable as the next hint,
+ *             or NULL if the tree is not backed by the Red-Black engine.
+ */
+Node *rbt_insert_hint(Tree *tree, Node *hint, const int data);
+
+/**
+ * @brief Searches for a value, starting from a recently visited node.
+ *
+ * This is the finger search counterpart of `rbt_search()`: the search ascends
+ * from @p start only as far as needed before descending.
+ * Without level links the climb can still reach the root even when @p data is
+ * adjacent to the finger (e.g. from the root's predecessor to its successor),
+ * so a lookup costs O(log n) in the worst case; over a sequence of lookups
+ * in sorted order it costs O(1) amortized.
+ *
+ * @param tree  A pointer to the Red-Black Tree we want to search.
+ * @param start A node of @p tree, e.g. the result of the previous lookup, or
+ *              NULL to search from the root.
+ * @param data  The value to search for.
+ * @return A pointer to the node containing @p data if found, NULL otherwise.
+ */
+Node *rbt_search_from(Tree *tree, Node *start, const int data);
+
+/**
+ * @brief Deletes a node from the Red-Black tree and frees it.
+ *
+ * The node is unlinked from the tree and the tree is fixed up so that it
+ * remains a valid Red-Black tree. Pointers to every other node stay valid.
+ *
+ * @param tree A pointer to the tree.
+ * @param node A pointer to a node of @p tree, e.g. returned by `rbt_search()`.
+ */
+void rbt_delete_node(Tree *tree, Node *node);
+
+/**
+ * @brief Deletes a value from the Red-Black tree.
+ *
+ * If @p data occurs more than once, only one occurrence is deleted. In
+ * `RBT_EXPIRY` builds, expired occurrences are skipped, as by `rbt_search()`.
+ *
+ * @param tree A pointer to the tree.
+ * @param data The value to delete.
+ * @return     true if a node was deleted, false if @p data was not found.
+ */
+bool rbt_delete(Tree *tree, const int data);
+
+/**
+ * @brief Returns the node with the smallest value in O(1).
+ *
+ * @param tree A pointer to the tree.
+ * @return     A pointer to the leftmost node, or NULL if the tree is empty.
+ */
+Node *rbt_min(Tree *tree);
+
+/**
+ * @brief Returns the node with the largest value in O(1).
+ *
+ * @param tree A pointer to the tree.
+ * @return     A pointer to the rightmost node, or NULL if the tree is empty.
+ */
+Node *rbt_max(Tree *tree);
+
+/**
+ * @brief Removes the smallest value from the tree.
+ *
+ * Together with `rbt_insert()` this lets the tree act as a priority queue;
+ * no search is needed since the minimum is cached. In `RBT_EXPIRY` builds,
+ * expired values at the low end are removed first and counted in
+ * `Tree::expired`, so only a live value is returned.
+ *
+ * @param tree A pointer to the tree.
+ * @param data A pointer that receives the removed value. May be NULL.
+ * @return     true if a value was removed, false if the tree is empty.
+ */
+bool rbt_pop_min(Tree *tree, int *data);
+
+/**
+ * @brief Removes the largest value from the tree.
+ *
+ * Like `rbt_pop_min()`, expired values at the high end are removed first in
+ * `RBT_EXPIRY` builds.
+ *
+ * @param tree A pointer to the tree.
+ * @param data A pointer that receives the removed value. May be NULL.
+ * @return     true if a value was removed, false if the tree is empty.
+ */
+bool rbt_pop_max(Tree *tree, int *data);
+
+/**
+ * @brief Returns the node that follows a given node in sorted order.
+ *
+ * Starting from `rbt_min()`, repeated calls visit every node in sorted order
+ * without recursion or allocation. When compiled with `RBT_THREADED` each step
+ * is a single pointer load; otherwise the successor is found through the
+ * parent pointers in O(1) amortized (O(log n) worst case) time.
+ *
+ * @param node A pointer to a node of the tree.
+ * @return     A pointer to the in-order successor of @p node, or NULL if
+ *             @p node is the maximum.
+ */
+Node *rbt_next(Node *node);
+
+/**
+ * @brief Returns the node that precedes a given node in sorted order.
+ *
+ * @param node A pointer to a node of the tree.
+ * @return     A pointer to the in-order predecessor of @p node, or NULL if
+ *             @p node is the minimum.
+ */
+Node *rbt_prev(Node *node);
+
+/**
+ * @brief Returns whether a value is present in the tree.
+ *
+ * Unlike `rbt_search()`, this works with every engine.
+ *
+ * @param tree A pointer to the tree.
+ * @param data The value to search for.
+ * @return     true if @p data is present, false otherwise.
+ */
+bool rbt_contains(Tree *tree, const int data);
+
+/**
+ * @brief Visits every value in the tree in sorted order.
+ *
+ * @param tree  A pointer to the tree.
+ * @param visit The function called for every value.
+ * @param ctx   An opaque pointer passed to @p visit.
+ */
+void rbt_foreach(Tree *tree, RbtVisitor visit, void *ctx);
+
+/**
+ * @brief Visits every value in [@p lo, @p hi] in sorted order.
+ *
+ * The first value is found in O(log n); every following one is an in-order
+ * step, so a range of k values costs O(log n + k).
+ *
+ * @param tree  A pointer to the tree.
+ * @param lo    The smallest value to visit.
+ * @param hi    The largest value to visit.
+ * @param visit The function called for every value.
+ * @param ctx   An opaque pointer passed to @p visit.
+ */
+void rbt_range(Tree *tree, const int lo, const int hi, RbtVisitor visit, void *ctx);
+
+/**
+ * @brief Detaches every value in [@p lo, @p hi] from the tree.
+ *
+ * The tree is split at @p lo and @p hi and the outer pieces are joined again,
+ * so the restructuring costs O(log n) regardless of how many values are
+ * removed; counting them costs O(k). The detached nodes form a valid
+ * Red-Black tree of their own, which the caller can free later, e.g. on a
+ * background thread, with `rbt_free_detached()`.
+ *
+ * @param tree  A pointer to the tree, backed by the Red-Black engine.
+ * @param lo    The smallest value to detach.
+ * @param hi    The largest value to detach.
+ * @param count A pointer that receives the number of detached nodes. May be NULL.
+ * @return      A pointer to the root of the detached nodes, or NULL if no value
+ *              lies in the range.
+ */
+Node *rbt_detach_range(Tree *tree, const int lo, const int hi, size_t *count);
+
+/**
+ * @brief Frees nodes detached by `rbt_detach_range()`.
+ *
+ * This only touches the detached nodes, so it may run on another thread while
+ * the tree they came from is in use.
+ *
+ * @param root A pointer to the root of the detached nodes, which may be NULL.
+ */
+void rbt_free_detached(Node *root);
+
+/**
+ * @brief Deletes every value in [@p lo, @p hi] from the tree.
+ *
+ * On the Red-Black engine the range is detached in O(log n) with
+ * `rbt_detach_range()` and its nodes are then freed in bulk, so the cost of a
+ * large purge is dominated by freeing memory rather than rebalancing. The
+ * B+-tree engine deletes the values one at a time.
+ *
+ * @param tree A pointer to the tree.
+ * @param lo   The smallest value to delete.
+ * @param hi   The largest value to delete.
+ * @return     The number of values deleted.
+ */
+size_t rbt_erase_range(Tree *tree, const int lo, const int hi);
+
+/**
+ * @brief Builds a balanced tree from values in ascending order.
+ *
+ * On an empty tree backed by the Red-Black engine, the nodes are allocated and
+ * linked in a single O(n) pass: every subtree is rooted at the middle of its
+ * range, and nodes on the deepest level are colored RED when that level is
+ * incomplete, so no rotation is ever needed. Otherwise the values are inserted
+ * one at a time. Either way, a tree bounded by `rbt_set_bounds()` is left
+ * within its bounds.
+ *
+ * @param tree A pointer to the tree.
+ * @param keys A pointer to the values, in ascending order.
+ * @param n    The number of values.
+ */
+void rbt_build_sorted(Tree *tree, const int *keys, size_t n);
+
+/**
+ * @brief Records every subsequent change to the tree in a write-ahead log.
+ *
+ * Insertions, deletions and range erasures are appended to @p wal (see
+ * `wal.h`). Changes made through the intrusive interface are not recorded.
+ * The tree does not own the log: close it with `wal_close()` after the tree
+ * is no longer modified.
+ *
+ * @param tree A pointer to the tree.
+ * @param wal  A pointer to an open log, or NULL to stop recording.
+ */
+void rbt_attach_wal(Tree *tree, struct Wal *wal);
+
+/**
+ * @brief Initializes a caller-owned tree for intrusive use.
+ *
+ * The tree is typically a global, a stack variable, or embedded in another
+ * structure. Since the library owns neither the tree nor its nodes, such a
+ * tree must not be passed to `rbt_destroy()`; unlink the nodes instead.
+ *
+ * @param tree A pointer to the tree to initialize.
+ */
+void rbt_init_intrusive(Tree *tree);
+
+/**
+ * @brief Links a caller-owned node into the tree.
+ *
+ * The node is placed using standard BST rules under @p cmp, with equality to
+ * the left subtree, and the tree is then fixed up exactly as in
+ * `rbt_insert()`. Only the link fields of @p node are written; `Node::data`
+ * is left untouched, so callers may use it as a cached key. As in
+ * `rbt_insert()`, the node also becomes the interval [data, data] in
+ * `RBT_INTERVAL` builds, and `Node::value` is set to `Node::data` in
+ * `RBT_AUGMENT` builds; use `rbt_set_value()` afterwards to attach another
+ * value.
+ *
+ * @param tree A pointer to the tree.
+ * @param node A pointer to the node embedded in the caller's structure. It
+ *             must not currently be linked into any tree.
+ * @param cmp  A function returning a negative, zero or positive value if its
+ *             first argument orders before, with or after its second.
+ * @return     @p node.
+ */
+Node *rbt_link(Tree *tree, Node *node, RbtCompare cmp);
+
+/**
+ * @brief Searches for a node by key.
+ *
+ * @param tree A pointer to the tree.
+ * @param key  A pointer to the key to search for, in whatever form @p cmp
+ *             expects.
+ * @param cmp  A function returning a negative, zero or positive value if
+ *             @p key orders before, with or after the given node. It must be
+ *             consistent with the comparator used by `rbt_link()`.
+ * @return     A pointer to a node matching @p key if found, NULL otherwise.
+ */
+Node *rbt_find(Tree *tree, const void *key, RbtKeyCompare cmp);
+
+/**
+ * @brief Unlinks a node from the tree without freeing it.
+ *
+ * The tree is fixed up exactly as in `rbt_delete_node()`; afterwards the node
+ * belongs to the caller again and may be freed or linked elsewhere.
+ *
+ * @param tree A pointer to the tree.
+ * @param node A pointer to a node linked into @p tree.
+ */
+void rbt_unlink(Tree *tree, Node *node);
+
+/**
+ * @brief Relocates up to @p budget nodes into contiguous slabs.
+ *
+ * After long insert/delete churn, nodes that are adjacent in the tree are
+ * scattered across the heap. A compaction pass copies every node, in
+ * depth-first preorder, into freshly allocated slabs of `RBT_SLAB_BYTES`, so
+ * that a parent and the top of its left subtree share cache lines and pages.
+ * Each call handles at most @p budget nodes and returns, so a pass can be
+ * spread over many calls, e.g. between requests; the tree may be used and
+ * modified freely between calls. Nodes inserted or rotated above the cursor
+ * during a pass may be left in place until the next pass.
+ *
+ * @warning Relocated nodes move: any `Node *` held by the caller, e.g. a hint
+ *          for `rbt_insert_hint()`, is invalid after this call.
+ *
+ * @param tree   A pointer to the tree. Intrusive trees and other engines are
+ *               left untouched.
+ * @param budget The maximum number of nodes to visit in this call.
+ * @return       true if the pass finished, in which case the next call starts
+ *               a new pass; false if more calls are needed.
+ */
+bool rbt_compact(Tree *tree, size_t budget);
+
+/**
+ * @brief Adds or removes a hash index for exact-match lookups.
+ *
+ * With the index, `rbt_search()`, `rbt_contains()` and `rbt_delete()` find a
+ * value in one or two cache misses instead of O(log n), while ordered
+ * operations keep using the tree. Every insertion and deletion updates the
+ * index, a table of 16-byte slots kept between a quarter and half full.
+ * Only trees backed by the Red-Black or the adaptive engine, and not set up
+ * with `rbt_init_intrusive()`, can have one.
+ *
+ * @param tree A pointer to the tree.
+ * @param on   true to build the index from the values present, false to free it.
+ */
+void rbt_set_hash_index(Tree *tree, bool on);
+
+/**
+ * @brief Visits every value in the tree on several threads.
+ *
+ * The tree is cut into about eight tasks per thread, each a run of adjacent
+ * values, which the threads take from per-thread queues and steal from each
+ * other once their own queue is empty. @p fn is called concurrently and in no
+ * particular order, so it must be thread-safe. The tree must not be modified
+ * until the function returns. Trees backed by the B+-tree engine, and small
+ * trees, are visited on the calling thread alone.
+ *
+ * @param tree     A pointer to the tree.
+ * @param fn       The function called for every value.
+ * @param ctx      An opaque pointer passed to @p fn.
+ * @param nthreads The number of threads, including the calling one, or 0 for
+ *                 one per online CPU.
+ */
+void rbt_parallel_for(Tree *tree, RbtVisitor fn, void *ctx, unsigned nthreads);
+
+/**
+ * @brief Reduces every value in the tree on several threads, in order.
+ *
+ * Each task folds its run of values, in ascending order, into its own copy of
+ * the identity; the accumulators are then combined from left to right, so
+ * the result equals a sequential fold over `rbt_foreach()` whenever
+ * @p combine is associative with the identity as its neutral element. The
+ * tasks are scheduled as in `rbt_parallel_for()`.
+ *
+ * @param tree     A pointer to the tree.
+ * @param result   A pointer to an accumulator holding the identity, which
+ *                 receives the result.
+ * @param size     The size of an accumulator in bytes.
+ * @param fold     The function adding a value to an accumulator.
+ * @param combine  The function merging two adjacent accumulators.
+ * @param ctx      An opaque pointer passed to @p fold and @p combine.
+ * @param nthreads The number of threads, including the calling one, or 0 for
+ *                 one per online CPU.
+ */
+void rbt_parallel_reduce(Tree *tree, void *result, size_t size, RbtFold fold, RbtCombine combine,
+                         void *ctx, unsigned nthreads);
+
+/**
+ * @brief Reports the memory footprint of a tree.
+ *
+ * This visits every node to measure allocator slack, so it costs O(n). The
+ * nodes of an intrusive tree belong to the caller and are not counted.
+ *
+ * @param tree A pointer to the tree.
+ * @return     The footprint of @p tree.
+ */
+RbtMemory rbt_memory_usage(Tree *tree);
+
+/**
+ * @brief Sets the label under which a tree is listed by `rbt_registry_dump()`.
+ *
+ * @param tree A pointer to the tree.
+ * @param name A string that outlives the tree (e.g. a literal), or NULL.
+ */
+void rbt_set_name(Tree *tree, const char *name);
+
+/**
+ * @brief Writes one line per live tree with its size and footprint.
+ *
+ * Every tree created with `rbt_init()` or `rbt_init_engine()` is listed, most
+ * recently created first, until it is passed to `rbt_destroy()`. The registry
+ * itself may be used from several threads, but as with every other function,
+ * a tree must not be modified while it is being measured.
+ *
+ * @param out The stream to write to, e.g. stderr.
+ * @return    The total footprint of every live tree, in bytes.
+ */
+size_t rbt_registry_dump(FILE *out);
+
+#ifdef RBT_INTERVAL
+/**
+ * @brief Inserts the interval [@p low, @p high].
+ *
+ * The tree is ordered by @p low. Intervals are not recorded by an attached
+ * write-ahead log, which only stores values.
+ *
+ * @param tree A pointer to the tree, backed by the Red-Black engine.
+ * @param low  The start of the interval.
+ * @param high The end of the interval; swapped with @p low if smaller.
+ * @return     A pointer to the new node, or NULL if the tree is not backed by
+ *             the Red-Black engine.
+ */
+Node *rbt_insert_interval(Tree *tree, int low, int high);
+
+/**
+ * @brief Deletes one occurrence of the interval [@p low, @p high].
+ *
+ * @param tree A pointer to the tree.
+ * @param low  The start of the interval.
+ * @param high The end of the interval.
+ * @return     true if the interval was found and deleted, false otherwise.
+ */
+bool rbt_delete_interval(Tree *tree, const int low, const int high);
+
+/**
+ * @brief Visits every interval that overlaps [@p a, @p b], ordered by start.
+ *
+ * Subtrees whose intervals all end before @p a, or all start after @p b, are
+ * skipped. Each reported interval still costs up to a root-to-leaf walk, so a
+ * query reporting k intervals costs O(min(n, (k + 1) log n)) in the worst
+ * case; it approaches O(log n + k) only when the reported intervals are
+ * clustered together in the tree. While an `RBT_ENGINE_ADAPTIVE` tree keeps
+ * its values inline, each value v is the interval [v, v], as for a value
+ * inserted with `rbt_insert()`.
+ *
+ * @param tree  A pointer to the tree.
+ * @param a     The start of the query interval.
+ * @param b     The end of the query interval.
+ * @param visit The function called for every overlapping interval, or NULL
+ *              to only count them.
+ * @param ctx   An opaque pointer passed to @p visit.
+ * @return      The number of overlapping intervals.
+ */
+size_t rbt_interval_overlaps(Tree *tree, const int a, const int b, RbtIntervalVisitor visit, void *ctx);
+
+/**
+ * @brief Visits every interval that contains @p point (a stabbing query).
+ *
+ * This is `rbt_interval_overlaps(tree, point, point, visit, ctx)`.
+ *
+ * @param tree  A pointer to the tree.
+ * @param point The point to stab.
+ * @param visit The function called for every interval containing @p point,
+ *              or NULL to only count them.
+ * @param ctx   An opaque pointer passed to @p visit.
+ * @return      The number of intervals containing @p point.
+ */
+size_t rbt_interval_stab(Tree *tree, const int point, RbtIntervalVisitor visit, void *ctx);
+#endif
+
+#ifdef RBT_AUGMENT
+/**
+ * @brief Inserts a key with an attached value.
+ *
+ * Values are not recorded by an attached write-ahead log, which only stores
+ * keys.
+ *
+ * @param tree  A pointer to the tree, backed by the Red-Black engine.
+ * @param data  The key to insert.
+ * @param value The value attached to @p data.
+ * @return      A pointer to the new node, or NULL if the tree is not backed by
+ *              the Red-Black engine.
+ */
+Node *rbt_insert_value(Tree *tree, const int data, const int value);
+
+/**
+ * @brief Replaces the value attached to a node.
+ *
+ * The aggregates of the node's ancestors are updated in O(log n).
+ *
+ * @param tree  A pointer to the tree.
+ * @param node  A pointer to a node of @p tree.
+ * @param value The new value.
+ */
+void rbt_set_value(Tree *tree, Node *node, const int value);
+
+/**
+ * @brief Aggregates the values of every key in [@p lo, @p hi].
+ *
+ * Only the two boundary paths below the node where they diverge are walked,
+ * using the aggregates stored in the subtrees hanging off them, so this costs
+ * O(log n) regardless of how many keys lie in the range. While an
+ * `RBT_ENGINE_ADAPTIVE` tree keeps its values inline, each value is its own
+ * attached value, as for a key inserted with `rbt_insert()`, and the array is
+ * scanned instead.
+ *
+ * Unlike `rbt_range()`, this does not filter expired entries in `RBT_EXPIRY`
+ * builds: they stay in the stored aggregates until the clock hand removes
+ * them. Call `rbt_expire()` with a budget of `Tree::size` first for an exact
+ * result.
+ *
+ * @param tree A pointer to the tree.
+ * @param lo   The smallest key to include.
+ * @param hi   The largest key to include.
+ * @return     The aggregate of the values in key order, or `RBT_AGG_IDENTITY`
+ *             if the range is empty or the tree is backed by neither the
+ *             Red-Black nor the adaptive engine.
+ */
+RbtAgg rbt_range_aggregate(Tree *tree, const int lo, const int hi);
+#endif
+
+#ifdef RBT_EXPIRY
+/**
+ * @brief Bounds the size of a tree, evicting entries as it is filled.
+ *
+ * Every later insertion that leaves the tree over its bounds evicts up to
+ * `RBT_EVICT_STEPS` entries chosen by @p policy, so a tree whose bounds are
+ * lowered shrinks gradually instead of in one sweep. The entry being inserted
+ * is never evicted by its own insertion. Evictions are recorded by an attached
+ * write-ahead log as deletions.
+ *
+ * @param tree        A pointer to the tree, backed by the Red-Black engine and
+ *                    not intrusive.
+ * @param max_entries The most entries to keep, or 0 for no limit on entries.
+ * @param max_bytes   The most bytes of nodes to keep, counted as
+ *                    `sizeof(Node)` per entry, or 0 for no limit on bytes.
+ * @param policy      Which entries to evict first.
+ * @return            true if the bounds were set, false if @p tree cannot be
+ *                    bounded.
+ */
+bool rbt_set_bounds(Tree *tree, size_t max_entries, size_t max_bytes, EvictPolicy policy);
+
+/**
+ * @brief Inserts a value that expires after a given time.
+ *
+ * An expired entry is invisible to `rbt_search()`, `rbt_contains()`,
+ * `rbt_range()`, `rbt_delete()` and `rbt_pop_min()` at once, and is removed
+ * later by the clock hand (see `rbt_expire()`). The exception is
+ * `rbt_range_aggregate()`, which counts it until it is removed. Expiry times
+ * are not recorded by an attached write-ahead log, which only stores values.
+ *
+ * @param tree A pointer to the tree, backed by the Red-Black engine.
+ * @param data The value to insert.
+ * @param ttl  The time to live, in units of the tree's clock (milliseconds by
+ *             default), or 0 for an entry that never expires.
+ * @return     A pointer to the new node, or NULL if the tree is not backed by
+ *             the Red-Black engine.
+ */
+Node *rbt_insert_ttl(Tree *tree, const int data, uint64_t ttl);
+
+/**
+ * @brief Advances the expiry clock hand, removing the expired entries it passes.
+ *
+ * Every insertion already advances the hand by `RBT_EXPIRY_STEPS` entries;
+ * this lets an idle tree be cleaned up, e.g. from a timer.
+ *
+ * @param tree   A pointer to the tree.
+ * @param budget The most entries to examine.
+ * @return       The number of expired entries removed.
+ */
+size_t rbt_expire(Tree *tree, size_t budget);
+
+/**
+ * @brief Replaces the clock expiry times are measured on.
+ *
+ * @param tree  A pointer to the tree.
+ * @param clock The new clock, or NULL for a monotonic clock in milliseconds.
+ *              Entries already inserted keep their expiry times.
+ */
+void rbt_set_clock(Tree *tree, RbtClock clock);
+#endif
+
+#endif
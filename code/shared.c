@@ -0,0 +1,530 @@
+/**
+ * @file shared.c
+ *
+ * @brief Implementation of the read-only tree shared between processes.
+ *
+ * File format (all integers in native byte order):
+ *
+ * @verbatim
+ *  header:   magic "RBTS" (u32), version (u32), capacity (u64),
+ *            active buffer (u32), reserved (u32), generation (u64),
+ *            2 x { sequence (u64), count (u64) }
+ *  buffer*2: capacity nodes of { value (i32), left (u32), right (u32) }
+ * @endverbatim
+ *
+ * A link is the position of the child within its buffer plus one, 0 meaning
+ * no child. Nodes are stored in preorder, so the root of a non-empty snapshot
+ * is always at position 1.
+ *
+ * @version 1.0
+ * @date 2024-02-27
+ * @author Warren Kim
+ */
+
+#include "shared.h"
+#include <fcntl.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define SHARED_MAGIC 0x53544252u
+#define SHARED_VERSION 1u
+#define SHARED_MAX_DEPTH 64
+
+/**
+ * @brief The state of one snapshot buffer.
+ *
+ * @p seq is odd while the writer is filling the buffer, and changes every time
+ * the buffer is rewritten.
+ */
+typedef struct {
+    _Atomic uint64_t seq;
+    uint64_t count;
+} SharedBuffer;
+
+/**
+ * @brief The header at the start of a shared tree file.
+ */
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t capacity;
+    _Atomic uint32_t active;
+    uint32_t reserved;
+    _Atomic uint64_t generation;
+    SharedBuffer buffers[2];
+} SharedHeader;
+
+/**
+ * @brief A node of a snapshot, linked to its children by position.
+ */
+typedef struct {
+    int32_t data;
+    uint32_t left;
+    uint32_t right;
+} SharedNode;
+
+/**
+ * @brief A growing array of the values of the tree being published.
+ */
+typedef struct {
+    int *keys;
+    size_t count;
+} SharedKeys;
+
+/**
+ * \defgroup shared_helpers Shared Tree Helper Functions
+ *
+ * This section describes the helpers used to lay out and search the
+ * snapshots of a shared tree file. Key operations include:
+ *
+ * - `header()`, `buffer_nodes()`: Locate the parts of the mapping.
+ * - `mapping_size()`: Computes the size of a file of a given capacity.
+ * - `layout()`: Writes sorted values as a balanced tree in preorder.
+ * - `search()`: Searches a snapshot, checking every link it follows.
+ * - `visit_range()`: Visits the values of a snapshot in a range.
+ */
+
+/**
+ * \ingroup shared_helpers
+ * @brief Returns the header of a mapped shared tree file.
+ *
+ * @param shared A pointer to the mapping.
+ * @return       A pointer to the header.
+ */
+static SharedHeader *header(const SharedTree *shared) {
+    return (SharedHeader *)shared->base;
+}
+
+
+/**
+ * \ingroup shared_helpers
+ * @brief Returns the nodes of one of the two snapshot buffers.
+ *
+ * @param shared A pointer to the mapping.
+ * @param b      The buffer, 0 or 1.
+ * @return       A pointer to the first node of the buffer.
+ */
+static SharedNode *buffer_nodes(const SharedTree *shared, unsigned b) {
+    return (SharedNode *)(shared->base + sizeof(SharedHeader)) + (size_t)b * shared->capacity;
+}
+
+
+/**
+ * \ingroup shared_helpers
+ * @brief Computes the size of a shared tree file of a given capacity.
+ *
+ * @param capacity The maximum number of values per snapshot.
+ * @return         The size of the file in bytes.
+ */
+static size_t mapping_size(size_t capacity) {
+    return sizeof(SharedHeader) + 2 * capacity * sizeof(SharedNode);
+}
+
+
+/**
+ * \ingroup shared_helpers
+ * @brief Appends a visited value to a `SharedKeys`; an `RbtVisitor`.
+ *
+ * @param data The value being visited.
+ * @param ctx  A pointer to the `SharedKeys`.
+ */
+static void collect_visit(int data, void *ctx) {
+    SharedKeys *keys = (SharedKeys *)ctx;
+    keys->keys[keys->count++] = data;
+}
+
+
+/**
+ * \ingroup shared_helpers
+ * @brief Writes a sorted range of values as a balanced tree in preorder.
+ *
+ * Each node takes the middle value of its range, so a left subtree holds only
+ * values less than or equal to its parent and a right subtree only values
+ * greater than or equal to it.
+ *
+ * @param nodes The nodes of the buffer being written.
+ * @param keys  The sorted values.
+ * @param lo    The start of the range (inclusive).
+ * @param hi    The end of the range (exclusive).
+ * @param next  The number of nodes written so far; advanced by this call.
+ * @return      The link to the root of the range, 0 if the range is empty.
+ */
+static uint32_t layout(SharedNode *nodes, const int *keys, size_t lo, size_t hi, uint32_t *next) {
+    if (lo >= hi) {
+        return 0;
+    }
+
+    size_t mid = lo + (hi - lo) / 2;
+    uint32_t at = ++*next;
+    nodes[at - 1].data = keys[mid];
+    nodes[at - 1].left = layout(nodes, keys, lo, mid, next);
+    nodes[at - 1].right = layout(nodes, keys, mid + 1, hi, next);
+    return at;
+}
+
+
+/**
+ * \ingroup shared_helpers
+ * @brief Searches a snapshot for a value.
+ *
+ * The snapshot may be overwritten while it is being read, so every link is
+ * checked against the size of the snapshot and the depth of the search is
+ * bounded; garbage is never dereferenced, and the caller discards the result
+ * if the sequence number shows the snapshot changed.
+ *
+ * @param nodes The nodes of the snapshot.
+ * @param count The number of nodes in the snapshot.
+ * @param value The value to look for.
+ * @return      true if the value was found.
+ */
+static bool search(const SharedNode *nodes, uint64_t count, const int value) {
+    uint32_t at = count ? 1 : 0;
+    for (int depth = 0; at && at <= count && depth < SHARED_MAX_DEPTH; depth++) {
+        const SharedNode *node = &nodes[at - 1];
+        if (value == node->data) {
+            return true;
+        }
+        at = value < node->data ? node->left : node->right;
+    }
+    return false;
+}
+
+
+/**
+ * \ingroup shared_helpers
+ * @brief Visits, in ascending order, the values of a snapshot in a range.
+ *
+ * Like `search()`, every link is checked before it is followed.
+ *
+ * @param nodes The nodes of the snapshot.
+ * @param count The number of nodes in the snapshot.
+ * @param lo    The lower bound of the range (inclusive).
+ * @param hi    The upper bound of the range (inclusive).
+ * @param visit The function called with each value.
+ * @param ctx   Passed to @p visit unchanged.
+ * @return      false if an invalid link was met, true otherwise.
+ */
+static bool visit_range(const SharedNode *nodes, uint64_t count, const int lo, const int hi,
+                        RbtVisitor visit, void *ctx) {
+    uint32_t stack[SHARED_MAX_DEPTH];
+    int top = 0;
+    uint32_t at = count ? 1 : 0;
+
+    for (uint64_t visited = 0; visited <= count; ) {
+        while (at) {
+            if (at > count || top == SHARED_MAX_DEPTH) {
+                return false;
+            }
+            if (nodes[at - 1].data < lo) {
+                at = nodes[at - 1].right;
+            } else {
+                stack[top++] = at;
+                at = nodes[at - 1].left;
+            }
+        }
+        if (!top) {
+            return true;
+        }
+
+        const SharedNode *node = &nodes[stack[--top] - 1];
+        if (node->data > hi) {
+            return true;
+        }
+        visit(node->data, ctx);
+        visited++;
+        at = node->right;
+    }
+    return false;
+}
+
+
+
+
+
+/**
+ * \defgroup shared Shared Tree
+ *
+ * This section documents the public facing API of the shared tree. Key
+ * operations include:
+ *
+ * - `shared_create()`: Creates a shared tree file for the writer.
+ * - `shared_open()`: Maps an existing shared tree file for reading.
+ * - `shared_close()`: Unmaps a shared tree.
+ * - `shared_publish()`: Publishes a snapshot of a tree (writer only).
+ * - `shared_contains()`: Checks whether a value is in the current snapshot.
+ * - `shared_range()`: Visits the values of the current snapshot in a range.
+ * - `shared_size()`, `shared_generation()`: Describe the current snapshot.
+ */
+
+/**
+ * \ingroup shared
+ * @brief Creates a shared tree file holding an empty snapshot.
+ *
+ * The file is built under a temporary name and renamed over @p path, so
+ * processes still mapping an older file at that path are unaffected and
+ * processes opening it afterwards see the new one.
+ *
+ * @param path     The path of the file, e.g. "/dev/shm/keys".
+ * @param capacity The maximum number of values a snapshot can hold.
+ * @return A pointer to the writer's mapping, error and exits on failure.
+ */
+SharedTree *shared_create(const char *path, size_t capacity) {
+    if (capacity >= UINT32_MAX) {
+        fprintf(stderr, "shared_create(): capacity %zu is too large\n", capacity);
+        exit(1);
+    }
+
+    SharedTree *shared = (SharedTree *)(malloc(sizeof(SharedTree)));
+    size_t len = strlen(path) + sizeof(".tmp");
+    char *tmp = (char *)malloc(len);
+    if (!shared || !tmp) {
+        perror("shared_create(): malloc failed");
+        exit(1);
+    }
+    snprintf(tmp, len, "%s.tmp", path);
+
+    shared->bytes = mapping_size(capacity);
+    shared->capacity = capacity;
+    shared->writer = true;
+    shared->fd = open(tmp, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (shared->fd < 0 || ftruncate(shared->fd, shared->bytes) < 0) {
+        perror("shared_create(): cannot create file");
+        exit(1);
+    }
+
+    shared->base = (unsigned char *)mmap(NULL, shared->bytes, PROT_READ | PROT_WRITE, MAP_SHARED, shared->fd, 0);
+    if (shared->base == MAP_FAILED) {
+        perror("shared_create(): mmap failed");
+        exit(1);
+    }
+
+    /* the file starts zeroed: both buffers empty, buffer 0 active */
+    SharedHeader *h = header(shared);
+    h->magic = SHARED_MAGIC;
+    h->version = SHARED_VERSION;
+    h->capacity = capacity;
+
+    if (rename(tmp, path) < 0) {
+        perror("shared_create(): cannot rename file");
+        exit(1);
+    }
+
+    free(tmp);
+    return shared;
+}
+
+
+/**
+ * \ingroup shared
+ * @brief Maps an existing shared tree file read-only.
+ *
+ * @param path The path of the file.
+ * @return A pointer to the reader's mapping, or NULL if the file does not
+ *         exist or is not a shared tree file.
+ */
+SharedTree *shared_open(const char *path) {
+    int fd = open(path, O_RDONLY);
+    struct stat st;
+    if (fd < 0) {
+        return NULL;
+    }
+    if (fstat(fd, &st) < 0 || (size_t)st.st_size < sizeof(SharedHeader)) {
+        close(fd);
+        return NULL;
+    }
+
+    unsigned char *base = (unsigned char *)mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    if (base == MAP_FAILED) {
+        close(fd);
+        return NULL;
+    }
+
+    const SharedHeader *h = (const SharedHeader *)base;
+    if (h->magic != SHARED_MAGIC || h->version != SHARED_VERSION
+        || h->capacity >= UINT32_MAX || mapping_size(h->capacity) != (size_t)st.st_size) {
+        munmap(base, st.st_size);
+        close(fd);
+        return NULL;
+    }
+
+    SharedTree *shared = (SharedTree *)(malloc(sizeof(SharedTree)));
+    if (!shared) {
+        perror("shared_open(): malloc failed");
+        exit(1);
+    }
+
+    shared->fd = fd;
+    shared->base = base;
+    shared->bytes = st.st_size;
+    shared->capacity = h->capacity;
+    shared->writer = false;
+    return shared;
+}
+
+
+/**
+ * \ingroup shared
+ * @brief Unmaps a shared tree. The file itself is left in place.
+ *
+ * @param shared A pointer to the mapping. May be NULL.
+ */
+void shared_close(SharedTree *shared) {
+    if (!shared) {
+        return;
+    }
+
+    munmap(shared->base, shared->bytes);
+    close(shared->fd);
+    free(shared);
+}
+
+
+/**
+ * \ingroup shared
+ * @brief Publishes a snapshot of a tree, replacing the current one.
+ *
+ * The snapshot is laid out as a balanced binary tree in preorder, so a search
+ * usually finds the left child in the same cache line as its parent. Only the
+ * process that created the file may publish, and only from one thread at a
+ * time. Publishing costs O(n), so a writer should batch its updates.
+ *
+ * @param shared A pointer to the writer's mapping.
+ * @param tree   A pointer to the tree to publish, of any engine.
+ * @return true if the snapshot was published, false if @p tree holds more
+ *         values than `SharedTree::capacity`.
+ */
+bool shared_publish(SharedTree *shared, Tree *tree) {
+    if (!shared->writer || tree->size > shared->capacity) {
+        return false;
+    }
+
+    SharedKeys keys = { (int *)malloc(tree->size * sizeof(int) + 1), 0 };
+    if (!keys.keys) {
+        perror("shared_publish(): malloc failed");
+        exit(1);
+    }
+    rbt_foreach(tree, collect_visit, &keys);
+
+    /* readers only use the other buffer, unless they fell two snapshots behind */
+    SharedHeader *h = header(shared);
+    unsigned b = atomic_load_explicit(&h->active, memory_order_relaxed) ^ 1;
+    SharedBuffer *buf = &h->buffers[b];
+    uint64_t seq = atomic_load_explicit(&buf->seq, memory_order_relaxed);
+
+    atomic_store_explicit(&buf->seq, seq + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+
+    uint32_t next = 0;
+    layout(buffer_nodes(shared, b), keys.keys, 0, keys.count, &next);
+    buf->count = keys.count;
+
+    atomic_store_explicit(&buf->seq, seq + 2, memory_order_release);
+    atomic_store_explicit(&h->active, b, memory_order_release);
+    atomic_fetch_add_explicit(&h->generation, 1, memory_order_release);
+
+    free(keys.keys);
+    return true;
+}
+
+
+/**
+ * \ingroup shared
+ * @brief Checks whether a value is in the current snapshot.
+ *
+ * @param shared A pointer to the mapping.
+ * @param value  The value to look for.
+ * @return true if the value is present, false otherwise.
+ */
+bool shared_contains(const SharedTree *shared, const int value) {
+    SharedHeader *h = header(shared);
+    for (;;) {
+        unsigned b = atomic_load_explicit(&h->active, memory_order_acquire) & 1;
+        uint64_t seq = atomic_load_explicit(&h->buffers[b].seq, memory_order_acquire);
+        if (seq & 1) {
+            continue;
+        }
+
+        uint64_t count = h->buffers[b].count;
+        bool found = count <= shared->capacity && search(buffer_nodes(shared, b), count, value);
+
+        atomic_thread_fence(memory_order_acquire);
+        if (atomic_load_explicit(&h->buffers[b].seq, memory_order_relaxed) == seq) {
+            return found;
+        }
+    }
+}
+
+
+/**
+ * \ingroup shared
+ * @brief Visits, in ascending order, the values of the current snapshot in a
+ *        range.
+ *
+ * The values are read straight from the mapping. If the writer published
+ * twice while the range was being visited, the values seen may come from
+ * different snapshots; the function then returns false and the caller should
+ * discard what it was given and try again.
+ *
+ * @param shared A pointer to the mapping.
+ * @param lo     The lower bound of the range (inclusive).
+ * @param hi     The upper bound of the range (inclusive).
+ * @param visit  The function called with each value.
+ * @param ctx    Passed to @p visit unchanged.
+ * @return true if every value visited came from the same snapshot.
+ */
+bool shared_range(const SharedTree *shared, const int lo, const int hi, RbtVisitor visit, void *ctx) {
+    SharedHeader *h = header(shared);
+    unsigned b;
+    uint64_t seq;
+    do {
+        b = atomic_load_explicit(&h->active, memory_order_acquire) & 1;
+        seq = atomic_load_explicit(&h->buffers[b].seq, memory_order_acquire);
+    } while (seq & 1);
+
+    uint64_t count = h->buffers[b].count;
+    bool valid = count <= shared->capacity && visit_range(buffer_nodes(shared, b), count, lo, hi, visit, ctx);
+
+    atomic_thread_fence(memory_order_acquire);
+    return valid && atomic_load_explicit(&h->buffers[b].seq, memory_order_relaxed) == seq;
+}
+
+
+/**
+ * \ingroup shared
+ * @brief Returns the number of values in the current snapshot.
+ *
+ * @param shared A pointer to the mapping.
+ * @return The number of values.
+ */
+size_t shared_size(const SharedTree *shared) {
+    SharedHeader *h = header(shared);
+    for (;;) {
+        unsigned b = atomic_load_explicit(&h->active, memory_order_acquire) & 1;
+        uint64_t seq = atomic_load_explicit(&h->buffers[b].seq, memory_order_acquire);
+        uint64_t count = h->buffers[b].count;
+
+        atomic_thread_fence(memory_order_acquire);
+        if (!(seq & 1) && atomic_load_explicit(&h->buffers[b].seq, memory_order_relaxed) == seq) {
+            return count;
+        }
+    }
+}
+
+
+/**
+ * \ingroup shared
+ * @brief Returns the number of snapshots published since the file was
+ *        created.
+ *
+ * @param shared A pointer to the mapping.
+ * @return The generation of the current snapshot; 0 for the initial, empty
+ *         one.
+ */
+uint64_t shared_generation(const SharedTree *shared) {
+    return atomic_load_explicit(&header(shared)->generation, memory_order_acquire);
+}
@@ -0,0 +1,156 @@
+/**
+ * @file shared.h
+ *
+ * @brief Declaration of a read-only tree shared between processes.
+ *
+ * A `SharedTree` lives in a file-backed mapping (e.g. under `/dev/shm`), so
+ * every process on a host that maps the same file reads the same physical
+ * pages: memory stays constant no matter how many readers there are. Nodes are
+ * linked by offsets instead of `Node *` pointers, so each process may map the
+ * file at any address, and readers search it in place without copying.
+ *
+ * A single writer keeps an ordinary `Tree` and publishes snapshots of it with
+ * `shared_publish()`. The file holds two snapshot buffers: a snapshot is
+ * written into the buffer readers are not using and then made current with a
+ * single atomic store, so readers never wait for the writer. Each buffer
+ * carries a sequence number (a seqlock) so that a reader which was overtaken by
+ * two publications while it searched notices and searches again.
+ *
+ * Key Functions (Declared):
+ * - shared_create(): Creates a shared tree file for the writer.
+ * - shared_open(): Maps an existing shared tree file for reading.
+ * - shared_close(): Unmaps a shared tree.
+ * - shared_publish(): Publishes a snapshot of a tree (writer only).
+ * - shared_contains(): Checks whether a value is in the current snapshot.
+ * - shared_range(): Visits the values of the current snapshot in a range.
+ * - shared_size(), shared_generation(): Describe the current snapshot.
+ *
+ * @version 1.0
+ * @date 2024-02-27
+ * @author Warren Kim
+ */
+
+#ifndef SHARED_H
+#define SHARED_H
+
+#include "rbt.h"
+#include <stdint.h>
+
+/**
+ * @typedef struct SharedTree
+ * @struct SharedTree
+ * @brief A process' mapping of a shared tree file.
+ *
+ * @var SharedTree::fd
+ * The file descriptor of the shared tree file.
+ *
+ * @var SharedTree::base
+ * The address at which the file is mapped in this process.
+ *
+ * @var SharedTree::bytes
+ * The size of the mapping in bytes.
+ *
+ * @var SharedTree::capacity
+ * The maximum number of values a snapshot can hold.
+ *
+ * @var SharedTree::writer
+ * true if this mapping was created by `shared_create()` and may publish.
+ */
+typedef struct SharedTree {
+    int fd;
+    unsigned char *base;
+    size_t bytes;
+    size_t capacity;
+    bool writer;
+} SharedTree;
+
+/**
+ * @brief Creates a shared tree file holding an empty snapshot.
+ *
+ * The file is built under a temporary name and renamed over @p path, so
+ * processes still mapping an older file at that path are unaffected and
+ * processes opening it afterwards see the new one.
+ *
+ * @param path     The path of the file, e.g. "/dev/shm/keys".
+ * @param capacity The maximum number of values a snapshot can hold.
+ * @return A pointer to the writer's mapping, error and exits on failure.
+ */
+SharedTree *shared_create(const char *path, size_t capacity);
+
+/**
+ * @brief Maps an existing shared tree file read-only.
+ *
+ * @param path The path of the file.
+ * @return A pointer to the reader's mapping, or NULL if the file does not
+ *         exist or is not a shared tree file.
+ */
+SharedTree *shared_open(const char *path);
+
+/**
+ * @brief Unmaps a shared tree. The file itself is left in place.
+ *
+ * @param shared A pointer to the mapping. May be NULL.
+ */
+void shared_close(SharedTree *shared);
+
+/**
+ * @brief Publishes a snapshot of a tree, replacing the current one.
+ *
+ * The snapshot is laid out as a balanced binary tree in preorder, so a search
+ * usually finds the left child in the same cache line as its parent. Only the
+ * process that created the file may publish, and only from one thread at a
+ * time. Publishing costs O(n), so a writer should batch its updates.
+ *
+ * @param shared A pointer to the writer's mapping.
+ * @param tree   A pointer to the tree to publish, of any engine.
+ * @return true if the snapshot was published, false if @p tree holds more
+ *         values than `SharedTree::capacity`.
+ */
+bool shared_publish(SharedTree *shared, Tree *tree);
+
+/**
+ * @brief Checks whether a value is in the current snapshot.
+ *
+ * @param shared A pointer to the mapping.
+ * @param value  The value to look for.
+ * @return true if the value is present, false otherwise.
+ */
+bool shared_contains(const SharedTree *shared, const int value);
+
+/**
+ * @brief Visits, in ascending order, the values of the current snapshot in a
+ *        range.
+ *
+ * The values are read straight from the mapping. If the writer published
+ * twice while the range was being visited, the values seen may come from
+ * different snapshots; the function then returns false and the caller should
+ * discard what it was given and try again.
+ *
+ * @param shared A pointer to the mapping.
+ * @param lo     The lower bound of the range (inclusive).
+ * @param hi     The upper bound of the range (inclusive).
+ * @param visit  The function called with each value.
+ * @param ctx    Passed to @p visit unchanged.
+ * @return true if every value visited came from the same snapshot.
+ */
+bool shared_range(const SharedTree *shared, const int lo, const int hi, RbtVisitor visit, void *ctx);
+
+/**
+ * @brief Returns the number of values in the current snapshot.
+ *
+ * @param shared A pointer to the mapping.
+ * @return The number of values.
+ */
+size_t shared_size(const SharedTree *shared);
+
+/**
+ * @brief Returns the number of snapshots published since the file was
+ *        created.
+ *
+ * @param shared A pointer to the mapping.
+ * @return The generation of the current snapshot; 0 for the initial, empty
+ *         one.
+ */
+uint64_t shared_generation(const SharedTree *shared);
+
+#endif
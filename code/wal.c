@@ -0,0 +1,771 @@
+/**
+ * @file wal.c
+ *
+ * @brief Implementation of the write-ahead log.
+ *
+ * File formats (all integers in native byte order):
+ *
+ * @verbatim
+ *  log:         header  = magic "RBTL" (u32), version (u32), generation (u64)
+ *               batch*  = magic "RBTB" (u32), length (u32), checksum (u32),
+ *                         length bytes of records
+ *  record:      op (u8), value (i32) [, range end (i32) for WAL_ERASE_RANGE]
+ *
+ *  checkpoint:  magic "RBTC" (u32), version (u32), generation (u64),
+ *               count (u64), checksum (u32), count values (i32), sorted
+ * @endverbatim
+ *
+ * The checksum is 32-bit FNV-1a over the records or values.
+ *
+ * @version 1.0
+ * @date 2024-02-27
+ * @author Warren Kim
+ */
+
+#include "wal.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#define LOG_MAGIC 0x4c544252u
+#define BATCH_MAGIC 0x42544252u
+#define CKPT_MAGIC 0x43544252u
+#define WAL_VERSION 1u
+#define LOG_HEADER_SIZE 16
+#define BATCH_HEADER_SIZE 12
+#define CKPT_HEADER_SIZE 28
+
+/**
+ * \defgroup wal_helpers Write-Ahead Log Helper Functions
+ *
+ * This section describes the helpers used to encode, write and read the log
+ * and checkpoint files. Key operations include:
+ *
+ * - `checksum()`: Computes the checksum of a byte range.
+ * - `write_all()`, `read_all()`: Transfer a buffer, retrying short transfers.
+ * - `sync_fd()`, `sync_dir()`: Sync a file, or the directory entries of one.
+ * - `file_path()`: Builds the path of the log or checkpoint file.
+ * - `write_log_header()`: Starts a new log file of a given generation.
+ * - `read_log_header()`: Reads the generation of a log.
+ * - `scan_log()`: Validates a log, replaying its batches into a tree.
+ * - `read_checkpoint()`: Loads a checkpoint into a tree.
+ */
+
+/**
+ * \ingroup wal_helpers
+ * @brief Computes the 32-bit FNV-1a checksum of a byte range.
+ *
+ * @param data A pointer to the bytes.
+ * @param len  The number of bytes.
+ * @return     The checksum.
+ */
+static uint32_t checksum(const unsigned char *data, size_t len) {
+    uint32_t h = 2166136261u;
+    for (size_t i = 0; i < len; i++) {
+        h = (h ^ data[i]) * 16777619u;
+    }
+    return h;
+}
+
+
+/**
+ * \ingroup wal_helpers
+ * @brief Returns the current value of a monotonic clock in milliseconds.
+ *
+ * @return The current time in milliseconds.
+ */
+static uint64_t now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+
+/**
+ * \ingroup wal_helpers
+ * @brief Writes a whole buffer, retrying short and interrupted writes.
+ *
+ * @param fd   The file descriptor to write to.
+ * @param data A pointer to the bytes to write.
+ * @param len  The number of bytes to write.
+ *
+ * @note A failed write leaves the log in an unknown state, so the function
+ *       prints an error message and exits the program.
+ */
+static void write_all(int fd, const void *data, size_t len) {
+    const unsigned char *p = (const unsigned char *)data;
+    while (len) {
+        ssize_t n = write(fd, p, len);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            perror("wal: write failed");
+            exit(1);
+        }
+        p += n;
+        len -= n;
+    }
+}
+
+
+/**
+ * \ingroup wal_helpers
+ * @brief Reads a whole buffer, retrying short and interrupted reads.
+ *
+ * @param fd   The file descriptor to read from.
+ * @param data A pointer to the buffer to fill.
+ * @param len  The number of bytes to read.
+ * @return     true if @p len bytes were read, false at end of file or on error.
+ */
+static bool read_all(int fd, void *data, size_t len) {
+    unsigned char *p = (unsigned char *)data;
+    while (len) {
+        ssize_t n = read(fd, p, len);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return false;
+        }
+        p += n;
+        len -= n;
+    }
+    return true;
+}
+
+
+/**
+ * \ingroup wal_helpers
+ * @brief Syncs a file descriptor to disk, exiting on failure.
+ *
+ * @param fd The file descriptor to sync.
+ */
+static void sync_fd(int fd) {
+    if (fsync(fd) < 0) {
+        perror("wal: fsync failed");
+        exit(1);
+    }
+}
+
+
+/**
+ * \ingroup wal_helpers
+ * @brief Syncs the directory containing a file, exiting on failure.
+ *
+ * A `rename()` only survives a crash once the directory holding the renamed
+ * file has been synced; until then the old name may reappear.
+ *
+ * @param path The path of a file in the directory to sync.
+ */
+static void sync_dir(const char *path) {
+    const char *slash = strrchr(path, '/');
+    char *dir = slash ? strndup(path, slash == path ? 1 : (size_t)(slash - path)) : strdup(".");
+    if (!dir) {
+        perror("sync_dir(): malloc failed");
+        exit(1);
+    }
+
+    int fd = open(dir, O_RDONLY | O_DIRECTORY);
+    if (fd < 0) {
+        perror("wal: cannot open directory");
+        exit(1);
+    }
+    sync_fd(fd);
+    close(fd);
+    free(dir);
+}
+
+
+/**
+ * \ingroup wal_helpers
+ * @brief Builds the path of a file belonging to the log.
+ *
+ * @param base   The base path of the log.
+ * @param suffix The suffix of the file, e.g. ".log".
+ * @return       A heap allocated path. The caller frees it.
+ */
+static char *file_path(const char *base, const char *suffix) {
+    size_t len = strlen(base) + strlen(suffix) + 1;
+    char *path = (char *)malloc(len);
+    if (!path) {
+        perror("file_path(): malloc failed");
+        exit(1);
+    }
+
+    snprintf(path, len, "%s%s", base, suffix);
+    return path;
+}
+
+
+/**
+ * \ingroup wal_helpers
+ * @brief Returns the size in bytes of a record for a given operation.
+ *
+ * @param op The operation of the record.
+ * @return   The size of the record, or 0 if @p op is not a valid operation.
+ */
+static size_t record_size(unsigned char op) {
+    switch (op) {
+    case WAL_INSERT:
+    case WAL_DELETE:
+        return 1 + sizeof(int32_t);
+    case WAL_ERASE_RANGE:
+        return 1 + 2 * sizeof(int32_t);
+    default:
+        return 0;
+    }
+}
+
+
+/**
+ * \ingroup wal_helpers
+ * @brief Creates a new, empty log file of a given generation.
+ *
+ * The log is written under a temporary name and renamed into place, so a
+ * crash never leaves a log without a header. The directory is synced after
+ * the rename, so the new log is durable once this returns.
+ *
+ * @param wal        A pointer to the log; its `fd` is replaced.
+ * @param generation The generation of the new log file.
+ */
+static void write_log_header(Wal *wal, uint64_t generation) {
+    char *path = file_path(wal->path, ".log");
+    char *tmp = file_path(wal->path, ".log.tmp");
+    unsigned char header[LOG_HEADER_SIZE];
+    uint32_t magic = LOG_MAGIC;
+    uint32_t version = WAL_VERSION;
+
+    int fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        perror("wal: cannot create log");
+        exit(1);
+    }
+
+    memcpy(header, &magic, 4);
+    memcpy(header + 4, &version, 4);
+    memcpy(header + 8, &generation, 8);
+    write_all(fd, header, sizeof(header));
+    sync_fd(fd);
+
+    if (rename(tmp, path) < 0) {
+        perror("wal: cannot rename log");
+        exit(1);
+    }
+    sync_dir(path);
+
+    if (wal->fd >= 0) {
+        close(wal->fd);
+    }
+    wal->fd = fd;
+    wal->generation = generation;
+
+    free(path);
+    free(tmp);
+}
+
+
+/**
+ * \ingroup wal_helpers
+ * @brief Reads the generation of the checkpoint at a base path.
+ *
+ * @param base The base path of the log.
+ * @param gen  A pointer that receives the generation.
+ * @return     true if a valid checkpoint header was found, false otherwise.
+ */
+static bool checkpoint_generation(const char *base, uint64_t *gen) {
+    char *path = file_path(base, ".ckpt");
+    unsigned char header[CKPT_HEADER_SIZE];
+    uint32_t magic = 0;
+    bool ok = false;
+
+    int fd = open(path, O_RDONLY);
+    if (fd >= 0 && read_all(fd, header, sizeof(header))) {
+        memcpy(&magic, header, 4);
+        memcpy(gen, header + 8, 8);
+        ok = magic == CKPT_MAGIC;
+    }
+
+    if (fd >= 0) {
+        close(fd);
+    }
+    free(path);
+    return ok;
+}
+
+
+/**
+ * \ingroup wal_helpers
+ * @brief Loads the checkpoint at a base path into an empty tree.
+ *
+ * @param base The base path of the log.
+ * @param tree A pointer to the (empty) tree to load into.
+ * @param gen  A pointer that receives the generation of the checkpoint.
+ * @return     true if a valid checkpoint was loaded, false otherwise.
+ */
+static bool read_checkpoint(const char *base, Tree *tree, uint64_t *gen) {
+    char *path = file_path(base, ".ckpt");
+    unsigned char header[CKPT_HEADER_SIZE];
+    uint32_t magic = 0;
+    uint64_t count = 0;
+    uint32_t sum = 0;
+    int32_t *keys = NULL;
+    bool ok = false;
+
+    int fd = open(path, O_RDONLY);
+    free(path);
+    if (fd < 0) {
+        return false;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) == 0 && read_all(fd, header, sizeof(header))) {
+        memcpy(&magic, header, 4);
+        memcpy(gen, header + 8, 8);
+        memcpy(&count, header + 16, 8);
+        memcpy(&sum, header + 24, 4);
+        /* a corrupt count must not overflow the allocation below */
+        bool fits = count <= ((uint64_t)st.st_size - CKPT_HEADER_SIZE) / sizeof(int32_t);
+        keys = magic == CKPT_MAGIC && fits ? (int32_t *)malloc(count * sizeof(int32_t) + 1) : NULL;
+    }
+
+    if (keys && read_all(fd, keys, count * sizeof(int32_t))
+             && checksum((unsigned char *)keys, count * sizeof(int32_t)) == sum) {
+        rbt_build_sorted(tree, keys, count);
+        ok = true;
+    }
+
+    free(keys);
+    close(fd);
+    return ok;
+}
+
+
+/**
+ * \ingroup wal_helpers
+ * @brief Applies the records of one batch to a tree.
+ *
+ * @param tree A pointer to the tree, or NULL to only validate the batch.
+ * @param data A pointer to the records of the batch.
+ * @param len  The length of the records in bytes.
+ * @return     true if every record was well formed, false otherwise.
+ */
+static bool replay_batch(Tree *tree, const unsigned char *data, size_t len) {
+    size_t i = 0;
+    while (i < len) {
+        size_t size = record_size(data[i]);
+        int32_t a, b = 0;
+        if (!size || i + size > len) {
+            return false;
+        }
+
+        memcpy(&a, data + i + 1, 4);
+        if (data[i] == WAL_ERASE_RANGE) {
+            memcpy(&b, data + i + 5, 4);
+        }
+
+        if (tree) {
+            switch (data[i]) {
+            case WAL_INSERT:
+                rbt_insert(tree, a);
+                break;
+            case WAL_DELETE:
+                rbt_delete(tree, a);
+                break;
+            case WAL_ERASE_RANGE:
+                rbt_erase_range(tree, a, b);
+                break;
+            }
+        }
+        i += size;
+    }
+    return true;
+}
+
+
+/**
+ * \ingroup wal_helpers
+ * @brief Reads the header of the log file open at @p fd.
+ *
+ * @param fd  The file descriptor of the log, positioned at its start.
+ * @param gen A pointer that receives the generation of the log.
+ * @return    true if the log has a valid header, false otherwise.
+ */
+static bool read_log_header(int fd, uint64_t *gen) {
+    unsigned char header[LOG_HEADER_SIZE];
+    uint32_t magic = 0;
+
+    if (!read_all(fd, header, sizeof(header))) {
+        return false;
+    }
+    memcpy(&magic, header, 4);
+    memcpy(gen, header + 8, 8);
+    return magic == LOG_MAGIC;
+}
+
+
+/**
+ * \ingroup wal_helpers
+ * @brief Validates the batches of a log file, optionally replaying them.
+ *
+ * Batches are read in order until the end of the file or the first batch that
+ * is incomplete or fails its checksum, which can only be the result of a crash
+ * during a commit.
+ *
+ * @param fd   The file descriptor of the log, positioned after its header.
+ * @param tree A pointer to the tree to replay the log into, or NULL.
+ * @return     The offset just past the last intact batch.
+ */
+static off_t scan_log(int fd, Tree *tree) {
+    unsigned char *batch = NULL;
+    off_t end = LOG_HEADER_SIZE;
+    struct stat st;
+    if (fstat(fd, &st) < 0) {
+        return end;
+    }
+
+    while (true) {
+        unsigned char header[BATCH_HEADER_SIZE];
+        uint32_t magic, len, sum;
+        if (!read_all(fd, header, sizeof(header))) {
+            break;
+        }
+
+        memcpy(&magic, header, 4);
+        memcpy(&len, header + 4, 4);
+        memcpy(&sum, header + 8, 4);
+        /* a corrupt length must not allocate more than the rest of the file */
+        bool fits = len <= st.st_size - end - BATCH_HEADER_SIZE;
+        unsigned char *grown = magic == BATCH_MAGIC && fits ? (unsigned char *)realloc(batch, (size_t)len + 1) : NULL;
+        if (!grown) {
+            break;
+        }
+        batch = grown;
+
+        if (!read_all(fd, batch, len) || checksum(batch, len) != sum || !replay_batch(NULL, batch, len)) {
+            break;
+        }
+        replay_batch(tree, batch, len);
+        end += BATCH_HEADER_SIZE + len;
+    }
+
+    free(batch);
+    return end;
+}
+
+
+/**
+ * \ingroup wal_helpers
+ * @brief The values of a checkpoint being written.
+ */
+typedef struct {
+    int32_t *keys;
+    size_t count;
+} CheckpointBuffer;
+
+
+/**
+ * \ingroup wal_helpers
+ * @brief Copies a visited value into a `CheckpointBuffer`; an `RbtVisitor`.
+ *
+ * @param data The value being visited.
+ * @param ctx  A pointer to the `CheckpointBuffer`.
+ */
+static void checkpoint_visit(int data, void *ctx) {
+    CheckpointBuffer *buf = (CheckpointBuffer *)ctx;
+    buf->keys[buf->count++] = data;
+}
+
+
+
+
+
+/**
+ * \defgroup wal Write-Ahead Log
+ *
+ * This section documents the public facing API of the write-ahead log. Key
+ * operations include:
+ *
+ * - `wal_open()`: Opens (or creates) the log for appending.
+ * - `wal_close()`: Commits pending records and closes the log.
+ * - `wal_append()`: Appends a record, committing the batch if it is due.
+ * - `wal_commit()`: Writes and syncs the pending batch (group commit).
+ * - `wal_tick()`: Commits the pending batch if its interval has passed.
+ * - `wal_checkpoint()`: Writes a sorted checkpoint and starts a new log.
+ * - `wal_recover()`: Rebuilds a tree from the checkpoint and the log.
+ */
+
+/**
+ * \ingroup wal
+ * @brief Opens the log at a base path for appending, creating it if needed.
+ *
+ * A batch torn by a crash at the end of an existing log is truncated away.
+ * If a crash during `wal_checkpoint()` left the log the checkpoint already
+ * covers, a new log is started after the checkpoint instead.
+ *
+ * @param path              The base path of the log and checkpoint files.
+ * @param group_bytes       The batch size at which a batch is committed; 0
+ *                          commits (and syncs) every record.
+ * @param group_interval_ms The time after the last commit at which a batch
+ *                          is committed; negative to disable.
+ * @return A pointer to the open log if successful, error and exits otherwise.
+ */
+Wal *wal_open(const char *path, size_t group_bytes, long group_interval_ms) {
+    Wal *wal = (Wal *)(malloc(sizeof(Wal)));
+    if (!wal) {
+        perror("wal_open(): malloc failed");
+        exit(1);
+    }
+
+    wal->path = file_path(path, "");
+    wal->fd = -1;
+    wal->generation = 0;
+    wal->capacity = BATCH_HEADER_SIZE + (group_bytes ? group_bytes : 16) + 16;
+    wal->buf = (unsigned char *)malloc(wal->capacity);
+    wal->len = BATCH_HEADER_SIZE;
+    wal->group_bytes = group_bytes;
+    wal->group_interval_ms = group_interval_ms;
+    wal->last_commit_ms = now_ms();
+    wal->records = 0;
+    wal->commits = 0;
+    if (!wal->buf) {
+        perror("wal_open(): malloc failed");
+        exit(1);
+    }
+
+    char *log = file_path(path, ".log");
+    uint64_t gen = 0;
+    uint64_t ckpt_gen = 0;
+    bool have_ckpt = checkpoint_generation(path, &ckpt_gen);
+    int fd = open(log, O_RDWR);
+    free(log);
+
+    /* a log no newer than the checkpoint is already covered by it */
+    if (fd >= 0 && read_log_header(fd, &gen) && (!have_ckpt || gen > ckpt_gen)) {
+        off_t end = scan_log(fd, NULL);
+        if (ftruncate(fd, end) < 0 || lseek(fd, end, SEEK_SET) < 0) {
+            perror("wal_open(): cannot truncate torn batch");
+            exit(1);
+        }
+        wal->fd = fd;
+        wal->generation = gen;
+        return wal;
+    }
+
+    if (fd >= 0) {
+        close(fd);
+    }
+
+    write_log_header(wal, have_ckpt ? ckpt_gen + 1 : 1);
+    return wal;
+}
+
+
+/**
+ * \ingroup wal
+ * @brief Commits any pending records and closes the log.
+ *
+ * @param wal A pointer to the log to close. May be NULL.
+ */
+void wal_close(Wal *wal) {
+    if (!wal) {
+        return;
+    }
+
+    wal_commit(wal);
+    close(wal->fd);
+    free(wal->buf);
+    free(wal->path);
+    free(wal);
+}
+
+
+/**
+ * \ingroup wal
+ * @brief Appends a record to the pending batch.
+ *
+ * The batch is committed if it has reached `Wal::group_bytes` or if
+ * `Wal::group_interval_ms` has passed since the last commit (see
+ * `wal_tick()`). This is called by the `rbt_*` functions of a tree the log is
+ * attached to.
+ *
+ * @param wal A pointer to the log.
+ * @param op  The operation to record.
+ * @param a   The value inserted or deleted, or the start of the erased range.
+ * @param b   The end of the erased range; ignored by other operations.
+ */
+void wal_append(Wal *wal, WalOp op, int a, int b) {
+    size_t size = record_size(op);
+    int32_t x = a;
+    int32_t y = b;
+
+    if (wal->len + size > wal->capacity) {
+        wal_commit(wal);
+    }
+
+    wal->buf[wal->len] = (unsigned char)op;
+    memcpy(wal->buf + wal->len + 1, &x, 4);
+    if (op == WAL_ERASE_RANGE) {
+        memcpy(wal->buf + wal->len + 5, &y, 4);
+    }
+    wal->len += size;
+    wal->records++;
+
+    if (wal->len - BATCH_HEADER_SIZE >= wal->group_bytes) {
+        wal_commit(wal);
+    } else {
+        wal_tick(wal);
+    }
+}
+
+
+/**
+ * \ingroup wal
+ * @brief Writes the pending batch to the log and syncs it to disk.
+ *
+ * Once this returns, every record appended so far survives a crash.
+ *
+ * @param wal A pointer to the log.
+ */
+void wal_commit(Wal *wal) {
+    wal->last_commit_ms = now_ms();
+    if (wal->len == BATCH_HEADER_SIZE) {
+        return;
+    }
+
+    uint32_t magic = BATCH_MAGIC;
+    uint32_t len = (uint32_t)(wal->len - BATCH_HEADER_SIZE);
+    uint32_t sum = checksum(wal->buf + BATCH_HEADER_SIZE, len);
+    memcpy(wal->buf, &magic, 4);
+    memcpy(wal->buf + 4, &len, 4);
+    memcpy(wal->buf + 8, &sum, 4);
+
+    write_all(wal->fd, wal->buf, wal->len);
+    sync_fd(wal->fd);
+    wal->len = BATCH_HEADER_SIZE;
+    wal->commits++;
+}
+
+
+/**
+ * \ingroup wal
+ * @brief Commits the pending batch if `Wal::group_interval_ms` has passed.
+ *
+ * `wal_append()` only checks the interval when a record arrives, so the last
+ * batch before a tree goes idle stays unsynced until this is called. Run it
+ * from a timer or an idle loop, every `Wal::group_interval_ms` or so, under
+ * the same lock as the tree the log is attached to.
+ *
+ * @param wal A pointer to the log.
+ * @return    true if a batch was committed, false otherwise.
+ */
+bool wal_tick(Wal *wal) {
+    if (wal->len == BATCH_HEADER_SIZE || wal->group_interval_ms < 0
+        || now_ms() - wal->last_commit_ms < (uint64_t)wal->group_interval_ms) {
+        return false;
+    }
+
+    wal_commit(wal);
+    return true;
+}
+
+
+/**
+ * \ingroup wal
+ * @brief Writes a sorted checkpoint of a tree and starts a new, empty log.
+ *
+ * The checkpoint is written to a temporary file and atomically renamed into
+ * place before the log is replaced, so a crash at any point leaves either the
+ * old checkpoint with the old log, or the new checkpoint. The directory is
+ * synced after each rename, so the new log never survives a crash that loses
+ * the new checkpoint.
+ *
+ * @param wal  A pointer to the log attached to @p tree.
+ * @param tree A pointer to the tree to checkpoint.
+ */
+void wal_checkpoint(Wal *wal, Tree *tree) {
+    CheckpointBuffer buf = { (int32_t *)malloc(tree->size * sizeof(int32_t) + 1), 0 };
+    if (!buf.keys) {
+        perror("wal_checkpoint(): malloc failed");
+        exit(1);
+    }
+
+    wal_commit(wal);
+    rbt_foreach(tree, checkpoint_visit, &buf);
+
+    unsigned char header[CKPT_HEADER_SIZE];
+    uint32_t magic = CKPT_MAGIC;
+    uint32_t version = WAL_VERSION;
+    uint64_t count = buf.count;
+    uint32_t sum = checksum((unsigned char *)buf.keys, buf.count * sizeof(int32_t));
+    memcpy(header, &magic, 4);
+    memcpy(header + 4, &version, 4);
+    memcpy(header + 8, &wal->generation, 8);
+    memcpy(header + 16, &count, 8);
+    memcpy(header + 24, &sum, 4);
+
+    char *path = file_path(wal->path, ".ckpt");
+    char *tmp = file_path(wal->path, ".ckpt.tmp");
+    int fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        perror("wal_checkpoint(): cannot create checkpoint");
+        exit(1);
+    }
+    write_all(fd, header, sizeof(header));
+    write_all(fd, buf.keys, buf.count * sizeof(int32_t));
+    sync_fd(fd);
+    close(fd);
+
+    if (rename(tmp, path) < 0) {
+        perror("wal_checkpoint(): cannot rename checkpoint");
+        exit(1);
+    }
+    /* the new log must not reach the disk before the checkpoint covering the old one */
+    sync_dir(path);
+
+    /* the checkpoint now covers this log; anything after goes to a new one */
+    write_log_header(wal, wal->generation + 1);
+
+    free(path);
+    free(tmp);
+    free(buf.keys);
+}
+
+
+/**
+ * \ingroup wal
+ * @brief Rebuilds a tree from the checkpoint and log at a base path.
+ *
+ * The checkpoint is bulk-loaded with `rbt_build_sorted()`, then every intact
+ * batch of the log written after it is replayed. Missing files are treated as
+ * empty. The returned tree has no log attached.
+ *
+ * @param path   The base path of the log and checkpoint files.
+ * @param engine The engine backing the rebuilt tree.
+ * @return A pointer to the rebuilt tree.
+ */
+Tree *wal_recover(const char *path, Engine engine) {
+    Tree *tree = rbt_init_engine(engine);
+    uint64_t ckpt_gen = 0;
+    bool have_ckpt = read_checkpoint(path, tree, &ckpt_gen);
+
+    char *log = file_path(path, ".log");
+    int fd = open(log, O_RDONLY);
+    free(log);
+    if (fd < 0) {
+        return tree;
+    }
+
+    uint64_t gen = 0;
+    if (read_log_header(fd, &gen) && (!have_ckpt || gen > ckpt_gen)) {
+        scan_log(fd, tree);
+    }
+
+    close(fd);
+    return tree;
+}
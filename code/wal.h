@@ -0,0 +1,196 @@
+/**
+ * @file wal.h
+ *
+ * @brief Declaration of the write-ahead log used to make a Tree durable.
+ *
+ * A `Wal` attached to a `Tree` with `rbt_attach_wal()` receives a compact
+ * record for every insertion and deletion. Records are buffered in memory and
+ * written out in batches ("group commit"): a batch is written and `fsync()`ed
+ * once it reaches a configurable size, or once a configurable interval has
+ * passed since the last commit, so the cost of a sync is shared by every
+ * record in the batch. The interval is checked when a record is appended and
+ * by `wal_tick()`, which a caller runs from a timer so that the last batch of
+ * an idle tree is synced too. Each batch carries a checksum, so a batch torn by a
+ * crash is detected and discarded on recovery.
+ *
+ * To keep recovery fast, `wal_checkpoint()` periodically writes the contents
+ * of the tree as a sorted array and starts a new, empty log. Recovery
+ * (`wal_recover()`) bulk-loads the latest checkpoint in O(n) and replays only
+ * the log written after it.
+ *
+ * Given a base path `p`, the log lives in `p.log` and the checkpoint in
+ * `p.ckpt`.
+ *
+ * Key Functions (Declared):
+ * - wal_open(): Opens (or creates) the log for appending.
+ * - wal_close(): Commits pending records and closes the log.
+ * - wal_append(): Appends a record, committing the batch if it is due.
+ * - wal_commit(): Writes and syncs the pending batch.
+ * - wal_tick(): Commits the pending batch if its interval has passed.
+ * - wal_checkpoint(): Writes a sorted checkpoint of a tree and starts a new log.
+ * - wal_recover(): Rebuilds a tree from the checkpoint and the log.
+ *
+ * @version 1.0
+ * @date 2024-02-27
+ * @author Warren Kim
+ */
+
+#ifndef WAL_H
+#define WAL_H
+
+#include "rbt.h"
+#include <stdint.h>
+
+/**
+ * @typedef enum WalOp
+ * @enum WalOp
+ * @brief The operation recorded by a log record.
+ *
+ * - WAL_INSERT: A value was inserted.
+ * - WAL_DELETE: One occurrence of a value was deleted.
+ * - WAL_ERASE_RANGE: Every value in a range was deleted.
+ */
+typedef enum { WAL_INSERT = 1, WAL_DELETE = 2, WAL_ERASE_RANGE = 3 } WalOp;
+
+/**
+ * @typedef struct Wal
+ * @struct Wal
+ * @brief An open write-ahead log.
+ *
+ * @var Wal::path
+ * The base path of the log and checkpoint files.
+ *
+ * @var Wal::fd
+ * The file descriptor of the log file, positioned at its end.
+ *
+ * @var Wal::generation
+ * The generation of the current log file. A checkpoint records the generation
+ * of the log it supersedes, so a log is only replayed if it is newer.
+ *
+ * @var Wal::buf
+ * The records of the pending batch, preceded by room for its header.
+ *
+ * @var Wal::len
+ * The number of bytes used in @p buf, including the header.
+ *
+ * @var Wal::capacity
+ * The number of bytes allocated for @p buf.
+ *
+ * @var Wal::group_bytes
+ * The batch size (in bytes of records) at which the batch is committed.
+ *
+ * @var Wal::group_interval_ms
+ * The time after the last commit at which the batch is committed, in
+ * milliseconds. A negative value disables the time-based trigger.
+ *
+ * @var Wal::last_commit_ms
+ * The time of the last commit, in milliseconds of a monotonic clock.
+ *
+ * @var Wal::records
+ * The total number of records appended since the log was opened.
+ *
+ * @var Wal::commits
+ * The total number of batches written and synced since the log was opened.
+ */
+typedef struct Wal {
+    char *path;
+    int fd;
+    uint64_t generation;
+    unsigned char *buf;
+    size_t len;
+    size_t capacity;
+    size_t group_bytes;
+    long group_interval_ms;
+    uint64_t last_commit_ms;
+    uint64_t records;
+    uint64_t commits;
+} Wal;
+
+/**
+ * @brief Opens the log at a base path for appending, creating it if needed.
+ *
+ * A batch torn by a crash at the end of an existing log is truncated away.
+ * If a crash during `wal_checkpoint()` left the log the checkpoint already
+ * covers, a new log is started after the checkpoint instead.
+ *
+ * @param path              The base path of the log and checkpoint files.
+ * @param group_bytes       The batch size at which a batch is committed; 0
+ *                          commits (and syncs) every record.
+ * @param group_interval_ms The time after the last commit at which a batch
+ *                          is committed; negative to disable.
+ * @return A pointer to the open log if successful, error and exits otherwise.
+ */
+Wal *wal_open(const char *path, size_t group_bytes, long group_interval_ms);
+
+/**
+ * @brief Commits any pending records and closes the log.
+ *
+ * @param wal A pointer to the log to close. May be NULL.
+ */
+void wal_close(Wal *wal);
+
+/**
+ * @brief Appends a record to the pending batch.
+ *
+ * The batch is committed if it has reached `Wal::group_bytes` or if
+ * `Wal::group_interval_ms` has passed since the last commit (see
+ * `wal_tick()`). This is called by the `rbt_*` functions of a tree the log is
+ * attached to.
+ *
+ * @param wal A pointer to the log.
+ * @param op  The operation to record.
+ * @param a   The value inserted or deleted, or the start of the erased range.
+ * @param b   The end of the erased range; ignored by other operations.
+ */
+void wal_append(Wal *wal, WalOp op, int a, int b);
+
+/**
+ * @brief Writes the pending batch to the log and syncs it to disk.
+ *
+ * Once this returns, every record appended so far survives a crash.
+ *
+ * @param wal A pointer to the log.
+ */
+void wal_commit(Wal *wal);
+
+/**
+ * @brief Commits the pending batch if `Wal::group_interval_ms` has passed.
+ *
+ * `wal_append()` only checks the interval when a record arrives, so the last
+ * batch before a tree goes idle stays unsynced until this is called. Run it
+ * from a timer or an idle loop, every `Wal::group_interval_ms` or so, under
+ * the same lock as the tree the log is attached to.
+ *
+ * @param wal A pointer to the log.
+ * @return    true if a batch was committed, false otherwise.
+ */
+bool wal_tick(Wal *wal);
+
+/**
+ * @brief Writes a sorted checkpoint of a tree and starts a new, empty log.
+ *
+ * The checkpoint is written to a temporary file and atomically renamed into
+ * place before the log is replaced, so a crash at any point leaves either the
+ * old checkpoint with the old log, or the new checkpoint. The directory is
+ * synced after each rename, so the new log never survives a crash that loses
+ * the new checkpoint.
+ *
+ * @param wal  A pointer to the log attached to @p tree.
+ * @param tree A pointer to the tree to checkpoint.
+ */
+void wal_checkpoint(Wal *wal, Tree *tree);
+
+/**
+ * @brief Rebuilds a tree from the checkpoint and log at a base path.
+ *
+ * The checkpoint is bulk-loaded with `rbt_build_sorted()`, then every intact
+ * batch of the log written after it is replayed. Missing files are treated as
+ * empty. The returned tree has no log attached.
+ *
+ * @param path   The base path of the log and checkpoint files.
+ * @param engine The engine backing the rebuilt tree.
+ * @return A pointer to the rebuilt tree.
+ */
+Tree *wal_recover(const char *path, Engine engine);
+
+#endif